@@ -1,4 +1,12 @@
 #include "CameraUnit_ASI.hpp"
+#include "ImageArchive.hpp"
+#include "StorageManager.hpp"
+#include "FrameWriter.hpp"
+#include "FrameSpool.hpp"
+#include "FrameRing.hpp"
+#include "FrameCache.hpp"
+#include "MJPEGServer.hpp"
+#include "AutoExposure.hpp"
 #include "meb_print.h"
 #include "ini.h"
 #include <signal.h>
@@ -21,7 +29,6 @@
 const char *bootcount_fname = "./bootcount.dat";
 
 static int GetBootCount();
-void _Catchable checknmakedir(const char *path);
 
 #include <time.h>
 static inline uint64_t get_msec()
@@ -40,22 +47,53 @@ void sighandler(int sig)
 }
 
 static int bootCount = 0;
-static char dirname[256] = {
-    0,
-};
 
 typedef struct
 {
     const char *progname;
     const char *savedir;
+    const char *spoolfile;
+    const char *shmname;
+    const char *cachesocket;
+    const char *mjpegaddress;
+    const char *meteringmask;
+    const char *aestatefile;
     float cadence,
         maxexposure,
         percentile,
-        temperature;
+        temperature,
+        mjpegrate,
+        meteringx,
+        meteringy,
+        meteringradius;
     int maxbin,
         value,
         uncertainty,
-        gain;
+        gain,
+        framesperfile,
+        minutesperfile,
+        rolloverhour,
+        utc,
+        quotamb,
+        minfreemb,
+        binnedfreemb,
+        previewfreemb,
+        metadatafreemb,
+        spoolslots,
+        shmslots,
+        thumbsize,
+        mjpegport,
+        mjpegwidth,
+        mjpegheight,
+        meteringmode,
+        meteringstride,
+        meteringleft,
+        meteringtop,
+        meteringwidth,
+        meteringheight,
+        meteringmaskscale,
+        aecontroller,
+        pixelbias;
 } asicam_config;
 
 static int inihandler(void *user, const char *section, const char *name, const char *value)
@@ -130,6 +168,142 @@ static int inihandler(void *user, const char *section, const char *name, const c
     {
         pconfig->gain = atol(value);
     }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "framesperfile") == 0))
+    {
+        pconfig->framesperfile = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "minutesperfile") == 0))
+    {
+        pconfig->minutesperfile = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "rolloverhour") == 0))
+    {
+        pconfig->rolloverhour = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "utc") == 0))
+    {
+        pconfig->utc = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "quotamb") == 0))
+    {
+        pconfig->quotamb = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "minfreemb") == 0))
+    {
+        pconfig->minfreemb = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "binnedfreemb") == 0))
+    {
+        pconfig->binnedfreemb = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "previewfreemb") == 0))
+    {
+        pconfig->previewfreemb = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "metadatafreemb") == 0))
+    {
+        pconfig->metadatafreemb = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "spoolfile") == 0))
+    {
+        pconfig->spoolfile = strdup(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "spoolslots") == 0))
+    {
+        pconfig->spoolslots = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "shmname") == 0))
+    {
+        pconfig->shmname = strdup(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "shmslots") == 0))
+    {
+        pconfig->shmslots = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "cachesocket") == 0))
+    {
+        pconfig->cachesocket = strdup(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "thumbsize") == 0))
+    {
+        pconfig->thumbsize = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "mjpegaddress") == 0))
+    {
+        pconfig->mjpegaddress = strdup(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "mjpegport") == 0))
+    {
+        pconfig->mjpegport = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "mjpegrate") == 0))
+    {
+        pconfig->mjpegrate = atof(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "mjpegwidth") == 0))
+    {
+        pconfig->mjpegwidth = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "mjpegheight") == 0))
+    {
+        pconfig->mjpegheight = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringmode") == 0))
+    {
+        pconfig->meteringmode = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringstride") == 0))
+    {
+        pconfig->meteringstride = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringleft") == 0))
+    {
+        pconfig->meteringleft = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringtop") == 0))
+    {
+        pconfig->meteringtop = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringwidth") == 0))
+    {
+        pconfig->meteringwidth = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringheight") == 0))
+    {
+        pconfig->meteringheight = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringx") == 0))
+    {
+        pconfig->meteringx = atof(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringy") == 0))
+    {
+        pconfig->meteringy = atof(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringradius") == 0))
+    {
+        pconfig->meteringradius = atof(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringmask") == 0))
+    {
+        pconfig->meteringmask = strdup(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "meteringmaskscale") == 0))
+    {
+        pconfig->meteringmaskscale = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "aecontroller") == 0))
+    {
+        pconfig->aecontroller = atol(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "aestatefile") == 0))
+    {
+        pconfig->aestatefile = strdup(value);
+    }
+    else if ((strcmp(section, "CONFIG") == 0 && strcmp(name, "pixelbias") == 0))
+    {
+        pconfig->pixelbias = atol(value);
+    }
     else
     {
         dbprintlf(RED_FG "%s -> %s: %s not accounted for.", section, name, value);
@@ -162,14 +336,48 @@ void frame_grabber(CCameraUnit *cam, uint64_t cadence, volatile bool *start_capt
     asicam_config pconfig = {
         .progname = progname,
         .savedir = "./data/",
+        .spoolfile = "",
+        .shmname = "",
+        .cachesocket = "",
+        .mjpegaddress = "",
+        .meteringmask = "",
+        .aestatefile = "",
         .cadence = 20,
         .maxexposure = 200,
         .percentile = 99.7,
         .temperature = -20,
+        .mjpegrate = 5,
+        .meteringx = 0,
+        .meteringy = 0,
+        .meteringradius = 0,
         .maxbin = 1,
         .value = 40000,
         .uncertainty = 5000,
         .gain = 200,
+        .framesperfile = 1,
+        .minutesperfile = 30,
+        .rolloverhour = 0,
+        .utc = 0,
+        .quotamb = 0,
+        .minfreemb = 0,
+        .binnedfreemb = 0,
+        .previewfreemb = 0,
+        .metadatafreemb = 0,
+        .spoolslots = 8,
+        .shmslots = 4,
+        .thumbsize = 256,
+        .mjpegport = 8080,
+        .mjpegwidth = 1024,
+        .mjpegheight = 1024,
+        .meteringmode = 0,
+        .meteringstride = 1,
+        .meteringleft = 0,
+        .meteringtop = 0,
+        .meteringwidth = 0,
+        .meteringheight = 0,
+        .meteringmaskscale = 1,
+        .aecontroller = 0,
+        .pixelbias = 0,
     };
 
     if (ini_parse("./asicam.ini", inihandler, &pconfig) < 0)
@@ -216,6 +424,128 @@ void frame_grabber(CCameraUnit *cam, uint64_t cadence, volatile bool *start_capt
         return;
     }
 
+    CStorageManager *storage = nullptr;
+    try
+    {
+        storage = new CStorageManager(savedir, pconfig.rolloverhour, pconfig.utc != 0, (uint64_t)pconfig.quotamb * 1048576LLU, (uint64_t)pconfig.minfreemb * 1048576LLU);
+    }
+    catch (const std::exception &e)
+    {
+        dbprintlf(FATAL "Error creating storage manager: %s", e.what());
+        return;
+    }
+
+    CImageArchive *archive = nullptr;
+    if (pconfig.framesperfile > 1) // append frames to rolling containers instead of one file per frame
+    {
+        archive = new CImageArchive(savedir, "comics", pconfig.framesperfile, pconfig.minutesperfile, true);
+    }
+    // full FITS -> binned FITS -> JPEG preview -> metadata only as the disk fills up
+    CFrameWriter writer(*storage, "comics", (uint64_t)pconfig.binnedfreemb * 1048576LLU, (uint64_t)pconfig.previewfreemb * 1048576LLU, (uint64_t)pconfig.metadatafreemb * 1048576LLU, 2, archive, true);
+
+    CFrameRing *ring = nullptr;
+    if (pconfig.shmname != NULL && strlen(pconfig.shmname) > 0) // live frames for viewers and quick-look processes
+    {
+        try
+        {
+            ring = new CFrameRing(pconfig.shmname, pconfig.shmslots, cam->GetCCDWidth(), cam->GetCCDHeight());
+        }
+        catch (const std::exception &e)
+        {
+            dbprintlf(RED_FG "Could not create frame ring %s: %s", pconfig.shmname, e.what());
+            ring = nullptr;
+        }
+    }
+
+    CFrameCache *cache = nullptr;
+    if (pconfig.cachesocket != NULL && strlen(pconfig.cachesocket) > 0) // JPEG and thumbnail of the latest frame for local clients
+    {
+        try
+        {
+            cache = new CFrameCache(pconfig.cachesocket, pconfig.thumbsize);
+            cam->SetFrameCache(cache); // updated by the camera with every frame
+        }
+        catch (const std::exception &e)
+        {
+            dbprintlf(RED_FG "Could not create frame cache %s: %s", pconfig.cachesocket, e.what());
+            cache = nullptr;
+        }
+    }
+
+    CMJPEGServer *preview = nullptr;
+    if (pconfig.mjpegaddress != NULL && strlen(pconfig.mjpegaddress) > 0) // live preview for focusing and alignment
+    {
+        try
+        {
+            preview = new CMJPEGServer(pconfig.mjpegaddress, pconfig.mjpegport, pconfig.mjpegrate, pconfig.mjpegwidth, pconfig.mjpegheight);
+        }
+        catch (const std::exception &e)
+        {
+            dbprintlf(RED_FG "Could not start preview server on %s: %s", pconfig.mjpegaddress, e.what());
+            preview = nullptr;
+        }
+    }
+
+    // auto-exposure metering, positions in unbinned sensor pixels
+    CImageMetering metering;
+    metering.mode = (CImageMeteringMode)pconfig.meteringmode;
+    metering.stride = pconfig.meteringstride;
+    metering.roiLeft = pconfig.meteringleft;
+    metering.roiTop = pconfig.meteringtop;
+    metering.roiWidth = pconfig.meteringwidth;
+    metering.roiHeight = pconfig.meteringheight;
+    metering.centerX = pconfig.meteringx;
+    metering.centerY = pconfig.meteringy;
+    metering.radius = pconfig.meteringradius;
+    metering.weightsScale = pconfig.meteringmaskscale;
+    if (metering.mode == METERING_WEIGHTED) // weight mask from the upper 8 bits of a FITS image
+    {
+        CImageData mask;
+        if (pconfig.meteringmask != NULL && strlen(pconfig.meteringmask) > 0 && mask.LoadFITS(pconfig.meteringmask))
+        {
+            const unsigned short *data = mask.GetImageData();
+            metering.weightsWidth = mask.GetImageWidth();
+            metering.weightsHeight = mask.GetImageHeight();
+            metering.weights.resize((size_t)metering.weightsWidth * metering.weightsHeight);
+            for (size_t i = 0; i < metering.weights.size(); i++)
+            {
+                metering.weights[i] = data[i] >> 8;
+            }
+        }
+        else
+        {
+            dbprintlf(RED_FG "Could not load metering mask %s, metering the whole frame", pconfig.meteringmask);
+            metering.mode = METERING_FULL;
+        }
+    }
+
+    CAutoExposureController *autoexposure = nullptr;
+    if (pconfig.aecontroller) // predictive auto exposure, warm-started from the saved state
+    {
+        autoexposure = new CAutoExposureController(pixelTarget, pixelUncertainty, pixelPercentile, maxExposure, maxBin, 100, pconfig.aestatefile != NULL ? pconfig.aestatefile : "");
+        autoexposure->SetMetering(metering);
+        autoexposure->SetPixelBias(pconfig.pixelbias);
+        if (autoexposure->Predict(get_msec(), exposure_1, bin_1))
+        {
+            bprintlf(YELLOW_FG "AERO: Starting from saved state, exposure %.3f s, bin %d", exposure_1, bin_1);
+        }
+    }
+
+    CFrameSpool *spool = nullptr;
+    if (pconfig.spoolfile != NULL && strlen(pconfig.spoolfile) > 0 && pconfig.spoolslots > 0) // frames survive a crash until they are saved
+    {
+        try
+        {
+            spool = new CFrameSpool(pconfig.spoolfile, pconfig.spoolslots, cam->GetCCDWidth(), cam->GetCCDHeight(), [&writer](CImageData &frame)
+                                    { return writer.Write(frame); });
+        }
+        catch (const std::exception &e)
+        {
+            dbprintlf(RED_FG "Could not open spool %s, saving directly: %s", pconfig.spoolfile, e.what());
+            spool = nullptr;
+        }
+    }
+
     while (!done)
     {
         uint64_t start = get_msec();
@@ -234,35 +564,52 @@ void frame_grabber(CCameraUnit *cam, uint64_t cadence, volatile bool *start_capt
                 cam->SetExposure(exposure_1);
             }
             CImageData img = cam->CaptureImage(); // capture frame
+            if (ring != nullptr)
+            {
+                ring->Publish(img);
+            }
+            if (preview != nullptr)
+            {
+                preview->Submit(img); // skipped above the preview rate
+            }
 
-            time_t t = time(NULL);
-            struct tm tm = *localtime(&t);
-
-            snprintf(dirname, sizeof(dirname), "data/%04d%02d%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
-
+            bool saved = false;
             try
             {
-                checknmakedir(dirname);
+                if (spool != nullptr)
+                {
+                    saved = spool->Push(img); // saved on the converter thread
+                }
+                if (!saved)
+                {
+                    saved = writer.Write(img);
+                }
             }
             catch (const std::exception &e)
             {
                 dbprintlf(FATAL "Error creating directory: %s", e.what());
                 exit(0);
             }
-
-            if (!img.SaveFITS(true, (char const *)dirname, (char const *)"comics_%" PRIu64, start)) // save frame
+            if (!saved) // save frame
             {
                 bprintlf(FATAL "[%" PRIu64 "] AERO: Could not save FITS", start);
             }
             else
             {
-                bprintlf(GREEN_FG "[%" PRIu64 "] AERO: Saved Exposure %.3f s, Bin %d", start, exposure_1, bin_1);
+                bprintlf(GREEN_FG "[%" PRIu64 "] AERO: Saved Exposure %.3f s, Bin %d (%s)", start, exposure_1, bin_1, CFrameWriter::LevelName(writer.GetLevel()));
             }
             sync();
             // run auto exposure
             float last_exposure = exposure_1;
             int last_bin = bin_1;
-            img.FindOptimumExposure(exposure_1, bin_1, pixelPercentile, pixelTarget, maxExposure, maxBin, 100, pixelUncertainty);
+            if (autoexposure != nullptr)
+            {
+                autoexposure->Update(img, exposure_1, bin_1);
+            }
+            else
+            {
+                img.FindOptimumExposure(exposure_1, bin_1, pixelPercentile, pixelTarget, maxExposure, maxBin, 100, pixelUncertainty, &metering);
+            }
             if (exposure_1 != last_exposure)
             {
                 bprintlf(YELLOW_FG "[%" PRIu64 "] AERO: Exposure changed from %.3f s to %.3f s", start, last_exposure, exposure_1);
@@ -287,6 +634,32 @@ void frame_grabber(CCameraUnit *cam, uint64_t cadence, volatile bool *start_capt
             }
         }
     }
+    if (spool != nullptr)
+    {
+        delete spool; // converts the remaining frames
+    }
+    if (autoexposure != nullptr)
+    {
+        delete autoexposure;
+    }
+    if (preview != nullptr)
+    {
+        delete preview;
+    }
+    if (cache != nullptr)
+    {
+        cam->SetFrameCache(nullptr);
+        delete cache;
+    }
+    if (ring != nullptr)
+    {
+        delete ring;
+    }
+    if (archive != nullptr)
+    {
+        delete archive;
+    }
+    delete storage;
 }
 
 int main(int argc, char *argv[])
@@ -446,29 +819,3 @@ rewrite:
     close(fd);
     return current_pos;
 }
-
-void _Catchable checknmakedir(const char *path)
-{
-    DIR *dir = opendir(path);
-    if (dir)
-    {
-        /* Directory exists. */
-        closedir(dir);
-    }
-    else if (ENOENT == errno)
-    {
-        char buf[512];
-        snprintf(buf, sizeof(buf), "mkdir -p %s", path);
-        int retval = system(buf);
-        if (retval)
-        {
-            dbprintlf(FATAL "could not create directory %s, retval %d", path, retval);
-            throw std::runtime_error("Could not create savedir, retval " + std::to_string(retval));
-        }
-    }
-    else
-    {
-        dbprintlf(FATAL "could not create directory %s", path);
-        throw std::runtime_error("Could not create savedir");
-    }
-}
\ No newline at end of file
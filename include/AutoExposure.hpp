@@ -0,0 +1,144 @@
+/**
+ * @file AutoExposure.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Closed-loop auto-exposure controller with sky brightness prediction
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __AUTOEXPOSURE_HPP__
+#define __AUTOEXPOSURE_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+#include "ImageData.hpp"
+
+#ifndef CAUTOEXPOSURE_DBG_LVL
+/**
+ * @brief Debug level for CAutoExposureController. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CAUTOEXPOSURE_DBG_LVL 3
+#endif
+
+/**
+ * @brief Auto-exposure controller that keeps state across frames.
+ *
+ * Every frame gives a measurement of the sky brightness, the metered pixel count (less the pixel bias)
+ * per second of exposure and per unbinned pixel. The controller tracks the logarithm of the brightness
+ * and its rate of change with an alpha-beta filter, predicts the brightness at the time of the next
+ * frame and picks the exposure and bin that put the metered pixel count on the target. An integral term
+ * removes a persistent offset between the target and the measured pixel counts. The exposure is held
+ * while the predicted pixel count stays within the target uncertainty, so the exposure does not chatter.
+ *
+ * Saturated and black frames only bound the brightness; they move the estimate by at least a factor
+ * of 2 in the right direction, but do not update the trend.
+ *
+ * The state is written to a file after every frame (if a file is given) and read back on construction,
+ * so that the first frame after a restart is exposed for the predicted brightness.
+ *
+ */
+class CAutoExposureController
+{
+public:
+    /**
+     * @brief Construct a new CAutoExposureController object.
+     *
+     * @param pixelTarget [optional] Target pixel count at the percentile (default: 40000).
+     * @param pixelTargetUncertainty [optional] Exposure is held while the predicted pixel count is within this of the target (default: 5000).
+     * @param percentilePixel [optional] Pixel percentile (default: 80).
+     * @param maxAllowedExposure [optional] Maximum exposure in seconds (default: 10).
+     * @param maxAllowedBin [optional] Maximum bin, the bin is kept as is if < 1 (default: 4).
+     * @param numPixelExclusion [optional] Number of brightest pixels excluded from the percentile (default: 100).
+     * @param stateFile [optional] File to save the state to after every frame and to warm-start from, empty to keep the state in memory only (default: empty).
+     */
+    CAutoExposureController(int pixelTarget = 40000, int pixelTargetUncertainty = 5000, float percentilePixel = 80, float maxAllowedExposure = 10.0, int maxAllowedBin = 4, int numPixelExclusion = 100, const std::string &stateFile = "");
+
+    /**
+     * @brief Set the pixels to meter (default: whole image).
+     *
+     * @param metering Metering settings.
+     */
+    void SetMetering(const CImageMetering &metering);
+
+    /**
+     * @brief Set the filter and controller gains.
+     *
+     * @param alpha [optional] Fraction of the brightness prediction error applied every frame, 0 - 1 (default: 0.7).
+     * @param beta [optional] Fraction of the prediction error applied to the brightness trend, 0 - 1 (default: 0.3).
+     * @param ki [optional] Integral gain on the log of target / measured pixel count, 0 to disable (default: 0.2).
+     */
+    void SetGains(float alpha = 0.7, float beta = 0.3, float ki = 0.2);
+
+    /**
+     * @brief Set the pixel count of a black pixel (camera offset), subtracted before the brightness is computed.
+     *
+     * @param pixelBias Pixel bias (default: 0).
+     */
+    void SetPixelBias(int pixelBias);
+
+    /**
+     * @brief Update the controller with a new frame and get the exposure and bin for the next frame.
+     *
+     * @param img New frame, with exposure, binning and timestamp in the metadata.
+     * @param exposure Exposure for the next frame in seconds (output).
+     * @param bin Bin for the next frame (output).
+     * @return bool Returns true if the frame was used, false if it has no data, no exposure or no metered pixel (outputs are then the frame exposure and bin).
+     */
+    bool Update(const CImageData &img, float &exposure, int &bin);
+
+    /**
+     * @brief Predict the exposure and bin for a frame at a given time from the saved state, e.g. for the
+     * first frame after a restart.
+     *
+     * @param timestamp Time of the frame, ms since epoch.
+     * @param exposure Exposure in seconds (output).
+     * @param bin Bin (output).
+     * @return bool Returns true if there is a state recent enough to predict from, false otherwise (outputs are unchanged).
+     */
+    bool Predict(uint64_t timestamp, float &exposure, int &bin) const;
+
+    /**
+     * @brief Forget the state. The next frame starts a new brightness estimate.
+     *
+     */
+    void Reset();
+
+private:
+    CAutoExposureController(const CAutoExposureController &);
+    CAutoExposureController &operator=(const CAutoExposureController &);
+
+    void Choose(double effectiveExposure, int currentBin, float &exposure, int &bin) const;
+    bool LoadState();
+    bool SaveState() const;
+
+    int m_target;
+    int m_uncertainty;
+    float m_percentile;
+    float m_maxExposure;
+    int m_maxBin;
+    int m_exclusion;
+    std::string m_stateFile;
+    CImageMetering m_metering;
+    float m_alpha;
+    float m_beta;
+    float m_ki;
+    int m_bias;
+
+    bool m_valid;        // brightness estimate exists
+    bool m_tracking;     // estimate is from measurements, not from a saturated or black frame
+    uint64_t m_time;     // time of the last frame, ms since epoch
+    double m_brightness; // log of counts per second per unbinned pixel
+    double m_trend;      // rate of change of m_brightness, per second
+    double m_integral;   // log exposure correction
+    double m_interval;   // time between the last two frames, s
+    int m_bin;           // bin chosen for the next frame
+
+    mutable std::mutex m_mutex;
+};
+
+#endif // __AUTOEXPOSURE_HPP__
@@ -14,6 +14,8 @@
 #include <string>
 #include "ImageData.hpp"
 
+class CFrameCache;
+
 #ifndef _Catchable
 /**
  * @brief Functions marked with _Catchable are expected to throw exceptions.
@@ -132,6 +134,14 @@ public:
      */
     virtual const CImageData *GetLastImage() const = 0;
 
+    /**
+     * @brief Set the latest-frame cache. Every captured image is passed to it next to the last image,
+     * and is encoded and served by the cache without touching the capture path.
+     *
+     * @param cache Cache ({@link CFrameCache}), not owned. nullptr to detach the cache, which must be done before it is deleted.
+     */
+    virtual void SetFrameCache(CFrameCache *cache) = 0;
+
     /**
      * @brief Check if camera was initialized properly
      *
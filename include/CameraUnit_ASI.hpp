@@ -41,6 +41,7 @@ private:
     std::atomic<double> exposure_;
     std::atomic<bool> capturing;
     std::shared_ptr<CImageData> image_data;
+    std::atomic<CFrameCache *> frame_cache{nullptr};
 
     char cam_name[100];
     std::string status_;
@@ -96,6 +97,7 @@ public:
     void CancelCapture();
     bool IsCapturing() const { return capturing; };
     const CImageData *GetLastImage() const;
+    inline void SetFrameCache(CFrameCache *cache) { frame_cache = cache; }
 
     inline bool CameraReady() const { return init_ok; }
     inline const char *CameraName() const { return cam_name; }
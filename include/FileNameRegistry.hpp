@@ -0,0 +1,90 @@
+/**
+ * @file FileNameRegistry.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Constant-time collision-free file creation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __FILENAMEREGISTRY_HPP__
+#define __FILENAMEREGISTRY_HPP__
+
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @brief Process-wide registry of file names in output directories.
+ * A directory is read once, the first time a file is created in it. After that,
+ * unique names (<stem><ext>, <stem>_1<ext>, <stem>_2<ext>, ...) are picked from
+ * memory and the file is created with O_CREAT | O_EXCL, so there is no probing
+ * and no window between the name check and file creation.
+ *
+ */
+class CFileNameRegistry
+{
+public:
+    /**
+     * @brief Get the process-wide registry.
+     *
+     * @return CFileNameRegistry& Registry instance.
+     */
+    static CFileNameRegistry &Instance();
+
+    /**
+     * @brief Create a new file with a unique name in a directory.
+     *
+     * @param dirName Directory to create the file in. Must exist.
+     * @param stem File name without extension.
+     * @param ext File extension including the dot, e.g. ".fits".
+     * @param path Full path of the created file (output).
+     * @param flags [optional] Additional open(2) flags, O_WRONLY | O_CREAT | O_EXCL are always set.
+     * @return int File descriptor of the created file, or -1 on error (errno is set).
+     */
+    int CreateUnique(const std::string &dirName, const std::string &stem, const std::string &ext, std::string &path, int flags = 0);
+
+    /**
+     * @brief Create a new file with a unique name and write a buffer to it. The file is
+     * preallocated to its final size first, so a full disk is detected before any data
+     * is written and the file is not fragmented. The file is removed if it can not be
+     * written completely.
+     *
+     * @param dirName Directory to create the file in. Must exist.
+     * @param stem File name without extension.
+     * @param ext File extension including the dot, e.g. ".fits".
+     * @param data Data to write.
+     * @param size Size of data in bytes.
+     * @param path Full path of the created file (output).
+     * @param syncOnWrite [optional] Call fsync() after writing (default: false).
+     * @return bool Returns true on success, false otherwise (errno is set, ENOSPC if the disk is full).
+     */
+    bool WriteUnique(const std::string &dirName, const std::string &stem, const std::string &ext, const void *data, size_t size, std::string &path, bool syncOnWrite = false);
+
+    /**
+     * @brief Drop the cached listing for a directory, e.g. after it has been rotated out or deleted.
+     *
+     * @param dirName Directory name.
+     */
+    void Forget(const std::string &dirName);
+
+private:
+    CFileNameRegistry() {}
+    CFileNameRegistry(const CFileNameRegistry &);
+    CFileNameRegistry &operator=(const CFileNameRegistry &);
+
+    struct DirEntry
+    {
+        std::unordered_set<std::string> names;      // names known to exist in the directory
+        std::unordered_map<std::string, int> next;  // next suffix to try for a colliding stem
+    };
+
+    DirEntry &GetDir(const std::string &dirName);
+
+    std::unordered_map<std::string, DirEntry> m_dirs;
+    std::mutex m_mutex;
+};
+
+#endif // __FILENAMEREGISTRY_HPP__
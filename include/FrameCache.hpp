@@ -0,0 +1,145 @@
+/**
+ * @file FrameCache.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Latest-frame cache with precomputed JPEG and thumbnail, served over a Unix socket
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __FRAMECACHE_HPP__
+#define __FRAMECACHE_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "ImageData.hpp"
+#include "FrameServer.hpp"
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef CFRAMECACHE_DBG_LVL
+/**
+ * @brief Debug level for CFrameCache. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CFRAMECACHE_DBG_LVL 3
+#endif
+
+/**
+ * @brief Keeps the latest frame as a JPEG image, a JPEG thumbnail and a text metadata block,
+ * and serves them to any number of clients over a Unix domain socket.
+ *
+ * A camera unit keeps the cache up to date once it is attached with CCameraUnit::SetFrameCache().
+ * Update() only copies the frame and wakes the encoder thread; the encoder converts the
+ * newest frame once (frames that arrive while it is busy are dropped), and the server
+ * thread sends the same encoded buffers to every client without re-encoding. The images
+ * are encoded with the JPEG settings of the frame; the thumbnail is binned down by a power
+ * of 2 to fit.
+ *
+ * Clients send one request per line and get a "<sequence> <length>\n" header followed by
+ * length bytes for every request. The sequence is 0 (and the length 0) until the first
+ * frame is encoded. Requests:
+ * - "JPEG": full frame JPEG image.
+ * - "THUMB": thumbnail JPEG image.
+ * - "META": frame metadata, "key=value" lines.
+ * - "NEXT JPEG", "NEXT THUMB", "NEXT META": same as above, but wait until a frame newer
+ *   than the last one sent on this connection is encoded.
+ *
+ * Unknown requests get "ERR\n" and the connection is closed.
+ *
+ */
+class CFrameCache
+{
+public:
+    /**
+     * @brief Create the socket and start the encoder and server threads.
+     *
+     * @param socketPath Unix domain socket path. A stale socket at the path is removed.
+     * @param thumbSize [optional] Maximum thumbnail width and height (default: 256).
+     * @param jpegQuality [optional] JPEG quality, 10 - 100 (default: 90).
+     */
+    _Catchable CFrameCache(const std::string &socketPath, int thumbSize = 256, int jpegQuality = 90);
+
+    /**
+     * @brief Stop the threads, disconnect the clients and remove the socket.
+     *
+     */
+    ~CFrameCache();
+
+    /**
+     * @brief Replace the cached frame. Copies the frame and returns without encoding it.
+     *
+     * @param img Newest image.
+     */
+    void Update(const CImageData &img);
+
+    /**
+     * @brief Get the sequence number of the last encoded frame.
+     *
+     * @return uint64_t Sequence number, 0 if no frame was encoded yet.
+     */
+    uint64_t GetSequence() const;
+
+    /**
+     * @brief Get the number of frames replaced by a newer frame before they were encoded.
+     *
+     * @return uint64_t Number of frames.
+     */
+    uint64_t GetDropped() const;
+
+    /**
+     * @brief Get the number of connected clients.
+     *
+     * @return int Number of clients.
+     */
+    int GetClients() const;
+
+private:
+    CFrameCache(const CFrameCache &);
+    CFrameCache &operator=(const CFrameCache &);
+
+    typedef CFrameServerClient::Buffer Buffer;
+
+    struct Entry
+    {
+        uint64_t sequence;
+        Buffer jpeg;
+        Buffer thumb;
+        Buffer meta;
+    };
+
+    void EncoderThread();
+    bool ServeClient(CFrameServerClient &client, uint64_t now);
+    Entry GetEntry() const;
+
+    std::string m_socketPath;
+    int m_thumbSize;
+    int m_jpegQuality;
+
+    CFrameServer *m_server;
+
+    CImageData *m_pending; // newest frame not yet encoded
+    uint64_t m_updates;
+    uint64_t m_dropped;
+    Entry m_entry;
+    bool m_done;
+
+    std::thread m_encoder;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+#endif // __FRAMECACHE_HPP__
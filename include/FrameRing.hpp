@@ -0,0 +1,179 @@
+/**
+ * @file FrameRing.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief POSIX shared memory frame ring for external consumers
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __FRAMERING_HPP__
+#define __FRAMERING_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+#include "ImageData.hpp"
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef CFRAMERING_DBG_LVL
+/**
+ * @brief Debug level for CFrameRing. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CFRAMERING_DBG_LVL 3
+#endif
+
+/**
+ * @brief Zero-copy view of a frame in a CFrameRing, filled by CFrameRingReader::Acquire().
+ * The pixels point into shared memory and stay valid until the slot is reused by the publisher,
+ * which CFrameRingReader::Release() detects.
+ *
+ */
+typedef struct
+{
+    uint64_t sequence;          /*!< Frame sequence number, starts at 1 */
+    int width;                  /*!< Image width */
+    int height;                 /*!< Image height */
+    const unsigned short *data; /*!< Pixels in shared memory */
+    CImageMetadata metadata;    /*!< Image metadata (copied) */
+    uint32_t ticket;            /*!< Slot version when the view was acquired */
+    const void *slot;           /*!< Slot in shared memory */
+} CFrameRingView;
+
+/**
+ * @brief Publishes frames into a POSIX shared memory (shm_open) ring of slots.
+ * Every slot is protected by a sequence lock: the publisher never waits for readers, and
+ * readers detect a frame that was overwritten while they were using it. The segment is
+ * recreated (and readers re-attach) when a publisher starts, also after a previous publisher crashed.
+ *
+ */
+class CFrameRing
+{
+public:
+    /**
+     * @brief Create the shared memory ring.
+     *
+     * @param name Shared memory object name, e.g. "/asicam_frames".
+     * @param nSlots Number of frames in the ring. A reader has nSlots - 1 frame periods to use a frame.
+     * @param maxWidth Maximum image width.
+     * @param maxHeight Maximum image height.
+     */
+    _Catchable CFrameRing(const std::string &name, int nSlots, int maxWidth, int maxHeight);
+
+    /**
+     * @brief Mark the ring inactive and remove the shared memory object name. Attached readers keep their mapping.
+     *
+     */
+    ~CFrameRing();
+
+    /**
+     * @brief Publish a frame to the ring and wake up waiting readers.
+     *
+     * @param img Image to publish.
+     * @return bool Returns true on success, false if the image is too large.
+     */
+    bool Publish(const CImageData &img);
+
+    /**
+     * @brief Get the sequence number of the last published frame.
+     *
+     * @return uint64_t Sequence number, 0 if nothing was published.
+     */
+    uint64_t GetSequence() const;
+
+private:
+    CFrameRing(const CFrameRing &);
+    CFrameRing &operator=(const CFrameRing &);
+
+    std::string m_name;
+    void *m_map;
+    size_t m_mapSize;
+    uint64_t m_sequence;
+    mutable std::mutex m_mutex;
+};
+
+/**
+ * @brief Attaches to a CFrameRing published by another process, and reads frames from it.
+ * A reader object is meant to be used from one thread.
+ *
+ */
+class CFrameRingReader
+{
+public:
+    /**
+     * @brief Attach to a frame ring.
+     *
+     * @param name Shared memory object name, e.g. "/asicam_frames".
+     */
+    _Catchable CFrameRingReader(const std::string &name);
+
+    /**
+     * @brief Detach from the frame ring.
+     *
+     */
+    ~CFrameRingReader();
+
+    /**
+     * @brief Wait until a frame newer than the last acquired one is published. Re-attaches if the publisher was restarted.
+     *
+     * @param timeoutMs Timeout in milliseconds, negative to wait forever.
+     * @return bool Returns true if a new frame is available, false on timeout or if no publisher is running.
+     */
+    bool WaitForFrame(int timeoutMs = -1);
+
+    /**
+     * @brief Get a zero-copy view of the newest frame.
+     *
+     * @param view Frame view (output).
+     * @return bool Returns true on success, false if there is no frame.
+     */
+    bool Acquire(CFrameRingView &view);
+
+    /**
+     * @brief Finish using a frame view.
+     *
+     * @param view Frame view from Acquire().
+     * @return bool Returns true if the frame was not overwritten while it was in use, i.e. everything read from it is valid.
+     */
+    bool Release(const CFrameRingView &view) const;
+
+    /**
+     * @brief Copy the newest frame into an image.
+     *
+     * @param img Image (output).
+     * @return bool Returns true on success, false if there is no frame.
+     */
+    bool Read(CImageData &img);
+
+    /**
+     * @brief Get the number of frames published but never acquired by this reader.
+     *
+     * @return uint64_t Number of frames skipped.
+     */
+    inline uint64_t GetSkipped() const { return m_skipped; }
+
+private:
+    CFrameRingReader(const CFrameRingReader &);
+    CFrameRingReader &operator=(const CFrameRingReader &);
+
+    bool Attach();
+    void Detach();
+
+    std::string m_name;
+    void *m_map;
+    size_t m_mapSize;
+    uint64_t m_lastSeq;
+    uint64_t m_skipped;
+};
+
+#endif // __FRAMERING_HPP__
@@ -0,0 +1,183 @@
+/**
+ * @file FrameServer.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Socket server and preview encoding shared by CFrameCache and CMJPEGServer
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __FRAMESERVER_HPP__
+#define __FRAMESERVER_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+#include "ImageData.hpp"
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef CFRAMESERVER_DBG_LVL
+/**
+ * @brief Debug level for CFrameServer. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CFRAMESERVER_DBG_LVL 3
+#endif
+
+/**
+ * @brief Connection of a CFrameServer client, with the response being sent to it.
+ *
+ */
+class CFrameServerClient
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char>> Buffer;
+
+    int fd;              /*!< Socket */
+    int state;           /*!< Protocol state of the handler, 0 on connection */
+    uint64_t connected;  /*!< Time of connection, ms */
+    uint64_t lastSeq;    /*!< Sequence of the last frame queued */
+    bool closing;        /*!< Close the connection once the response is sent */
+    std::string request; /*!< Bytes received and not yet processed by the handler */
+
+    CFrameServerClient(int fd, uint64_t now)
+        : fd(fd), state(0), connected(now), lastSeq(0), closing(false), offset(0) {}
+
+    /**
+     * @brief Queue a response. The body is shared, e.g. by all clients of the same frame, and not copied.
+     *
+     * @param head Header, not empty.
+     * @param body [optional] Body (default: none).
+     * @param tail [optional] Trailer (default: none).
+     */
+    void Queue(const std::string &head, const Buffer &body = Buffer(), const std::string &tail = "");
+
+    /**
+     * @brief Check if a response is being sent.
+     *
+     * @return bool
+     */
+    bool Pending() const { return !head.empty(); }
+
+    /**
+     * @brief Send as much of the response as the socket takes.
+     *
+     * @return bool Returns false if the client is gone.
+     */
+    bool Send();
+
+private:
+    std::string head;
+    Buffer body;
+    std::string tail;
+    size_t offset; // bytes of the response sent
+};
+
+/**
+ * @brief Handles the requests of a client. Called on the server thread whenever the client has no response
+ * pending: after it sent data, after a response was sent, after CFrameServer::Wake(), and at least once a second.
+ * Processes client.request and queues at most one response per call.
+ *
+ * @param client Client.
+ * @param now Current time, ms (see CFrameServer::GetTime()).
+ * @return bool Returns false to close the connection at once.
+ */
+typedef std::function<bool(CFrameServerClient &client, uint64_t now)> CFrameServerHandler;
+
+/**
+ * @brief Non-blocking stream socket server on a single poll() thread, for the frame servers.
+ *
+ * The server thread accepts clients on a Unix domain or TCP socket, reads their requests into
+ * CFrameServerClient::request and sends their queued responses without blocking, so a slow client
+ * never holds up the others. The protocol is implemented by the handler. A self-pipe wakes the
+ * thread up when new data is available (Wake()) and on exit.
+ *
+ */
+class CFrameServer
+{
+public:
+    /**
+     * @brief Listen on a socket and start the server thread.
+     *
+     * @param address IPv4 address to bind to (empty for "127.0.0.1"), or the Unix domain socket path if port < 0. A stale socket at the path is removed.
+     * @param port TCP port, < 0 for a Unix domain socket.
+     * @param handler Request handler.
+     * @param maxClients [optional] Maximum number of clients, further connections are closed; 0 for no limit (default: 0).
+     * @param sendBuffer [optional] Socket send buffer of the clients, 0 for the system default (default: 0). A small buffer makes slow clients skip frames instead of queueing them in the kernel.
+     */
+    _Catchable CFrameServer(const std::string &address, int port, const CFrameServerHandler &handler, int maxClients = 0, int sendBuffer = 0);
+
+    /**
+     * @brief Stop the server thread, disconnect the clients and remove the Unix domain socket.
+     *
+     */
+    ~CFrameServer();
+
+    /**
+     * @brief Wake up the server thread, so that the handler is called for every idle client.
+     *
+     */
+    void Wake();
+
+    /**
+     * @brief Get the number of connected clients.
+     *
+     * @return int Number of clients.
+     */
+    int GetClients() const;
+
+    /**
+     * @brief Get the time of the steady clock.
+     *
+     * @return uint64_t Time, ms.
+     */
+    static uint64_t GetTime();
+
+    /**
+     * @brief Encode a JPEG image of a frame with its JPEG settings (tone curve, black and white points, overlay),
+     * like the saved JPEG images. A frame larger than the maximum size is binned down by the smallest power of 2
+     * that fits with CImageData::BuildPyramid().
+     *
+     * @param img Frame. Its JPEG quality is set.
+     * @param quality JPEG quality, 10 - 100.
+     * @param maxWidth [optional] Maximum width, 0 for no limit (default: 0).
+     * @param maxHeight [optional] Maximum height, 0 for no limit (default: 0).
+     * @return CFrameServerClient::Buffer JPEG image, empty on error.
+     */
+    static CFrameServerClient::Buffer EncodeJPEG(CImageData &img, int quality, int maxWidth = 0, int maxHeight = 0);
+
+private:
+    CFrameServer(const CFrameServer &);
+    CFrameServer &operator=(const CFrameServer &);
+
+    void ServerThread();
+
+    std::string m_socketPath; // Unix domain socket, removed on exit
+    CFrameServerHandler m_handler;
+    int m_maxClients;
+    int m_sendBuffer;
+
+    int m_listenFd;
+    int m_wakeFd[2]; // self-pipe, wakes up the server thread on new data and on exit
+
+    int m_clients;
+    bool m_done;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+};
+
+#endif // __FRAMESERVER_HPP__
@@ -0,0 +1,152 @@
+/**
+ * @file FrameSpool.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Crash-safe memory-mapped raw frame spool
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __FRAMESPOOL_HPP__
+#define __FRAMESPOOL_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+#include "ImageData.hpp"
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef CFRAMESPOOL_DBG_LVL
+/**
+ * @brief Debug level for CFrameSpool. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CFRAMESPOOL_DBG_LVL 3
+#endif
+
+/**
+ * @brief Header of a spool slot, followed by the serialized extended metadata and the pixel data.
+ *
+ */
+typedef struct
+{
+    char magic[8];           /*!< Slot magic, "CFSSLOT1" */
+    uint64_t sequence;       /*!< Frame sequence number */
+    uint32_t state;          /*!< Slot state (empty, writing, pending, done) */
+    uint32_t width;          /*!< Image width */
+    uint32_t height;         /*!< Image height */
+    uint32_t extendedLength; /*!< Length of the serialized extended metadata */
+    uint64_t timestamp;      /*!< Metadata: timestamp since epoch in ms */
+    double exposureTime;     /*!< Metadata: exposure time in seconds */
+    float temperature;       /*!< Metadata: CCD temperature */
+    int32_t binX;            /*!< Metadata: X axis bin */
+    int32_t binY;            /*!< Metadata: Y axis bin */
+    int32_t imgLeft;         /*!< Metadata: left offset */
+    int32_t imgTop;          /*!< Metadata: top offset */
+    int32_t minGain;         /*!< Metadata: minimum gain */
+    int32_t maxGain;         /*!< Metadata: maximum gain */
+    int32_t reserved;        /*!< Reserved */
+    int64_t gain;            /*!< Metadata: gain */
+    int64_t offset;          /*!< Metadata: offset */
+    char cameraName[64];     /*!< Metadata: camera name */
+    uint64_t checksum;       /*!< Checksum of the header (state and checksum zeroed), extended metadata and pixels */
+} CFrameSpoolSlot;
+
+/**
+ * @brief Fixed-size circular spool of raw frames in a memory-mapped file.
+ * Frames are copied into the spool with Push() as soon as they are captured, and a
+ * background thread hands them to a sink (e.g. CFrameWriter::Write) in order, marking
+ * each slot done once the sink succeeds. Since the spool is a shared file mapping, the
+ * frames survive a crash of the process: on construction, complete (checksum verified)
+ * frames that were not converted are recovered and handed to the sink first.
+ *
+ */
+class CFrameSpool
+{
+public:
+    /**
+     * @brief Construct a new CFrameSpool object. Opens (recovering pending frames) or creates the spool file, and starts the converter thread.
+     *
+     * @param fileName Spool file name.
+     * @param nSlots Number of frames the spool holds.
+     * @param maxWidth Maximum image width.
+     * @param maxHeight Maximum image height.
+     * @param sink Called on the converter thread for every frame, returns true once the frame is stored.
+     * @param syncOnWrite [optional] msync() every frame to disk, to also survive a power failure (default: false).
+     */
+    _Catchable CFrameSpool(const std::string &fileName, int nSlots, int maxWidth, int maxHeight, const std::function<bool(CImageData &)> &sink, bool syncOnWrite = false);
+
+    /**
+     * @brief Stop the converter thread after the pending frames are converted, and unmap the spool.
+     *
+     */
+    ~CFrameSpool();
+
+    /**
+     * @brief Copy a frame into the spool.
+     *
+     * @param img Image to spool.
+     * @return bool Returns true if the frame was spooled, false if the spool is full or the image is too large.
+     */
+    bool Push(const CImageData &img);
+
+    /**
+     * @brief Get the number of frames waiting to be converted.
+     *
+     * @return int Number of frames.
+     */
+    int GetPending() const;
+
+    /**
+     * @brief Get the number of frames recovered from the spool file on construction.
+     *
+     * @return int Number of frames.
+     */
+    inline int GetRecovered() const { return m_recovered; }
+
+private:
+    CFrameSpool(const CFrameSpool &);
+    CFrameSpool &operator=(const CFrameSpool &);
+
+    bool Map(bool create);
+    void Unmap();
+    int Recover();
+    CFrameSpoolSlot *Slot(uint64_t sequence) const;
+    bool ReadSlot(const CFrameSpoolSlot *slot, CImageData &img) const;
+    void ConverterThread();
+
+    std::string m_fileName;
+    uint32_t m_nSlots;
+    uint64_t m_slotSize;
+    uint32_t m_maxWidth;
+    uint32_t m_maxHeight;
+    std::function<bool(CImageData &)> m_sink;
+    bool m_syncOnWrite;
+
+    int m_fd;
+    unsigned char *m_map;
+    size_t m_mapSize;
+
+    uint64_t m_nextSeq;    // sequence of the next frame pushed
+    uint64_t m_convertSeq; // sequence of the next frame to convert
+    int m_recovered;
+    bool m_done;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+#endif // __FRAMESPOOL_HPP__
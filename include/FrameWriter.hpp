@@ -0,0 +1,127 @@
+/**
+ * @file FrameWriter.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Frame writer with low disk space degradation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __FRAMEWRITER_HPP__
+#define __FRAMEWRITER_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+#include "ImageData.hpp"
+#include "ImageArchive.hpp"
+#include "StorageManager.hpp"
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef _Nullable
+/**
+ * @brief Indicate the pointer can be set to null safely.
+ *
+ */
+#define _Nullable
+#endif
+
+#ifndef CFRAMEWRITER_DBG_LVL
+/**
+ * @brief Debug level for CFrameWriter. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CFRAMEWRITER_DBG_LVL 3
+#endif
+
+/**
+ * @brief Output levels of CFrameWriter, from most to least disk space used.
+ *
+ */
+enum FrameWriteLevel
+{
+    WRITE_FULL = 0,     /*!< Full resolution FITS */
+    WRITE_BINNED = 1,   /*!< Software binned FITS */
+    WRITE_PREVIEW = 2,  /*!< JPEG preview only */
+    WRITE_METADATA = 3, /*!< One line of metadata per frame in a log file */
+};
+
+/**
+ * @brief Writes frames to the dated directories of a CStorageManager, degrading the output
+ * as the disk fills up instead of failing. The free space is read with statvfs() before every
+ * frame, and the writer steps down through the levels full FITS, binned FITS, JPEG preview and
+ * metadata only as it crosses the configured thresholds. It steps back up once the free space
+ * is 10% above a threshold. If a frame can not be written (e.g. the preallocation fails), the
+ * next level is tried for the same frame. The level used is recorded in the frame metadata
+ * (SAVELVL key).
+ *
+ */
+class CFrameWriter
+{
+public:
+    /**
+     * @brief Construct a new CFrameWriter object.
+     *
+     * @param storage Storage manager providing the output directories.
+     * @param filePrefix File name prefix, files are named <prefix>_<timestamp>.
+     * @param binnedBelow [optional] Save binned FITS below this free space in bytes, 0 to disable (default: 0).
+     * @param previewBelow [optional] Save only JPEG previews below this free space in bytes, 0 to disable (default: 0).
+     * @param metadataBelow [optional] Save only metadata below this free space in bytes, 0 to disable (default: 0).
+     * @param binFactor [optional] Binning applied at the binned FITS level (default: 2).
+     * @param archive [optional] Archive to append FITS frames to, instead of one file per frame (default: none).
+     * @param syncOnWrite [optional] Sync every file to disk after writing (default: true).
+     */
+    CFrameWriter(CStorageManager &storage, const std::string &filePrefix, uint64_t binnedBelow = 0, uint64_t previewBelow = 0, uint64_t metadataBelow = 0, int binFactor = 2, CImageArchive *_Nullable archive = nullptr, bool syncOnWrite = true);
+
+    /**
+     * @brief Write a frame at the level allowed by the current free space.
+     *
+     * @param img Image to write. The SAVELVL extended metadata key is set to the level used.
+     * @return bool Returns true if the frame was written at any level, false otherwise.
+     */
+    bool _Catchable Write(CImageData &img);
+
+    /**
+     * @brief Get the level used for the last frame.
+     *
+     * @return FrameWriteLevel Output level.
+     */
+    FrameWriteLevel GetLevel() const;
+
+    /**
+     * @brief Get the name of an output level, as recorded in the frame metadata.
+     *
+     * @param level Output level.
+     * @return const char* Level name (FULL, BINNED, PREVIEW or METADATA).
+     */
+    static const char *LevelName(FrameWriteLevel level);
+
+private:
+    CFrameWriter(const CFrameWriter &);
+    CFrameWriter &operator=(const CFrameWriter &);
+
+    FrameWriteLevel LevelFor(uint64_t freeBytes, uint64_t margin) const;
+    bool WriteLevel(CImageData &img, const std::string &dirName, FrameWriteLevel level);
+    bool WriteMetadata(const CImageData &img, const std::string &dirName);
+
+    CStorageManager &m_storage;
+    CImageArchive *m_archive;
+    std::string m_filePrefix;
+    uint64_t m_thresholds[3]; // binned, preview, metadata
+    int m_binFactor;
+    bool m_syncOnWrite;
+    FrameWriteLevel m_level;
+
+    mutable std::mutex m_mutex;
+};
+
+#endif // __FRAMEWRITER_HPP__
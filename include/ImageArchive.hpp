@@ -0,0 +1,137 @@
+/**
+ * @file ImageArchive.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Rolling multi-extension FITS archive for image sequences
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __IMAGEARCHIVE_HPP__
+#define __IMAGEARCHIVE_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+#include "ImageData.hpp"
+
+#ifndef CIMAGEARCHIVE_DBG_LVL
+/**
+ * @brief Debug level for CImageArchive. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CIMAGEARCHIVE_DBG_LVL CIMAGEDATA_DBG_LVL
+#endif
+
+/**
+ * @brief Index record for one frame in an archive container.
+ * Records are stored back to back after a 16-byte file header in
+ * `<container>.idx`, so frame k lives at byte offset 16 + 64 * k.
+ *
+ */
+struct CImageArchiveIndexEntry
+{
+    uint32_t frame;       /*!< Frame number in the container (0-based) */
+    uint32_t hdu;         /*!< HDU number of the frame (1-based, cfitsio convention) */
+    uint64_t timestamp;   /*!< Frame timestamp since epoch in ms */
+    int64_t headerOffset; /*!< Byte offset of the HDU header in the container */
+    int64_t dataOffset;   /*!< Byte offset of the HDU data unit in the container */
+    int64_t dataEnd;      /*!< Byte offset of the end of the HDU data unit */
+    uint32_t width;       /*!< Image width in pixels */
+    uint32_t height;      /*!< Image height in pixels */
+    float exposure;       /*!< Exposure time in seconds */
+    uint32_t reserved0;   /*!< Reserved, zero */
+    uint64_t reserved1;   /*!< Reserved, zero */
+};
+
+/**
+ * @brief Appends frames as tile-compressed image extensions to a rolling FITS container.
+ * Each frame keeps its own header. A container is closed and a new one started after
+ * a set number of frames, a set time, or when the output directory changes.
+ *
+ */
+class CImageArchive
+{
+public:
+    /**
+     * @brief Construct a new CImageArchive object. No file is created until the first frame is appended.
+     *
+     * @param dirName Directory to store containers in.
+     * @param filePrefix Container name prefix. Containers are named <filePrefix>_<timestamp>.fits.
+     * @param maxFrames [optional] Maximum number of frames per container (default: 100).
+     * @param maxMinutes [optional] Maximum minutes spanned by a container, 0 to disable (default: 30).
+     * @param syncOnWrite [optional] Sync the container and then its index to disk after every frame (default: false).
+     */
+    CImageArchive(const std::string &dirName, const std::string &filePrefix, int maxFrames = 100, int maxMinutes = 30, bool syncOnWrite = false);
+    ~CImageArchive();
+
+    /**
+     * @brief Append a frame to the current container, rolling over to a new container if required.
+     *
+     * @param img Image to append.
+     * @return bool Returns true if successful, false otherwise. The container is closed on error, and the next frame starts a new one.
+     */
+    bool Append(const CImageData &img);
+
+    /**
+     * @brief Close the current container. The next frame starts a new one.
+     *
+     */
+    void Close();
+
+    /**
+     * @brief Change the output directory. Closes the current container if the directory differs.
+     *
+     * @param dirName New output directory.
+     */
+    void SetDirectory(const std::string &dirName);
+
+    /**
+     * @brief Get the path of the open container.
+     *
+     * @return std::string Path of the container, empty if none is open.
+     */
+    std::string GetCurrentFile() const;
+
+    /**
+     * @brief Get the number of frames in the open container.
+     *
+     * @return int Number of frames.
+     */
+    int GetFrameCount() const;
+
+    /**
+     * @brief Look up frame k of a container from its index, without scanning the container.
+     *
+     * @param containerName Path of the container (.fits file).
+     * @param frame Frame number (0-based).
+     * @param entry Index record (output).
+     * @return bool Returns true if the record exists, false otherwise.
+     */
+    static bool ReadIndex(const std::string &containerName, int frame, CImageArchiveIndexEntry &entry);
+
+private:
+    CImageArchive(const CImageArchive &);
+    CImageArchive &operator=(const CImageArchive &);
+
+    bool OpenContainer(uint64_t timestamp);
+    void CloseUnlocked();
+
+    std::string m_dirName;
+    std::string m_filePrefix;
+    int m_maxFrames;
+    int m_maxMinutes;
+    bool m_syncOnWrite;
+
+    void *m_fptr;
+    int m_indexFd;
+    std::string m_fileName;
+    int m_frameCount;
+    uint64_t m_openTime;
+
+    mutable std::mutex m_mutex;
+};
+
+#endif // __IMAGEARCHIVE_HPP__
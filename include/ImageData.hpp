@@ -21,6 +21,9 @@ typedef SSIZE_T ssize_t;
 #include <string>
 #include <map>
 #include <mutex>
+#include <vector>
+#include <memory>
+#include <functional>
 
 #ifndef _Nullable
 /**
@@ -52,6 +55,11 @@ typedef SSIZE_T ssize_t;
 #endif /* _MSC_VER */
 #endif /* _DOXYGEN_ */
 
+namespace jpge
+{
+    class output_stream;
+}
+
 /**
  * @brief Image Data Statistics Storage Class
  *
@@ -100,6 +108,207 @@ public:
     double GetStandardDeviationValue() const { return stddev_; }
 };
 
+/**
+ * @brief Histogram of 16-bit pixel counts.
+ *
+ * Bin i counts the pixels with (count >> shift) == i, where the number of bins is 65536 >> shift. With
+ * the default 65536 bins every pixel count has its own bin and the queries are exact; with fewer bins
+ * they return the lowest pixel count of the bin. All queries are O(bins).
+ */
+class CImageHistogram
+{
+    std::vector<uint32_t> counts_;
+    uint64_t total_;
+    int shift_;
+
+public:
+    /**
+     * @brief Construct an empty histogram.
+     *
+     */
+    CImageHistogram()
+        : total_(0), shift_(0) {}
+    /**
+     * @brief Build the histogram of a block of pixels. Large blocks are split between threads that fill
+     * private histograms, which are merged at the end.
+     *
+     * @param data Pixel counts.
+     * @param count Number of pixels.
+     * @param bins [optional] Number of bins, a power of 2 from 1 to 65536, rounded down otherwise (default: 65536).
+     * @param nThreads [optional] Number of threads, 0 to use one per core for large blocks (default: 0).
+     */
+    CImageHistogram(const uint16_t *data, size_t count, int bins = 0x10000, int nThreads = 0);
+    /**
+     * @brief Build a histogram with fewer bins from this histogram.
+     *
+     * @param bins Number of bins, a power of 2 from 1 to the number of bins of this histogram, rounded down otherwise.
+     * @return CImageHistogram Histogram with the new number of bins.
+     */
+    CImageHistogram Rebin(int bins) const;
+    /**
+     * @brief Get the number of bins
+     *
+     * @return int
+     */
+    int GetBins() const { return (int)counts_.size(); }
+    /**
+     * @brief Get the pixel counts covered by a bin
+     *
+     * @param bin Bin index
+     * @param low Lowest pixel count of the bin (output)
+     * @param high Highest pixel count of the bin (output)
+     */
+    void GetBinRange(int bin, uint16_t &low, uint16_t &high) const
+    {
+        low = (uint16_t)(bin << shift_);
+        high = (uint16_t)(((bin + 1) << shift_) - 1);
+    }
+    /**
+     * @brief Get the number of pixels in the histogram
+     *
+     * @return uint64_t
+     */
+    uint64_t GetTotal() const { return total_; }
+    /**
+     * @brief Get the bin counts
+     *
+     * @return const std::vector<uint32_t>& Number of pixels in every bin
+     */
+    const std::vector<uint32_t> &GetCounts() const { return counts_; }
+    /**
+     * @brief Get the pixel count at a percentile: the pixel of rank floor(percentile / 100 * (total - 1))
+     * in ascending order, so 0 is the minimum and 100 the maximum.
+     *
+     * @param percentile Percentile (0 - 100)
+     * @return uint16_t Pixel count, 0xffff if the histogram is empty
+     */
+    uint16_t GetPercentile(float percentile) const;
+    /**
+     * @brief Get the pixel count of a rank in ascending order.
+     *
+     * @param rank Rank, 0 for the minimum
+     * @return uint16_t Pixel count, 0xffff if the rank is out of range
+     */
+    uint16_t GetRank(uint64_t rank) const;
+    /**
+     * @brief Get the median pixel count (lower median for an even number of pixels)
+     *
+     * @return uint16_t
+     */
+    uint16_t GetMedian() const { return GetPercentile(50); }
+    /**
+     * @brief Get the most frequent pixel count (the lowest one if several are equally frequent)
+     *
+     * @return uint16_t Pixel count, 0xffff if the histogram is empty
+     */
+    uint16_t GetMode() const;
+    /**
+     * @brief Get the minimum pixel count
+     *
+     * @return uint16_t
+     */
+    uint16_t GetMinValue() const { return GetRank(0); }
+    /**
+     * @brief Get the maximum pixel count
+     *
+     * @return uint16_t
+     */
+    uint16_t GetMaxValue() const { return total_ ? GetRank(total_ - 1) : 0xffff; }
+};
+
+/**
+ * @brief Pixel statistics and histogram of an image from a single sweep over the pixels.
+ *
+ * The sweep builds the full 65536-bin histogram; the minimum, maximum, sum, sum of squares and the
+ * saturated pixel count are then read off the histogram, exactly, in O(65536) instead of more passes
+ * over the pixels.
+ */
+class CImageAnalysis
+{
+    CImageHistogram histogram_;
+    uint16_t min_;
+    uint16_t max_;
+    uint64_t sum_;
+    uint64_t sumsq_;
+    uint64_t saturated_;
+
+public:
+    /**
+     * @brief Construct an empty analysis.
+     *
+     */
+    CImageAnalysis()
+        : min_(0), max_(0), sum_(0), sumsq_(0), saturated_(0) {}
+    /**
+     * @brief Analyze a block of pixels.
+     *
+     * @param data Pixel counts.
+     * @param count Number of pixels.
+     * @param nThreads [optional] Number of threads, 0 to use one per core for large blocks (default: 0).
+     */
+    CImageAnalysis(const uint16_t *data, size_t count, int nThreads = 0);
+    /**
+     * @brief Get the full (65536-bin) histogram
+     *
+     * @return const CImageHistogram&
+     */
+    const CImageHistogram &GetHistogram() const { return histogram_; }
+    /**
+     * @brief Get the number of pixels
+     *
+     * @return uint64_t
+     */
+    uint64_t GetCount() const { return histogram_.GetTotal(); }
+    /**
+     * @brief Get the minimum pixel count
+     *
+     * @return uint16_t
+     */
+    uint16_t GetMinValue() const { return min_; }
+    /**
+     * @brief Get the maximum pixel count
+     *
+     * @return uint16_t
+     */
+    uint16_t GetMaxValue() const { return max_; }
+    /**
+     * @brief Get the sum of the pixel counts
+     *
+     * @return uint64_t
+     */
+    uint64_t GetSum() const { return sum_; }
+    /**
+     * @brief Get the sum of the squared pixel counts
+     *
+     * @return uint64_t
+     */
+    uint64_t GetSumSquares() const { return sumsq_; }
+    /**
+     * @brief Get the number of saturated (0xffff) pixels
+     *
+     * @return uint64_t
+     */
+    uint64_t GetSaturated() const { return saturated_; }
+    /**
+     * @brief Get the mean pixel count
+     *
+     * @return double Mean, 0 if there are no pixels
+     */
+    double GetMean() const;
+    /**
+     * @brief Get the sample standard deviation of the pixel counts
+     *
+     * @return double Standard deviation, 0 if there are less than 2 pixels
+     */
+    double GetStandardDeviation() const;
+    /**
+     * @brief Get the statistics in an ImageStats container
+     *
+     * @return ImageStats
+     */
+    ImageStats GetStats() const { return ImageStats(min_, max_, GetMean(), GetStandardDeviation()); }
+};
+
 /**
  * @brief Image metadata storage class.
  *
@@ -140,6 +349,60 @@ public:
     }
 };
 
+/**
+ * @brief Tone curve used to map raw pixel counts to 8-bit JPEG brightness.
+ *
+ */
+typedef enum
+{
+    STRETCH_LINEAR = 0, /*!< Linear */
+    STRETCH_GAMMA,      /*!< Power law, x^(1/gamma) */
+    STRETCH_LOG,        /*!< Logarithmic, log(1 + a x) / log(1 + a) */
+    STRETCH_ASINH       /*!< Inverse hyperbolic sine, asinh(b x) / asinh(b) */
+} CImageStretch;
+
+/**
+ * @brief Pixels metered by auto-exposure.
+ *
+ */
+typedef enum
+{
+    METERING_FULL = 0, /*!< Whole image */
+    METERING_ROI,      /*!< Rectangular window */
+    METERING_CIRCLE,   /*!< Circle, e.g. the image circle of a fisheye lens */
+    METERING_WEIGHTED  /*!< Weight mask */
+} CImageMeteringMode;
+
+/**
+ * @brief Auto-exposure metering settings. Positions are unbinned sensor pixels, so the same settings
+ * apply at any binning and readout window; a binned pixel is metered if its center is selected.
+ *
+ */
+class CImageMetering
+{
+public:
+    CImageMeteringMode mode;      /*!< Metering mode */
+    int stride;                   /*!< Meter every stride-th pixel of every stride-th row, 1 for all pixels (1/16 of the pixels at 4) */
+    int roiLeft;                  /*!< METERING_ROI: left edge of the window */
+    int roiTop;                   /*!< METERING_ROI: top edge of the window */
+    int roiWidth;                 /*!< METERING_ROI: width of the window */
+    int roiHeight;                /*!< METERING_ROI: height of the window */
+    float centerX;                /*!< METERING_CIRCLE: center of the circle, X */
+    float centerY;                /*!< METERING_CIRCLE: center of the circle, Y */
+    float radius;                 /*!< METERING_CIRCLE: radius of the circle */
+    std::vector<uint8_t> weights; /*!< METERING_WEIGHTED: weight mask, row major, 0 = not metered, 255 = full weight */
+    int weightsWidth;             /*!< METERING_WEIGHTED: width of the weight mask */
+    int weightsHeight;            /*!< METERING_WEIGHTED: height of the weight mask */
+    int weightsScale;             /*!< METERING_WEIGHTED: sensor pixels per mask pixel along each axis, pixels outside the mask are not metered */
+
+    /**
+     * @brief Construct metering settings for the whole image.
+     *
+     */
+    CImageMetering()
+        : mode(METERING_FULL), stride(1), roiLeft(0), roiTop(0), roiWidth(0), roiHeight(0), centerX(0), centerY(0), radius(0), weightsWidth(0), weightsHeight(0), weightsScale(1) {}
+};
+
 /**
  * @brief Class to contain 16-bit raw image data
  *
@@ -153,15 +416,22 @@ class CImageData
 
     unsigned short *m_imageData;
 
-    unsigned char *m_jpegData;
+    std::vector<unsigned char> m_jpegData; // keeps its capacity across conversions
     int sz_jpegData;
 
-    bool convert_jpeg;
+    bool jpegDirty; // JPEG image is out of date with the pixels or the JPEG settings
 
     int JpegQuality;
     int pixelMin;
     int pixelMax;
     bool autoscale;
+    bool jpegOverlay;
+    CImageStretch jpegStretch;
+    float jpegStretchParam;
+    float blackPercentile;
+    float whitePercentile;
+
+    mutable std::shared_ptr<const CImageAnalysis> m_analysis; // built on demand, reset when the pixels change
 
     mutable std::mutex m_mutex;
 
@@ -179,7 +449,7 @@ public:
      * @param imageData [optional] Pointer to image data
      * @param metadata [optional] Image metadata (exposure, timestamp, binning, gain etc.)
      * @param is8bit [optional] Image data is 8-bit (default is 16-bit)
-     * @param enableJpeg [optional] Enable JPEG conversion
+     * @param enableJpeg [optional] Unused, the JPEG image is encoded on demand by GetJPEGData()
      * @param JpegQuality [optional] Quality of JPEG conversion
      * @param pixelMin [optional] JPEG image scaling pixel count minimum, -1 for default (0x0000), overriden by autoscale flag
      * @param pixelMax [optional] JPEG image scaling pixel count maximum, -1 for default (0xffff), overriden by autoscale flag
@@ -253,12 +523,21 @@ public:
         m_metadata.AddExtendedAttribute(key, value);
     }
     /**
-     * @brief Retrieve JPEG image corresponding to raw data
+     * @brief Retrieve JPEG image corresponding to raw data. The image is encoded here if the pixels or the
+     * JPEG settings changed since the last call, so modifying the image does not encode anything.
      *
      * @param ptr Pointer to JPEG image data
      * @param sz Size of JPEG image data
      */
     void GetJPEGData(unsigned char *&ptr, int &sz);
+    /**
+     * @brief Encode the JPEG image with the current settings directly into a stream, without keeping a copy in
+     * the image. Use a jpge::fd_stream for a file or socket, or a jpge::memory_stream for a shared memory slot.
+     *
+     * @param stream Output stream.
+     * @return bool Returns true on success, false if there is no image data or a stream write fails.
+     */
+    bool WriteJPEG(jpge::output_stream *stream);
     /**
      * @brief Set quality of JPEG image
      *
@@ -269,6 +548,7 @@ public:
         JpegQuality = quality;
         JpegQuality = JpegQuality < 0 ? 10 : JpegQuality;
         JpegQuality = JpegQuality > 100 ? 100 : JpegQuality;
+        jpegDirty = true;
     }
     /**
      * @brief Set pixel scaling values for JPEG image conversion
@@ -280,6 +560,7 @@ public:
     {
         pixelMin = min;
         pixelMax = max;
+        jpegDirty = true;
     }
     /**
      * @brief Enable/disable automatic scaling of image brightness based on pixel data
@@ -289,14 +570,62 @@ public:
     inline void SetJPEGScaling(bool autoscale)
     {
         this->autoscale = autoscale;
-        ConvertJPEG(); // update the JPEG image with the new scaling method
+        jpegDirty = true; // encoded with the new scaling method on the next GetJPEGData()
+    }
+    /**
+     * @brief Enable/disable the color overlay in the JPEG image. With the overlay, saturated pixels are
+     * marked red and pixels above the maximum pixel count are marked orange. Without it (default), the
+     * JPEG image is single channel grayscale.
+     *
+     * @param overlay
+     */
+    inline void SetJPEGOverlay(bool overlay)
+    {
+        jpegOverlay = overlay;
+        jpegDirty = true;
     }
     /**
-     * @brief Get statistics on image data
+     * @brief Set the tone curve of the JPEG image. With automatic scaling, the black and white points are
+     * the given percentiles of the pixel counts, so that a few hot pixels do not compress the brightness range.
+     * The defaults (linear, 0 - 100 percentile) map the minimum to maximum pixel count linearly.
+     *
+     * @param stretch Tone curve.
+     * @param parameter [optional] Curve parameter: gamma for STRETCH_GAMMA (default 2.2), a for STRETCH_LOG (default 1000), b for STRETCH_ASINH (default 10). Values <= 0 select the default.
+     * @param blackPercentile [optional] Percentile of pixel counts mapped to black (0 - 100, default 0).
+     * @param whitePercentile [optional] Percentile of pixel counts mapped to white (0 - 100, default 100).
+     */
+    void SetJPEGStretch(CImageStretch stretch, float parameter = 0, float blackPercentile = 0, float whitePercentile = 100);
+    /**
+     * @brief Build a 16-bit to 8-bit lookup table for a tone curve.
+     *
+     * @param lut Lookup table (output), 65536 entries.
+     * @param black Pixel count mapped to 0.
+     * @param white Pixel count mapped to 255.
+     * @param stretch Tone curve.
+     * @param parameter [optional] Curve parameter, see SetJPEGStretch(). Values <= 0 select the default.
+     */
+    static void BuildToneMap(uint8_t *lut, uint16_t black, uint16_t white, CImageStretch stretch = STRETCH_LINEAR, float parameter = 0);
+    /**
+     * @brief Get statistics on image data. Read off the cached analysis, see GetAnalysis().
      *
      * @return ImageStats Statistics data container
      */
     ImageStats GetStats() const;
+    /**
+     * @brief Get the statistics and histogram of the pixel counts. The analysis is made in one sweep over the
+     * pixels, once per image, on the first call after the pixels change (or the first call of GetStats(),
+     * GetHistogram(), autoscaling or exposure metering), and shared by all later calls and by copies of the image.
+     *
+     * @return std::shared_ptr<const CImageAnalysis> Analysis, empty (no pixels) if there is no image data.
+     */
+    std::shared_ptr<const CImageAnalysis> GetAnalysis() const;
+    /**
+     * @brief Get the histogram of the pixel counts, from the cached analysis (see GetAnalysis()).
+     *
+     * @param bins [optional] Number of bins, a power of 2 from 1 to 65536 (default: 65536). Smaller histograms are rebinned from the cached one.
+     * @return std::shared_ptr<const CImageHistogram> Histogram, empty if there is no image data.
+     */
+    std::shared_ptr<const CImageHistogram> GetHistogram(int bins = 0x10000) const;
     /**
      * @brief Get the pointer to image data
      *
@@ -308,11 +637,17 @@ public:
      *
      * @return unsigned short* const
      */
-    unsigned short *const GetImageData() { return m_imageData; }
+    unsigned short *const GetImageData()
+    {
+        jpegDirty = true; // the caller may modify the pixels
+        m_analysis.reset();
+        return m_imageData;
+    }
     /**
-     * @brief Stack data from another image
+     * @brief Stack data from another image. Pixel counts saturate at 0xffff. If this image has no data, it
+     * becomes a copy of the other image; images of a different size are ignored.
      *
-     * @param rsh Image container
+     * @param rsh Image container, may be this image
      */
     void Add(const CImageData &rsh);
     /**
@@ -327,6 +662,17 @@ public:
      *
      */
     void FlipHorizontal();
+    /**
+     * @brief Build a preview pyramid of 2x2 box-filtered images (1/2, 1/4, 1/8 ... of the size) in a single
+     * pass over the image. Every level is a complete image with the JPEG settings of this image, so it can be
+     * encoded independently with GetJPEGData() or WriteJPEG(). Pixel counts are averaged, not summed, so the
+     * levels keep the brightness scale of the full image; the binning of the metadata is updated.
+     *
+     * @param levels Pyramid levels (output), levels[0] is 1/2 of the size, levels[1] 1/4 and so on.
+     * @param numLevels [optional] Number of levels (default: 3). Levels smaller than 1 x 1 pixel are not built.
+     * @return int Number of levels built.
+     */
+    int BuildPyramid(std::vector<CImageData> &levels, int numLevels = 3) const;
     /**
      * @brief Find optimum exposure from this exposure
      *
@@ -338,9 +684,10 @@ public:
      * @param maxAllowedBin Maximum allowed binning (input, default: 4)
      * @param numPixelExclusion Number of pixels to be excluded from calculation (input, default: 100)
      * @param pixelTargetUncertainty Value target uncertainty (inpit, default: 5000)
-     * @return bool Returns true.
+     * @param metering [optional] Pixels to meter, NULL for the whole image (default: NULL). Excluded pixels are counted among the metered pixels, at full weight.
+     * @return bool Returns true, false if there is no image data or no pixel is metered.
      */
-    bool FindOptimumExposure(float &targetExposure, int &bin, float percentilePixel = 80, int pixelTarget = 40000, float maxAllowedExposure = 10.0, int maxAllowedBin = 4, int numPixelExclusion = 100, int pixelTargetUncertainty = 5000);
+    bool FindOptimumExposure(float &targetExposure, int &bin, float percentilePixel = 80, int pixelTarget = 40000, float maxAllowedExposure = 10.0, int maxAllowedBin = 4, int numPixelExclusion = 100, int pixelTargetUncertainty = 5000, const CImageMetering *_Nullable metering = nullptr);
     /**
      * @brief Find optimum exposure from this exposure without binning adjustment
      *
@@ -350,9 +697,21 @@ public:
      * @param maxAllowedExposure aximum allowed exposure time (input, default: 10 s)
      * @param numPixelExclusion Number of pixels to be excluded from calculation (input, default: 100)
      * @param pixelTargetUncertainty Value target uncertainty (inpit, default: 5000)
-     * @return bool Returns true.
+     * @param metering [optional] Pixels to meter, NULL for the whole image (default: NULL). Excluded pixels are counted among the metered pixels, at full weight.
+     * @return bool Returns true, false if there is no image data or no pixel is metered.
      */
-    bool FindOptimumExposure(float &targetExposure, float percentilePixel = 80, int pixelTarget = 40000, float maxAllowedExposure = 10.0, int numPixelExclusion = 100, int pixelTargetUncertainty = 5000);
+    bool FindOptimumExposure(float &targetExposure, float percentilePixel = 80, int pixelTarget = 40000, float maxAllowedExposure = 10.0, int numPixelExclusion = 100, int pixelTargetUncertainty = 5000, const CImageMetering *_Nullable metering = nullptr);
+    /**
+     * @brief Get the pixel count that FindOptimumExposure() compares against the target: the pixel at the
+     * percentile of the metered pixels, with at least numPixelExclusion brighter pixels.
+     *
+     * @param value Pixel count (output)
+     * @param percentilePixel [optional] Pixel percentile (default: 80 percentile)
+     * @param numPixelExclusion [optional] Number of pixels to be excluded from calculation (default: 100)
+     * @param metering [optional] Pixels to meter, NULL for the whole image (default: NULL)
+     * @return bool Returns true, false if there is no image data or no pixel is metered.
+     */
+    bool GetMeteredPercentile(uint16_t &value, float percentilePixel = 80, int numPixelExclusion = 100, const CImageMetering *_Nullable metering = nullptr) const;
 #if (defined(__GNUC__) || defined(__clang__)) && !defined(_DOXYGEN_)
     __attribute__((__format__(__printf__, 4, 5)))
 #endif
@@ -369,6 +728,38 @@ public:
      * @return bool Returns true if successful, false otherwise.
      */
     bool SaveFITS(bool syncOnWrite, const char *_Nullable DirNamePrefix, FORMAT_STRING(const char *fileNameFormat), ...);
+
+    /**
+     * @brief Load image data and metadata (including extended keys) from a FITS file written by SaveFITS
+     * or CImageArchive. Uncompressed images are converted directly from a memory mapping of the file,
+     * RICE_1 tile-compressed images are decoded tile by tile on multiple threads. Other formats are read
+     * through cfitsio.
+     *
+     * @param fileName FITS file name.
+     * @param hdu [optional] HDU number (1 = primary), 0 for the first HDU containing an image (default: 0).
+     * @param nThreads [optional] Number of threads to decode compressed tiles with, 0 for one per core (default: 0).
+     * @return bool Returns true if successful, false otherwise. The image is unchanged on failure.
+     */
+    bool LoadFITS(const std::string &fileName, int hdu = 0, int nThreads = 0);
+
+    /**
+     * @brief Load a batch of FITS files on multiple threads, one file per thread. Only one image per
+     * thread is held in memory, so arbitrarily large batches can be processed.
+     *
+     * @param fileNames FITS file names.
+     * @param callback Called from the worker threads with the index of the file and the loaded image, for every file that was loaded.
+     * @param nThreads [optional] Number of threads, 0 for one per core (default: 0). One thread is used if cfitsio is not thread safe.
+     * @return size_t Number of files loaded.
+     */
+    static size_t LoadFITSBatch(const std::vector<std::string> &fileNames, const std::function<void(size_t, CImageData &)> &callback, int nThreads = 0);
+    /**
+     * @brief Append the image, with its metadata, as a new image HDU to an open FITS file.
+     *
+     * @param fptr Open cfitsio file handle (`fitsfile *`).
+     * @param extName [optional] Value of the EXTNAME keyword, omitted if NULL.
+     * @return int cfitsio status code, 0 on success.
+     */
+    int WriteFITSHDU(void *fptr, const char *_Nullable extName = nullptr) const;
     /**
      * @brief Get the image height
      *
@@ -425,17 +816,42 @@ private:
      */
     void ConvertJPEG();
     /**
-     * @brief Return minimum pixel count
+     * @brief Encode the JPEG image into a stream without locking the image mutex.
      *
-     * @return uint16_t
      */
-    uint16_t DataMin();
+    bool WriteJPEGUnlocked(jpge::output_stream *stream);
     /**
-     * @brief Return maximum pixel count
+     * @brief Write the image HDU without locking the image mutex.
      *
-     * @return uint16_t
      */
-    uint16_t DataMax();
+    int WriteFITSHDUUnlocked(void *fptr, const char *extName) const;
+    /**
+     * @brief Get the cached analysis without locking the image mutex.
+     *
+     */
+    std::shared_ptr<const CImageAnalysis> GetAnalysisUnlocked() const;
+    /**
+     * @brief Build the histogram of the metered pixels without locking the image mutex.
+     *
+     * @param metering Metering settings.
+     * @param hist Histogram (output), 65536 bins, in units of 1/255 pixel for METERING_WEIGHTED and pixels otherwise.
+     * @return uint64_t Total count of the histogram.
+     */
+    uint64_t MeterUnlocked(const CImageMetering &metering, std::vector<uint64_t> &hist) const;
+    /**
+     * @brief Get the metered percentile without locking the image mutex.
+     *
+     */
+    bool MeteredPercentileUnlocked(uint16_t &value, float percentilePixel, int numPixelExclusion, const CImageMetering *metering) const;
+    /**
+     * @brief Return pixel counts at two percentiles
+     *
+     * @param lowPercentile Lower percentile (0 - 100)
+     * @param highPercentile Higher percentile (0 - 100)
+     * @param low Pixel count at the lower percentile (output)
+     * @param high Pixel count at the higher percentile (output)
+     */
+    void DataPercentiles(float lowPercentile, float highPercentile, uint16_t &low, uint16_t &high);
 };
 
 #endif // __IMAGEDATA_HPP__
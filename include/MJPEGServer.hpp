@@ -0,0 +1,136 @@
+/**
+ * @file MJPEGServer.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Live MJPEG-over-HTTP preview server
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __MJPEGSERVER_HPP__
+#define __MJPEGSERVER_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "ImageData.hpp"
+#include "FrameServer.hpp"
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef CMJPEGSERVER_DBG_LVL
+/**
+ * @brief Debug level for CMJPEGServer. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CMJPEGSERVER_DBG_LVL 3
+#endif
+
+/**
+ * @brief Maximum number of simultaneous HTTP clients.
+ *
+ */
+#define CMJPEGSERVER_MAX_CLIENTS 16
+
+/**
+ * @brief Serves a live preview as an MJPEG (multipart/x-mixed-replace) HTTP stream,
+ * for focusing and alignment without a display.
+ *
+ * Submit() is called from the capture path: it returns immediately if the preview rate limit is
+ * reached, and otherwise only copies the frame. Frames are encoded even while no client is
+ * connected, so that "/snapshot.jpg" always has a recent frame. An encoder thread bins the newest
+ * frame down to the preview resolution with CImageData::BuildPyramid() and encodes it with the
+ * JPEG settings of the frame, so the preview looks like the saved JPEG images. Every client gets
+ * the newest encoded frame once it has finished sending the previous one, so slow clients drop
+ * frames instead of holding anything back.
+ *
+ * Endpoints:
+ * - "/" and "/stream": MJPEG stream.
+ * - "/snapshot.jpg": latest preview frame.
+ *
+ */
+class CMJPEGServer
+{
+public:
+    /**
+     * @brief Start the preview server.
+     *
+     * @param address IPv4 address to bind to (e.g. "127.0.0.1"), or a Unix domain socket path if it starts with '/'.
+     * @param port TCP port, ignored for Unix domain sockets.
+     * @param maxRate [optional] Maximum preview frame rate in frames per second, <= 0 for no limit (default: 5).
+     * @param maxWidth [optional] Maximum preview width, the image is binned down by a power of 2 to fit (default: 1024).
+     * @param maxHeight [optional] Maximum preview height, the image is binned down by a power of 2 to fit (default: 1024).
+     * @param jpegQuality [optional] JPEG quality, 10 - 100 (default: 75).
+     */
+    _Catchable CMJPEGServer(const std::string &address, int port, float maxRate = 5, int maxWidth = 1024, int maxHeight = 1024, int jpegQuality = 75);
+
+    /**
+     * @brief Disconnect the clients and stop the server.
+     *
+     */
+    ~CMJPEGServer();
+
+    /**
+     * @brief Offer a frame to the preview stream.
+     *
+     * @param img Newest image.
+     * @return bool Returns true if the frame was queued for encoding, false if it was skipped (no data or rate limited).
+     */
+    bool Submit(const CImageData &img);
+
+    /**
+     * @brief Get the number of connected clients.
+     *
+     * @return int Number of clients.
+     */
+    int GetClients() const;
+
+    /**
+     * @brief Get the number of encoded frames that clients skipped because they were still receiving an older frame.
+     *
+     * @return uint64_t Number of frames.
+     */
+    uint64_t GetDropped() const;
+
+private:
+    CMJPEGServer(const CMJPEGServer &);
+    CMJPEGServer &operator=(const CMJPEGServer &);
+
+    typedef CFrameServerClient::Buffer Buffer;
+
+    void EncoderThread();
+    bool ServeClient(CFrameServerClient &client, uint64_t now);
+
+    std::string m_address;
+    float m_maxRate;
+    int m_maxWidth;
+    int m_maxHeight;
+    int m_jpegQuality;
+
+    CFrameServer *m_server;
+
+    CImageData *m_pending; // newest frame not yet encoded
+    uint64_t m_lastSubmit; // time the last frame was accepted, ms
+    uint64_t m_sequence;   // sequence of the last encoded frame
+    Buffer m_frame;        // last encoded frame
+    uint64_t m_dropped;
+    bool m_done;
+
+    std::thread m_encoder;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
+
+#endif // __MJPEGSERVER_HPP__
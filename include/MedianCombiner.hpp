@@ -0,0 +1,159 @@
+/**
+ * @file MedianCombiner.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Tile-based median and percentile combination of frames with bounded memory
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __MEDIANCOMBINER_HPP__
+#define __MEDIANCOMBINER_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+
+#include "ImageData.hpp"
+
+#ifndef CMEDIANCOMBINER_DBG_LVL
+/**
+ * @brief Debug level for CMedianCombiner. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CMEDIANCOMBINER_DBG_LVL 3
+#endif
+
+/**
+ * @brief Default memory budget for the frame tiles, in bytes.
+ *
+ */
+#define CMEDIANCOMBINER_DEFAULT_BUDGET (256UL << 20)
+
+/**
+ * @brief Reads a band of rows of a frame.
+ *
+ * @param row First row (0-based).
+ * @param rows Number of rows.
+ * @param data Pixels (output), rows x width, row major.
+ * @return bool Returns true on success, false otherwise.
+ */
+typedef std::function<bool(int row, int rows, uint16_t *data)> CMedianCombinerReader;
+
+/**
+ * @brief Median (or any percentile) of every pixel over a set of frames, e.g. for master darks and flats.
+ *
+ * The frames are not held in memory. The image is combined in tiles of whole rows: for every tile,
+ * the rows of every frame are read back from their FITS files (or from a reader, e.g. for spooled
+ * frames), every pixel is combined with std::nth_element over its samples, and the tile is written
+ * to the output. The tile height follows from the memory budget, and tiles are combined in parallel,
+ * each thread with its share of the budget. Every thread opens a FITS file once, at its first tile,
+ * and keeps it open until the frames are combined.
+ *
+ */
+class CMedianCombiner
+{
+public:
+    /**
+     * @brief Construct a new CMedianCombiner object.
+     *
+     * @param memoryBudget [optional] Memory for the frame tiles of all threads, in bytes (default: CMEDIANCOMBINER_DEFAULT_BUDGET). At least one row of every frame is held per thread.
+     * @param nThreads [optional] Number of tiles combined in parallel, 0 for one per core (default: 0). FITS files are read on one thread if cfitsio is not thread safe.
+     */
+    CMedianCombiner(size_t memoryBudget = CMEDIANCOMBINER_DEFAULT_BUDGET, int nThreads = 0);
+
+    /**
+     * @brief Add a FITS file. The image size is checked now, the pixels are read during Combine().
+     *
+     * @param fileName FITS file name.
+     * @param hdu [optional] HDU number (1-based), 0 for the first HDU with an image (default: 0).
+     * @return bool Returns true if the file was added, false if it could not be read or the size does not match the first frame.
+     */
+    bool AddFile(const std::string &fileName, int hdu = 0);
+
+    /**
+     * @brief Add a frame read through a reader.
+     *
+     * @param width Image width.
+     * @param height Image height.
+     * @param reader Reads rows of the frame. Called from the worker threads, so it must be thread safe.
+     * @return bool Returns true if the frame was added, false if the size does not match the first frame.
+     */
+    bool AddSource(int width, int height, const CMedianCombinerReader &reader);
+
+    /**
+     * @brief Combine the frames.
+     *
+     * @param data Combined image (output), width x height pixels, row major.
+     * @param percentile [optional] Percentile (0 - 100), interpolated between the two nearest samples; 50 is the median, the mean of the two middle samples for an even number of frames (default: 50).
+     * @return bool Returns true on success, false if there are no frames or a frame could not be read.
+     */
+    bool Combine(std::vector<float> &data, float percentile = 50) const;
+
+    /**
+     * @brief Combine the frames and save the result to a 32-bit float FITS file.
+     *
+     * @param fileName File name, replaced if it exists.
+     * @param percentile [optional] Percentile (0 - 100) (default: 50).
+     * @param metadata [optional] Metadata written to the header, e.g. of the first frame (default: none).
+     * @return bool Returns true on success, false otherwise.
+     */
+    bool SaveFITS(const std::string &fileName, float percentile = 50, const CImageMetadata *_Nullable metadata = nullptr) const;
+
+    /**
+     * @brief Get the number of frames.
+     *
+     * @return int Number of frames.
+     */
+    int GetFrames() const;
+
+    /**
+     * @brief Get the image width.
+     *
+     * @return int Width, 0 before the first frame.
+     */
+    int GetWidth() const;
+
+    /**
+     * @brief Get the image height.
+     *
+     * @return int Height, 0 before the first frame.
+     */
+    int GetHeight() const;
+
+    /**
+     * @brief Remove all frames.
+     *
+     */
+    void Clear();
+
+private:
+    CMedianCombiner(const CMedianCombiner &);
+    CMedianCombiner &operator=(const CMedianCombiner &);
+
+    // A frame, read from a FITS file or, if fileName is empty, through a reader
+    struct Source
+    {
+        std::string fileName;
+        int hdu;
+        CMedianCombinerReader reader;
+    };
+
+    bool AddSourceUnlocked(int width, int height, const Source &source);
+    bool CombineUnlocked(std::vector<float> &data, float percentile) const;
+
+    size_t m_memoryBudget;
+    int m_nThreads;
+    bool m_files; // some frames are read from FITS files
+
+    int m_width;
+    int m_height;
+    std::vector<Source> m_sources;
+
+    mutable std::mutex m_mutex;
+};
+
+#endif // __MEDIANCOMBINER_HPP__
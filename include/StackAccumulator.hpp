@@ -0,0 +1,177 @@
+/**
+ * @file StackAccumulator.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Streaming frame stacker with wide accumulators
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __STACKACCUMULATOR_HPP__
+#define __STACKACCUMULATOR_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "ImageData.hpp"
+
+#ifndef CSTACKACCUMULATOR_DBG_LVL
+/**
+ * @brief Debug level for CStackAccumulator. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CSTACKACCUMULATOR_DBG_LVL 3
+#endif
+
+/**
+ * @brief Maximum number of frames in a stack (the per-pixel counts are 16-bit, and 65535 frames of
+ * 16-bit pixels fit the 32-bit integer sums).
+ *
+ */
+#define CSTACKACCUMULATOR_MAX_FRAMES 0xffff
+
+/**
+ * @brief Accumulator type.
+ *
+ */
+typedef enum
+{
+    STACK_INT32 = 0, /*!< 32-bit integer sums, exact. Frames are added unscaled. */
+    STACK_FLOAT,     /*!< 64-bit float sums. Frames can be scaled as they are added (e.g. normalized flats). Unscaled
+                          sums stay exact (below 2^53), the relative error of scaled sums is below frames x 2^-53. */
+} CStackAccumulatorType;
+
+/**
+ * @brief Combination of the accumulated frames.
+ *
+ */
+typedef enum
+{
+    STACK_MEAN = 0,      /*!< Mean of the valid samples of every pixel */
+    STACK_SUM,           /*!< Sum over all frames, a pixel's skipped samples count as its mean */
+    STACK_SIGMA_CLIPPED, /*!< Mean of the samples of every pixel that passed sigma clipping */
+} CStackCombine;
+
+/**
+ * @brief Stacks a stream of frames into per-pixel sums, without keeping the frames.
+ *
+ * Every pixel has a sum (32-bit integer or 64-bit float), a 16-bit count of the samples in the sum
+ * and, optionally, a sum of squares. Saturated (0xffff) samples are skipped. Memory is 6 bytes per
+ * pixel, 14 with the sum of squares and 20 with sigma clipping (10, 18 and 28 with STACK_FLOAT),
+ * whatever the number of frames.
+ *
+ * Sigma clipping is done as the frames arrive: once a pixel has a minimum number of samples, a
+ * sample further than clipSigma standard deviations from the mean of the samples accepted so far is
+ * rejected. Rejected samples are kept in separate sums, so the plain mean is still available. The
+ * samples before the minimum are not tested, and the result depends on the order of the frames.
+ *
+ */
+class CStackAccumulator
+{
+public:
+    /**
+     * @brief Construct a new CStackAccumulator object. The sums are allocated on the first frame.
+     *
+     * @param type [optional] Accumulator type (default: STACK_INT32).
+     * @param sumSquares [optional] Keep the sum of squares of every pixel (default: false, implied by sigma clipping).
+     * @param clipSigma [optional] Sigma clipping threshold in standard deviations, <= 0 to disable (default: 0).
+     * @param clipMinFrames [optional] Samples of a pixel before clipping starts, at least 3; with few samples the standard deviation is too uncertain to clip on (default: 10).
+     */
+    CStackAccumulator(CStackAccumulatorType type = STACK_INT32, bool sumSquares = false, float clipSigma = 0, int clipMinFrames = 10);
+
+    /**
+     * @brief Add a frame to the stack.
+     *
+     * @param img Frame, of the size of the first frame.
+     * @param scale [optional] Factor the pixels are multiplied by, STACK_FLOAT only (default: 1).
+     * @return bool Returns true if the frame was added, false if it has no data, a different size, the scale is not supported or the stack is full.
+     */
+    bool Add(const CImageData &img, float scale = 1);
+
+    /**
+     * @brief Combine the frames accumulated so far.
+     *
+     * @param combine Combination. STACK_SIGMA_CLIPPED is the same as STACK_MEAN without clipping.
+     * @param data Combined image (output), width x height pixels, row major. Pixels without samples (saturated in every frame) are NaN.
+     * @return bool Returns true on success, false if there are no frames.
+     */
+    bool GetImage(CStackCombine combine, std::vector<float> &data) const;
+
+    /**
+     * @brief Save the combined image to a 32-bit float FITS file.
+     *
+     * @param fileName File name, replaced if it exists.
+     * @param combine [optional] Combination (default: STACK_MEAN).
+     * @return bool Returns true on success, false otherwise.
+     */
+    bool SaveFITS(const std::string &fileName, CStackCombine combine = STACK_MEAN) const;
+
+    /**
+     * @brief Get the number of frames in the stack.
+     *
+     * @return int Number of frames.
+     */
+    int GetFrames() const;
+
+    /**
+     * @brief Get the stack width.
+     *
+     * @return int Width, 0 before the first frame.
+     */
+    int GetWidth() const;
+
+    /**
+     * @brief Get the stack height.
+     *
+     * @return int Height, 0 before the first frame.
+     */
+    int GetHeight() const;
+
+    /**
+     * @brief Get the metadata of the stack: the metadata of the first frame, with the total exposure time of the frames.
+     *
+     * @return CImageMetadata
+     */
+    CImageMetadata GetImageMetadata() const;
+
+    /**
+     * @brief Remove all frames and free the sums.
+     *
+     */
+    void Reset();
+
+private:
+    CStackAccumulator(const CStackAccumulator &);
+    CStackAccumulator &operator=(const CStackAccumulator &);
+
+    bool Allocate(int width, int height);
+    void Free();
+    bool GetImageUnlocked(CStackCombine combine, std::vector<float> &data) const;
+
+    CStackAccumulatorType m_type;
+    bool m_sumSquares;
+    float m_clipSigma;
+    int m_clipMinFrames;
+
+    int m_width;
+    int m_height;
+    int m_frames;
+    CImageMetadata m_metadata; // first frame, total exposure
+    uint64_t m_lastTimestamp;
+
+    std::vector<uint32_t> m_sumInt;      // STACK_INT32
+    std::vector<double> m_sumFloat;      // STACK_FLOAT
+    std::vector<uint64_t> m_sumSqInt;    // STACK_INT32 with sum of squares
+    std::vector<double> m_sumSqFloat;    // STACK_FLOAT with sum of squares
+    std::vector<uint16_t> m_count;       // accepted samples
+    std::vector<uint32_t> m_rejectInt;   // sum of the rejected samples, STACK_INT32 with clipping
+    std::vector<double> m_rejectFloat;   // sum of the rejected samples, STACK_FLOAT with clipping
+    std::vector<uint16_t> m_rejectCount; // rejected samples
+
+    mutable std::mutex m_mutex;
+};
+
+#endif // __STACKACCUMULATOR_HPP__
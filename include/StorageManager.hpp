@@ -0,0 +1,160 @@
+/**
+ * @file StorageManager.hpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Dated output directories with quota and retention
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#ifndef __STORAGEMANAGER_HPP__
+#define __STORAGEMANAGER_HPP__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <string>
+#include <map>
+#include <mutex>
+
+#ifndef _Catchable
+/**
+ * @brief Functions marked with _Catchable are expected to throw exceptions.
+ *
+ */
+#define _Catchable
+#endif
+
+#ifndef CSTORAGEMANAGER_DBG_LVL
+/**
+ * @brief Debug level for CStorageManager. 0 = no debug, 1 = errors only, 2 = errors and warnings, 3 = errors, warnings and info
+ *
+ */
+#define CSTORAGEMANAGER_DBG_LVL 3
+#endif
+
+/**
+ * @brief Manages the dated (YYYYMMDD) output directories under a root directory.
+ * The current directory is cached until the next rollover, so the capture loop does
+ * not touch the file system to find it. Directories are created in-process. The total
+ * size of the dated directories is tracked, and the oldest directories are deleted
+ * when the quota or the minimum free space is exceeded.
+ *
+ */
+class CStorageManager
+{
+public:
+    /**
+     * @brief Construct a new CStorageManager object. Scans the dated directories under the root once.
+     *
+     * @param rootDir Root directory, created if it does not exist.
+     * @param rolloverHour [optional] Hour of the day (0 - 23) at which a new directory is started (default: 0, midnight).
+     * Frames before this hour go into the previous day's directory, e.g. 12 keeps a whole night in one directory.
+     * @param useUTC [optional] Use UTC instead of local time for dates and the rollover hour (default: false).
+     * @param quotaBytes [optional] Maximum total size of the dated directories, 0 to disable (default: 0).
+     * @param minFreeBytes [optional] Minimum free space to keep on the file system, 0 to disable (default: 0).
+     */
+    _Catchable CStorageManager(const std::string &rootDir, int rolloverHour = 0, bool useUTC = false, uint64_t quotaBytes = 0, uint64_t minFreeBytes = 0);
+
+    /**
+     * @brief Get the dated directory for a time, creating it if it is a new one.
+     *
+     * @param tnow [optional] Time, 0 to use the current time.
+     * @return std::string Path of the dated directory.
+     */
+    std::string _Catchable GetDirectory(time_t tnow = 0);
+
+    /**
+     * @brief Forget the cached directory. The next call to GetDirectory() checks and creates it again.
+     *
+     */
+    void Invalidate();
+
+    /**
+     * @brief Account for a file written to the current directory, and enforce the quota.
+     *
+     * @param path Path of the file.
+     */
+    void Account(const std::string &path);
+
+    /**
+     * @brief Account for bytes written to the current directory, and enforce the quota.
+     *
+     * @param bytes Number of bytes.
+     */
+    void Account(uint64_t bytes);
+
+    /**
+     * @brief Re-read the size of the current directory from disk (at most once a minute), and enforce the quota.
+     * Use this when the size of written files is not known, e.g. with SaveFITS or CImageArchive.
+     *
+     */
+    void Update();
+
+    /**
+     * @brief Delete the oldest dated directories until the quota and free space limits are met.
+     * The current directory is never deleted.
+     *
+     * @return int Number of directories deleted.
+     */
+    int EnforceQuota();
+
+    /**
+     * @brief Get the total size of the dated directories.
+     *
+     * @return uint64_t Size in bytes.
+     */
+    uint64_t GetUsage() const;
+
+    /**
+     * @brief Get the free space on the file system holding the root directory.
+     *
+     * @return uint64_t Free space in bytes, available to unprivileged users.
+     */
+    uint64_t GetFreeSpace() const;
+
+    /**
+     * @brief Get the root directory.
+     *
+     * @return const std::string& Root directory.
+     */
+    inline const std::string &GetRoot() const { return m_root; }
+
+    /**
+     * @brief Create a directory and its parents, equivalent to `mkdir -p`.
+     *
+     * @param path Directory path.
+     * @param mode [optional] Permissions of the created directories (default: 0755).
+     * @return bool Returns true if the directory exists or was created, false otherwise.
+     */
+    static bool MakeDirectories(const std::string &path, mode_t mode = 0755);
+
+private:
+    CStorageManager(const CStorageManager &);
+    CStorageManager &operator=(const CStorageManager &);
+
+    std::string DateName(time_t tnow, time_t &validFrom, time_t &validUntil) const;
+    void ScanUnlocked();
+    int EnforceQuotaUnlocked();
+
+    std::string m_root;
+    int m_rolloverHour;
+    bool m_useUTC;
+    uint64_t m_quotaBytes;
+    uint64_t m_minFreeBytes;
+
+    std::string m_currentName;
+    std::string m_currentDir;
+    time_t m_validFrom;
+    time_t m_validUntil;
+    time_t m_lastFreeCheck;
+    time_t m_lastScan;
+
+    std::map<std::string, uint64_t> m_usage; // dated directory name -> bytes, oldest first
+    uint64_t m_totalUsage;
+
+    mutable std::mutex m_mutex;
+};
+
+#endif // __STORAGEMANAGER_HPP__
@@ -4,6 +4,9 @@
 #ifndef JPEG_ENCODER_H
 #define JPEG_ENCODER_H
 
+#include <vector>
+#include <functional>
+
 namespace jpge
 {
   typedef unsigned char  uint8;
@@ -53,6 +56,42 @@ namespace jpge
   // On entry, buf_size is the size of the output buffer pointed at by pBuf, which should be at least ~1024 bytes. 
   // If return value is true, buf_size will be set to the size of the compressed data.
   bool compress_image_to_jpeg_file_in_memory(void *pBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params());
+
+  // Writes JPEG image to memory buffer like compress_image_to_jpeg_file_in_memory(), but encodes horizontal strips of
+  // the image in parallel on num_threads threads (0 = one per hardware thread). The strips are separated by restart
+  // markers, so the output is a standard baseline JPEG. One thread or m_two_pass_flag encode the image serially.
+  bool compress_image_to_jpeg_file_in_memory_mt(void *pBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params(), int num_threads = 0);
+
+  class output_stream;
+
+  // Writes JPEG image to an output stream, e.g. one of the streams below, without staging it in memory first.
+  bool compress_image_to_jpeg_stream(output_stream *pStream, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params());
+
+  // Writes JPEG image to an output stream like compress_image_to_jpeg_stream(), encoding horizontal strips in parallel
+  // like compress_image_to_jpeg_file_in_memory_mt().
+  bool compress_image_to_jpeg_stream_mt(output_stream *pStream, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params = params(), int num_threads = 0);
+
+  // Returns scanline y of the source image (width * num_channels bytes), either in place or after converting it into
+  // pBuf, a buffer of that size owned by the calling thread. Called concurrently for different rows. NULL aborts.
+  typedef std::function<const uint8 *(int y, uint8 *pBuf)> scanline_source;
+
+  // Like compress_image_to_jpeg_stream_mt(), but reads the scanlines from a source, so each thread only converts the
+  // rows of its own strips and the whole source bitmap is never held in memory.
+  bool compress_scanlines_to_jpeg_stream_mt(output_stream *pStream, int width, int height, int num_channels, const scanline_source &source, const params &comp_params = params(), int num_threads = 0);
+
+  // Instruction sets used for the forward DCT, quantization, block loading and RGB to YCbCr conversion.
+  // All of them produce the same output as the scalar code (SIMD_NONE).
+  enum simd_t { SIMD_NONE = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2, SIMD_NEON = 3 };
+
+  // Returns the instruction set used by encoders initialized from now on. Defaults to the best one the CPU supports.
+  simd_t get_simd();
+
+  // Selects the instruction set used by encoders initialized from now on, e.g. SIMD_NONE to compare against the scalar
+  // code. Returns false if the instruction set is not compiled in or not supported by the CPU. Define JPGE_NO_SIMD
+  // when building to compile only the scalar code.
+  bool set_simd(simd_t simd);
+
+  struct simd_kernels;
     
   // Output stream abstract class - used by the jpeg_encoder class to write to the output stream. 
   // put_buf() is generally called with len==JPGE_OUT_BUF_SIZE bytes, but for headers it'll be called with smaller amounts.
@@ -63,6 +102,60 @@ namespace jpge
     virtual bool put_buf(const void* Pbuf, int len) = 0;
     template<class T> inline bool put_obj(const T& obj) { return put_buf(&obj, sizeof(T)); }
   };
+
+  // Writes into a fixed size memory region, e.g. a caller's buffer or a shared memory slot. put_buf() fails once the
+  // region is full.
+  class memory_stream : public output_stream
+  {
+  public:
+    memory_stream(void *pBuf, uint buf_size) : m_pBuf(static_cast<uint8 *>(pBuf)), m_buf_size(buf_size), m_buf_ofs(0) { }
+    virtual ~memory_stream() { }
+    virtual bool put_buf(const void *pBuf, int len);
+    uint get_size() const { return m_buf_ofs; }
+
+  private:
+    memory_stream(const memory_stream &);
+    memory_stream &operator =(const memory_stream &);
+
+    uint8 *m_pBuf;
+    uint m_buf_size, m_buf_ofs;
+  };
+
+  // Appends to a vector, which grows as needed. Clearing the vector between images keeps its capacity.
+  class vector_stream : public output_stream
+  {
+  public:
+    vector_stream(std::vector<uint8> &buf) : m_buf(buf) { }
+    virtual ~vector_stream() { }
+    virtual bool put_buf(const void *pBuf, int len);
+
+  private:
+    vector_stream(const vector_stream &);
+    vector_stream &operator =(const vector_stream &);
+
+    std::vector<uint8> &m_buf;
+  };
+
+#ifndef _WIN32
+  // Writes to a file descriptor: a file, a pipe or a socket. Partial and interrupted writes are retried, and writes to
+  // a disconnected socket fail instead of raising SIGPIPE. The descriptor is not closed.
+  class fd_stream : public output_stream
+  {
+  public:
+    fd_stream(int fd) : m_fd(fd), m_socket(true), m_size(0) { }
+    virtual ~fd_stream() { }
+    virtual bool put_buf(const void *pBuf, int len);
+    uint get_size() const { return m_size; }
+
+  private:
+    fd_stream(const fd_stream &);
+    fd_stream &operator =(const fd_stream &);
+
+    int m_fd;
+    bool m_socket; // cleared when send() reports the descriptor is not a socket
+    uint m_size;
+  };
+#endif
     
   // Lower level jpeg_encoder class - useful if more control is needed than the above helper functions.
   class jpeg_encoder
@@ -77,7 +170,18 @@ namespace jpge
     // width, height  - Image dimensions.
     // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
     // Returns false on out of memory or if a stream write fails.
+    // The encoder can be initialized again for the next image without deinit(): the scanline buffer is kept if it is
+    // large enough, and the quantization and Huffman tables are kept if the parameters did not change them.
     bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
+
+    // Writes the markers preceding the entropy-coded data of an image, with a DRI marker if restart_interval (in MCUs)
+    // is not 0, and deinitializes the compressor. Huffman tables are the standard ones (m_two_pass_flag is ignored).
+    bool write_headers(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, uint restart_interval);
+
+    // Initializes the compressor to write only the entropy-coded data of a horizontal strip of an image (no markers),
+    // padded to a byte boundary after the last scanline. All but the last strip of an image must be a multiple of the
+    // MCU height tall. Huffman tables are the standard ones (m_two_pass_flag is ignored).
+    bool init_strip(output_stream *pStream, int width, int height, int src_channels, const params &comp_params);
     
     const params &get_params() const { return m_params; }
     
@@ -127,6 +231,13 @@ namespace jpge
     uint m_bits_in;
     uint8 m_pass_num;
     bool m_all_stream_writes_succeeded;
+    uint m_restart_interval;
+    bool m_strip_flag;
+    const simd_kernels *m_simd;
+    uint m_mcu_buf_size;
+    int m_quant_quality;
+    bool m_quant_no_chroma_discrim_flag;
+    bool m_std_huff_tables;
         
     void optimize_huffman_table(int table_num, int table_len);
     void emit_byte(uint8 i);
@@ -145,6 +256,7 @@ namespace jpge
     void first_pass_init();
     bool second_pass_init();
     bool jpg_open(int p_x_res, int p_y_res, int src_channels);
+    bool open(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, uint restart_interval, bool strip_flag);
     void load_block_8_8_grey(int x);
     void load_block_8_8(int x, int y, int c);
     void load_block_16_8(int x, int c);
@@ -161,6 +273,7 @@ namespace jpge
     bool process_end_of_image();
     void load_mcu(const void* src);
     void clear();
+    void reset();
     void init();
   };
 
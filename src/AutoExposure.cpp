@@ -0,0 +1,282 @@
+/**
+ * @file AutoExposure.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Closed-loop auto-exposure controller with sky brightness prediction implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "AutoExposure.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include <algorithm>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CAUTOEXPOSURE_DBG_LVL >= 3)
+#define CAUTOEXPOSURE_DBG_INFO(fmt, ...)                                                                     \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CAUTOEXPOSURE_DBG_INFO(fmt, ...)
+#endif
+
+#if (CAUTOEXPOSURE_DBG_LVL >= 1)
+#define CAUTOEXPOSURE_DBG_ERR(fmt, ...)                                                                     \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CAUTOEXPOSURE_DBG_ERR(fmt, ...)
+#endif
+
+#ifndef CAUTOEXPOSURE_MAX_GAP
+// A brightness estimate older than this (s) is not used for prediction
+#define CAUTOEXPOSURE_MAX_GAP 3600
+#endif
+
+#define SATURATED_PIXEL 0xff00    // metered pixel count at or above this only bounds the brightness from below
+#define MAX_TREND (log(10.0) / 60) // brightness changes at most 10x per minute
+#define MAX_INTEGRAL log(4.0)      // integral term corrects the exposure by at most 4x
+#define MIN_EXPOSURE 0.001         // s, exposures are rounded to 1 ms
+#define BIN_HYSTERESIS 0.5         // bin is reduced only if the exposure at the lower bin is below this fraction of the maximum
+
+CAutoExposureController::CAutoExposureController(int pixelTarget, int pixelTargetUncertainty, float percentilePixel, float maxAllowedExposure, int maxAllowedBin, int numPixelExclusion, const std::string &stateFile)
+    : m_target(pixelTarget), m_uncertainty(pixelTargetUncertainty), m_percentile(percentilePixel), m_maxExposure(maxAllowedExposure), m_maxBin(maxAllowedBin), m_exclusion(numPixelExclusion), m_stateFile(stateFile), m_alpha(0.7), m_beta(0.3), m_ki(0.2), m_bias(0), m_valid(false), m_tracking(false), m_time(0), m_brightness(0), m_trend(0), m_integral(0), m_interval(0), m_bin(1)
+{
+    if (m_maxExposure < MIN_EXPOSURE)
+    {
+        m_maxExposure = MIN_EXPOSURE;
+    }
+    if (m_stateFile.length() > 0 && LoadState())
+    {
+        CAUTOEXPOSURE_DBG_INFO("Loaded state from %s: brightness %.3f, trend %.2e/s", m_stateFile.c_str(), m_brightness, m_trend);
+    }
+}
+
+void CAutoExposureController::SetMetering(const CImageMetering &metering)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_metering = metering;
+}
+
+void CAutoExposureController::SetGains(float alpha, float beta, float ki)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_alpha = alpha < 0.01 ? 0.01 : (alpha > 1 ? 1 : alpha);
+    m_beta = beta < 0 ? 0 : (beta > 1 ? 1 : beta);
+    m_ki = ki < 0 ? 0 : ki;
+}
+
+void CAutoExposureController::SetPixelBias(int pixelBias)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bias = pixelBias < 0 ? 0 : pixelBias;
+}
+
+void CAutoExposureController::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_valid = false;
+    m_tracking = false;
+    m_trend = 0;
+    m_integral = 0;
+    m_interval = 0;
+}
+
+bool CAutoExposureController::Update(const CImageData &img, float &exposure, int &bin)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    exposure = img.GetExposure();
+    bin = img.GetBinX();
+    uint16_t value;
+    if (exposure <= 0 || !img.GetMeteredPercentile(value, m_percentile, m_exclusion, &m_metering))
+    {
+        return false;
+    }
+
+    // measured brightness, or a bound on it if the metered pixel is saturated or black
+    double effective = (double)exposure * img.GetBinX() * img.GetBinY();
+    double signal = std::max(1.0, (double)value - m_bias);
+    double measured = log(signal / effective);
+    int bound = value >= SATURATED_PIXEL ? 1 : (value <= m_bias + 1 ? -1 : 0);
+    uint64_t time = img.GetTimestamp();
+
+    if (!m_valid || time <= m_time || (time - m_time) * 1e-3 > CAUTOEXPOSURE_MAX_GAP)
+    {
+        // (re)start the estimate
+        m_brightness = measured + bound * log(2.0);
+        m_trend = 0;
+        m_interval = 0;
+        m_valid = true;
+        m_tracking = bound == 0;
+    }
+    else
+    {
+        double dt = (time - m_time) * 1e-3;
+        double predicted = m_brightness + m_trend * dt;
+        double error = measured - predicted;
+        if (bound != 0)
+        {
+            // the true brightness is beyond the measurement: keep the prediction if it agrees,
+            // otherwise step at least a factor of 2 past the measurement
+            if (error * bound > 0)
+            {
+                predicted = measured + bound * log(2.0);
+            }
+            m_brightness = predicted;
+            m_tracking = false;
+        }
+        else if (!m_tracking)
+        {
+            // first measurement after a bound, the estimate so far is a guess
+            m_brightness = measured;
+            m_trend = 0;
+            m_tracking = true;
+        }
+        else
+        {
+            m_brightness = predicted + m_alpha * error;
+            m_trend += m_beta * error / dt;
+            m_trend = std::max(-MAX_TREND, std::min(MAX_TREND, m_trend));
+            // integral of the remaining offset, outside the target band only so that noise does not accumulate
+            if (fabs((double)value - m_target) >= m_uncertainty)
+            {
+                m_integral += m_ki * log((m_target - m_bias) / signal);
+                m_integral = std::max(-MAX_INTEGRAL, std::min(MAX_INTEGRAL, m_integral));
+            }
+        }
+        m_interval = dt;
+    }
+    m_time = time;
+
+    // brightness at the next frame, assuming the same frame interval
+    double next = m_brightness + m_trend * m_interval;
+    double predictedValue = m_bias + exp(next) * effective;
+    if (bound == 0 && fabs(predictedValue - m_target) < m_uncertainty)
+    {
+        // on target, hold the exposure
+        m_bin = bin;
+    }
+    else
+    {
+        double target = std::max(1, m_target - m_bias);
+        Choose(target / exp(next) * exp(m_integral), bin, exposure, bin);
+        m_bin = bin;
+    }
+    if (m_stateFile.length() > 0 && !SaveState())
+    {
+        CAUTOEXPOSURE_DBG_ERR("Could not save state to %s", m_stateFile.c_str());
+    }
+    return true;
+}
+
+bool CAutoExposureController::Predict(uint64_t timestamp, float &exposure, int &bin) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_valid || timestamp < m_time || (timestamp - m_time) * 1e-3 > CAUTOEXPOSURE_MAX_GAP)
+    {
+        return false;
+    }
+    double next = m_brightness + m_trend * (timestamp - m_time) * 1e-3;
+    double target = std::max(1, m_target - m_bias);
+    Choose(target / exp(next) * exp(m_integral), m_bin, exposure, bin);
+    return true;
+}
+
+void CAutoExposureController::Choose(double effectiveExposure, int currentBin, float &exposure, int &bin) const
+{
+    // effective exposure = exposure x bin area, bins in factors of 2 as in CImageData::FindOptimumExposure
+    int bin_ = currentBin < 1 ? 1 : currentBin;
+    double exposure_ = effectiveExposure / ((double)bin_ * bin_);
+    if (m_maxBin >= 1)
+    {
+        while (exposure_ > m_maxExposure && bin_ * 2 <= m_maxBin)
+        {
+            bin_ *= 2;
+            exposure_ /= 4;
+        }
+        while (bin_ > 1 && exposure_ * 4 < m_maxExposure * BIN_HYSTERESIS)
+        {
+            bin_ /= 2;
+            exposure_ *= 4;
+        }
+        if (bin_ > m_maxBin)
+        {
+            bin_ = m_maxBin;
+        }
+    }
+    exposure_ = std::max(MIN_EXPOSURE, std::min((double)m_maxExposure, exposure_));
+    exposure = ((int)(exposure_ * 1000)) * 0.001; // round to 1 ms
+    bin = bin_;
+}
+
+bool CAutoExposureController::LoadState()
+{
+    FILE *fp = fopen(m_stateFile.c_str(), "r");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    char key[64];
+    double value;
+    int found = 0;
+    while (fscanf(fp, " %63[^=]=%lf", key, &value) == 2)
+    {
+        if (strcmp(key, "time") == 0)
+        {
+            m_time = (uint64_t)value;
+            found |= 1;
+        }
+        else if (strcmp(key, "brightness") == 0)
+        {
+            m_brightness = value;
+            found |= 2;
+        }
+        else if (strcmp(key, "trend") == 0)
+            m_trend = std::max(-MAX_TREND, std::min(MAX_TREND, value));
+        else if (strcmp(key, "integral") == 0)
+            m_integral = std::max(-MAX_INTEGRAL, std::min(MAX_INTEGRAL, value));
+        else if (strcmp(key, "interval") == 0)
+            m_interval = value > 0 ? value : 0;
+        else if (strcmp(key, "bin") == 0)
+            m_bin = value >= 1 ? (int)value : 1;
+        else if (strcmp(key, "tracking") == 0)
+            m_tracking = value != 0;
+    }
+    fclose(fp);
+    m_valid = found == 3 && isfinite(m_brightness);
+    return m_valid;
+}
+
+bool CAutoExposureController::SaveState() const
+{
+    // written next to the state file and renamed over it, a crash leaves the old or the new state
+    std::string tmpFile = m_stateFile + ".tmp";
+    FILE *fp = fopen(tmpFile.c_str(), "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    fprintf(fp, "time=%" PRIu64 "\nbrightness=%.17g\ntrend=%.17g\nintegral=%.17g\ninterval=%.17g\nbin=%d\ntracking=%d\n", m_time, m_brightness, m_trend, m_integral, m_interval, m_bin, m_tracking ? 1 : 0);
+    bool ok = fflush(fp) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpFile.c_str(), m_stateFile.c_str()) != 0)
+    {
+        remove(tmpFile.c_str());
+        return false;
+    }
+    return true;
+}
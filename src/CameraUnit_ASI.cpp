@@ -9,6 +9,7 @@
  *
  */
 #include "CameraUnit_ASI.hpp"
+#include "FrameCache.hpp"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -441,6 +442,9 @@ void CCameraUnit_ASI::CaptureThread(CCameraUnit_ASI *cam, CImageData *data, CCam
         metadata.maxGain = cam->GetMaxGain();
         CImageData *new_img = new CImageData(iwid, ihei, dataptr, metadata); // create new image data object
         cam->image_data = std::shared_ptr<CImageData>(new_img);              // store in shared pointer
+        CFrameCache *cache = cam->frame_cache;
+        if (cache != nullptr)
+            cache->Update(*new_img); // copied, encoded on the cache thread
         if (data != nullptr)
             *data = *new_img; // copy to output
         delete[] dataptr;
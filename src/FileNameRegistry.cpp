@@ -0,0 +1,154 @@
+/**
+ * @file FileNameRegistry.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Constant-time collision-free file creation implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "FileNameRegistry.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+
+static inline std::string normalize_dir(const std::string &dirName)
+{
+    std::string dir = dirName;
+    while (dir.length() > 1 && dir[dir.length() - 1] == '/')
+    {
+        dir.erase(dir.length() - 1);
+    }
+    return dir;
+}
+
+CFileNameRegistry &CFileNameRegistry::Instance()
+{
+    static CFileNameRegistry registry;
+    return registry;
+}
+
+CFileNameRegistry::DirEntry &CFileNameRegistry::GetDir(const std::string &dirName)
+{
+    auto iter = m_dirs.find(dirName);
+    if (iter != m_dirs.end())
+    {
+        return iter->second;
+    }
+    DirEntry &entry = m_dirs[dirName];
+    DIR *dir = opendir(dirName.c_str());
+    if (dir != nullptr)
+    {
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != nullptr)
+        {
+            entry.names.insert(ent->d_name);
+        }
+        closedir(dir);
+    }
+    return entry;
+}
+
+int CFileNameRegistry::CreateUnique(const std::string &dirName, const std::string &stem, const std::string &ext, std::string &path, int flags)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string dir = normalize_dir(dirName);
+    DirEntry &entry = GetDir(dir);
+
+    std::string name = stem + ext;
+    int ctr = 0;
+    if (entry.names.count(name))
+    {
+        auto next = entry.next.find(stem);
+        ctr = next == entry.next.end() ? 1 : next->second;
+        name = stem + "_" + std::to_string(ctr) + ext;
+    }
+    while (true)
+    {
+        if (!entry.names.count(name))
+        {
+            std::string full = dir + "/" + name;
+            int fd = open(full.c_str(), flags | O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd >= 0)
+            {
+                entry.names.insert(name);
+                if (ctr > 0)
+                {
+                    entry.next[stem] = ctr + 1;
+                }
+                path = full;
+                return fd;
+            }
+            if (errno != EEXIST) // EEXIST: created by someone else since the directory was read
+            {
+                if (errno == ENOENT) // directory does not exist (yet), do not keep an empty listing
+                {
+                    m_dirs.erase(dir);
+                }
+                return -1;
+            }
+            entry.names.insert(name);
+        }
+        name = stem + "_" + std::to_string(++ctr) + ext;
+    }
+    return -1;
+}
+
+bool CFileNameRegistry::WriteUnique(const std::string &dirName, const std::string &stem, const std::string &ext, const void *data, size_t size, std::string &path, bool syncOnWrite)
+{
+    int fd = CreateUnique(dirName, stem, ext, path);
+    if (fd < 0)
+    {
+        return false;
+    }
+    int err = 0;
+#if defined(__linux__)
+    // reserve the blocks up front; file systems without fallocate support fall through to write()
+    if (size > 0 && fallocate(fd, 0, 0, (off_t)size) != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        err = errno;
+    }
+#endif
+    const char *ptr = (const char *)data;
+    size_t remaining = err ? 0 : size;
+    while (remaining > 0)
+    {
+        ssize_t n = write(fd, ptr, remaining);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            err = n < 0 ? errno : ENOSPC;
+            break;
+        }
+        ptr += n;
+        remaining -= n;
+    }
+    if (!err && syncOnWrite && fsync(fd) != 0)
+    {
+        err = errno;
+    }
+    if (close(fd) != 0 && !err)
+    {
+        err = errno;
+    }
+    if (err)
+    {
+        unlink(path.c_str()); // the name stays reserved in the registry, it is not reused
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+void CFileNameRegistry::Forget(const std::string &dirName)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dirs.erase(normalize_dir(dirName));
+}
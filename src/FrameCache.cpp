@@ -0,0 +1,227 @@
+/**
+ * @file FrameCache.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Latest-frame cache with precomputed JPEG and thumbnail, served over a Unix socket implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "FrameCache.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CFRAMECACHE_DBG_LVL >= 3)
+#define CFRAMECACHE_DBG_INFO(fmt, ...)                                                                       \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CFRAMECACHE_DBG_INFO(fmt, ...)
+#endif
+
+#if (CFRAMECACHE_DBG_LVL >= 1)
+#define CFRAMECACHE_DBG_ERR(fmt, ...)                                                                       \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CFRAMECACHE_DBG_ERR(fmt, ...)
+#endif
+
+// Longest request line accepted from a client
+#define CFRAMECACHE_MAX_REQUEST 64
+
+// Client state: the request waiting for a newer frame
+enum
+{
+    REQ_NONE = 0,
+    REQ_JPEG,
+    REQ_THUMB,
+    REQ_META
+};
+
+static std::shared_ptr<const std::vector<unsigned char>> format_metadata(const CImageData &img, uint64_t sequence)
+{
+    CImageMetadata metadata = img.GetImageMetadata();
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "sequence=%llu\nwidth=%d\nheight=%d\ntimestamp=%llu\nexposure=%.6f\nbinx=%d\nbiny=%d\n"
+             "left=%d\ntop=%d\ntemperature=%.2f\ngain=%lld\noffset=%lld\n",
+             (unsigned long long)sequence, img.GetImageWidth(), img.GetImageHeight(),
+             (unsigned long long)metadata.timestamp, metadata.exposureTime, metadata.binX, metadata.binY,
+             metadata.imgLeft, metadata.imgTop, metadata.temperature, (long long)metadata.gain, (long long)metadata.offset);
+    std::string text(buf);
+    text += "camera=" + metadata.cameraName + "\n";
+    for (auto it = metadata.extendedMetadata.begin(); it != metadata.extendedMetadata.end(); it++)
+        text += it->first + "=" + it->second + "\n";
+    return std::make_shared<const std::vector<unsigned char>>(text.begin(), text.end());
+}
+
+CFrameCache::CFrameCache(const std::string &socketPath, int thumbSize, int jpegQuality)
+    : m_socketPath(socketPath), m_thumbSize(thumbSize < 16 ? 16 : thumbSize), m_jpegQuality(jpegQuality), m_server(nullptr), m_pending(nullptr), m_updates(0), m_dropped(0), m_done(false)
+{
+    m_entry.sequence = 0;
+    m_server = new CFrameServer(socketPath, -1, [this](CFrameServerClient &client, uint64_t now)
+                                { return ServeClient(client, now); });
+    m_encoder = std::thread(&CFrameCache::EncoderThread, this);
+    CFRAMECACHE_DBG_INFO("Serving frames on %s", socketPath.c_str());
+}
+
+CFrameCache::~CFrameCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+    m_cond.notify_all();
+    m_encoder.join();
+    delete m_server;
+    delete m_pending;
+}
+
+void CFrameCache::Update(const CImageData &img)
+{
+    if (!img.HasData())
+        return;
+    CImageData *frame = new CImageData(img);
+    CImageData *old = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        old = m_pending;
+        m_pending = frame;
+        m_updates++;
+        if (old != nullptr)
+            m_dropped++;
+    }
+    m_cond.notify_one();
+    delete old;
+}
+
+uint64_t CFrameCache::GetSequence() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entry.sequence;
+}
+
+uint64_t CFrameCache::GetDropped() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+int CFrameCache::GetClients() const
+{
+    return m_server->GetClients();
+}
+
+CFrameCache::Entry CFrameCache::GetEntry() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entry;
+}
+
+void CFrameCache::EncoderThread()
+{
+    while (true)
+    {
+        CImageData *frame = nullptr;
+        uint64_t sequence = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]
+                        { return m_done || m_pending != nullptr; });
+            if (m_done)
+                break;
+            frame = m_pending;
+            m_pending = nullptr;
+            sequence = m_updates;
+        }
+
+        Entry entry;
+        entry.sequence = sequence;
+        entry.thumb = CFrameServer::EncodeJPEG(*frame, m_jpegQuality, m_thumbSize, m_thumbSize);
+        entry.meta = format_metadata(*frame, sequence);
+        entry.jpeg = CFrameServer::EncodeJPEG(*frame, m_jpegQuality);
+        delete frame;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entry = entry;
+        }
+        m_server->Wake(); // clients waiting for a new frame
+    }
+}
+
+// Queue the reply to a request
+static void queue_reply(CFrameServerClient &client, uint64_t sequence, const CFrameServerClient::Buffer &body)
+{
+    char buf[64];
+    size_t len = body ? body->size() : 0;
+    snprintf(buf, sizeof(buf), "%llu %zu\n", (unsigned long long)sequence, len);
+    client.Queue(buf, body);
+    client.lastSeq = sequence;
+}
+
+bool CFrameCache::ServeClient(CFrameServerClient &client, uint64_t /* now */)
+{
+    if (client.state == REQ_NONE)
+    {
+        size_t eol = client.request.find('\n');
+        if (eol == std::string::npos)
+        {
+            return client.request.size() <= CFRAMECACHE_MAX_REQUEST;
+        }
+        std::string line = client.request.substr(0, eol);
+        client.request.erase(0, eol + 1);
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        bool next = false;
+        if (line.compare(0, 5, "NEXT ") == 0)
+        {
+            next = true;
+            line.erase(0, 5);
+        }
+        int req = REQ_NONE;
+        if (line == "JPEG")
+            req = REQ_JPEG;
+        else if (line == "THUMB")
+            req = REQ_THUMB;
+        else if (line == "META")
+            req = REQ_META;
+        if (req == REQ_NONE)
+        {
+            client.Queue("ERR\n");
+            client.closing = true;
+            return true;
+        }
+        Entry entry = GetEntry();
+        if (!next)
+        {
+            queue_reply(client, entry.sequence, req == REQ_JPEG ? entry.jpeg : req == REQ_THUMB ? entry.thumb
+                                                                                                : entry.meta);
+            return true;
+        }
+        client.state = req;
+    }
+    // waiting for a frame newer than the last one sent
+    Entry entry = GetEntry();
+    if (entry.sequence > client.lastSeq)
+    {
+        int req = client.state;
+        queue_reply(client, entry.sequence, req == REQ_JPEG ? entry.jpeg : req == REQ_THUMB ? entry.thumb
+                                                                                            : entry.meta);
+        client.state = REQ_NONE;
+    }
+    return true;
+}
@@ -0,0 +1,517 @@
+/**
+ * @file FrameRing.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief POSIX shared memory frame ring for external consumers implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "FrameRing.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CFRAMERING_DBG_LVL >= 3)
+#define CFRAMERING_DBG_INFO(fmt, ...)                                                                        \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CFRAMERING_DBG_INFO(fmt, ...)
+#endif
+
+#if (CFRAMERING_DBG_LVL >= 2)
+#define CFRAMERING_DBG_WARN(fmt, ...)                                                                          \
+    {                                                                                                          \
+        fprintf(stderr, "%s:%d:%s(): " YELLOW_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                        \
+    }
+#else
+#define CFRAMERING_DBG_WARN(fmt, ...)
+#endif
+
+#if (CFRAMERING_DBG_LVL >= 1)
+#define CFRAMERING_DBG_ERR(fmt, ...)                                                                        \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CFRAMERING_DBG_ERR(fmt, ...)
+#endif
+
+// 32-bit atomics are lock-free (and so usable across processes) on every supported target, 64-bit ones are not on armv7
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "32-bit atomics must be lock-free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Atomics must have the layout of the plain type");
+
+// Ring header, at the start of the segment
+typedef struct
+{
+    char magic[8];
+    uint32_t nSlots;
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    uint32_t reserved;
+    uint64_t slotSize;
+    std::atomic<uint32_t> active; // 0 once the publisher exits
+    std::atomic<uint32_t> latest; // index + 1 of the newest slot, 0 if none
+    std::atomic<uint32_t> notify; // futex word, incremented for every frame
+} ring_header;
+
+// Slot header, followed by the serialized extended metadata; the pixels start at the next page
+typedef struct
+{
+    std::atomic<uint32_t> lock; // sequence lock, odd while the slot is written
+    uint32_t extendedLength;
+    uint64_t sequence;
+    uint32_t width;
+    uint32_t height;
+    uint64_t timestamp;
+    double exposureTime;
+    float temperature;
+    int32_t binX;
+    int32_t binY;
+    int32_t imgLeft;
+    int32_t imgTop;
+    int32_t minGain;
+    int32_t maxGain;
+    int32_t reserved;
+    int64_t gain;
+    int64_t offset;
+    char cameraName[64];
+} ring_slot;
+
+static const char ringMagic[8] = {'C', 'F', 'R', 'I', 'N', 'G', '0', '1'};
+static const size_t pageSize = 4096;
+
+static inline ring_slot *get_slot(void *map, uint32_t index)
+{
+    ring_header *header = (ring_header *)map;
+    return (ring_slot *)((unsigned char *)map + pageSize + index * header->slotSize);
+}
+
+static void futex_wait(std::atomic<uint32_t> *addr, uint32_t val, int timeoutMs)
+{
+#if defined(__linux__)
+    struct timespec ts, *pts = nullptr;
+    if (timeoutMs >= 0)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        pts = &ts;
+    }
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, pts, NULL, 0); // shared futex, works on a read-only mapping
+#else
+    usleep(1000);
+#endif
+}
+
+static void futex_wake(std::atomic<uint32_t> *addr)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+// Mark the segment of a previous publisher inactive and wake its readers. The publisher sets
+// this on exit, but not when it crashed, and readers would then wait on the orphaned mapping.
+static void retire_segment(const std::string &name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= pageSize)
+    {
+        map = mmap(NULL, pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return;
+    }
+    ring_header *header = (ring_header *)map;
+    if (memcmp(header->magic, ringMagic, sizeof(ringMagic)) == 0)
+    {
+        header->active.store(0, std::memory_order_release);
+        header->notify.fetch_add(1, std::memory_order_release);
+        futex_wake(&header->notify);
+    }
+    munmap(map, pageSize);
+}
+
+CFrameRing::CFrameRing(const std::string &name, int nSlots, int maxWidth, int maxHeight)
+    : m_name(name), m_map(nullptr), m_mapSize(0), m_sequence(0)
+{
+    if (nSlots < 2 || maxWidth < 1 || maxHeight < 1)
+    {
+        throw std::invalid_argument("Frame ring needs at least 2 slots and a positive image size");
+    }
+    uint64_t slotSize = (pageSize + (uint64_t)maxWidth * maxHeight * sizeof(unsigned short) + pageSize - 1) / pageSize * pageSize;
+    m_mapSize = pageSize + slotSize * nSlots;
+
+    // start from a fresh segment, readers of a previous publisher see it inactive and re-attach
+    retire_segment(m_name);
+    shm_unlink(m_name.c_str());
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        CFRAMERING_DBG_ERR("Could not create %s: %s", m_name.c_str(), strerror(errno));
+        throw std::runtime_error("Could not create shared memory " + m_name);
+    }
+    // reserve the memory: touching a page that can not be allocated raises SIGBUS
+    int err = posix_fallocate(fd, 0, m_mapSize);
+    if (err == EOPNOTSUPP || err == EINVAL)
+    {
+        CFRAMERING_DBG_WARN("%s can not be preallocated (%s), a full /dev/shm raises SIGBUS on publish", m_name.c_str(), strerror(err));
+        err = ftruncate(fd, m_mapSize) == 0 ? 0 : errno;
+    }
+    if (err != 0)
+    {
+        CFRAMERING_DBG_ERR("Could not allocate %zu bytes for %s: %s", m_mapSize, m_name.c_str(), strerror(err));
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("Could not allocate shared memory " + m_name);
+    }
+    void *map = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        CFRAMERING_DBG_ERR("Could not map %s: %s", m_name.c_str(), strerror(errno));
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("Could not map shared memory " + m_name);
+    }
+    m_map = map;
+    ring_header *header = (ring_header *)m_map;
+    header->nSlots = nSlots;
+    header->maxWidth = maxWidth;
+    header->maxHeight = maxHeight;
+    header->slotSize = slotSize;
+    header->latest.store(0, std::memory_order_relaxed);
+    header->notify.store(0, std::memory_order_relaxed);
+    memcpy(header->magic, ringMagic, sizeof(ringMagic));
+    header->active.store(1, std::memory_order_release);
+    CFRAMERING_DBG_INFO("Publishing frames to %s, %d slots, %.1f MiB", m_name.c_str(), nSlots, m_mapSize / 1048576.0);
+}
+
+CFrameRing::~CFrameRing()
+{
+    ring_header *header = (ring_header *)m_map;
+    header->active.store(0, std::memory_order_release);
+    header->notify.fetch_add(1, std::memory_order_release);
+    futex_wake(&header->notify);
+    munmap(m_map, m_mapSize);
+    shm_unlink(m_name.c_str());
+}
+
+bool CFrameRing::Publish(const CImageData &img)
+{
+    if (!img.HasData())
+    {
+        return false;
+    }
+    ring_header *header = (ring_header *)m_map;
+    uint32_t width = img.GetImageWidth(), height = img.GetImageHeight();
+    if (width > header->maxWidth || height > header->maxHeight)
+    {
+        CFRAMERING_DBG_ERR("Image %u x %u does not fit %s (%u x %u)", width, height, m_name.c_str(), header->maxWidth, header->maxHeight);
+        return false;
+    }
+    CImageMetadata metadata = img.GetImageMetadata();
+    std::string extended;
+    for (auto iter = metadata.extendedMetadata.begin(); iter != metadata.extendedMetadata.end(); iter++)
+    {
+        size_t len = iter->first.length() + iter->second.length() + 2;
+        if (sizeof(ring_slot) + extended.length() + len > pageSize)
+        {
+            break;
+        }
+        extended += iter->first;
+        extended.push_back('\0');
+        extended += iter->second;
+        extended.push_back('\0');
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t sequence = ++m_sequence;
+    uint32_t index = sequence % header->nSlots;
+    ring_slot *slot = get_slot(m_map, index);
+
+    uint32_t ticket = slot->lock.load(std::memory_order_relaxed);
+    slot->lock.store(ticket + 1, std::memory_order_relaxed); // odd: readers retry or discard
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->sequence = sequence;
+    slot->width = width;
+    slot->height = height;
+    slot->extendedLength = extended.length();
+    slot->timestamp = metadata.timestamp;
+    slot->exposureTime = metadata.exposureTime;
+    slot->temperature = metadata.temperature;
+    slot->binX = metadata.binX;
+    slot->binY = metadata.binY;
+    slot->imgLeft = metadata.imgLeft;
+    slot->imgTop = metadata.imgTop;
+    slot->minGain = metadata.minGain;
+    slot->maxGain = metadata.maxGain;
+    slot->gain = metadata.gain;
+    slot->offset = metadata.offset;
+    memset(slot->cameraName, 0, sizeof(slot->cameraName));
+    strncpy(slot->cameraName, metadata.cameraName.c_str(), sizeof(slot->cameraName) - 1);
+    memcpy((unsigned char *)slot + sizeof(ring_slot), extended.data(), extended.length());
+    memcpy((unsigned char *)slot + pageSize, img.GetImageData(), (size_t)width * height * sizeof(unsigned short));
+    slot->lock.store(ticket + 2, std::memory_order_release);
+
+    header->latest.store(index + 1, std::memory_order_release);
+    header->notify.fetch_add(1, std::memory_order_release);
+    futex_wake(&header->notify);
+    return true;
+}
+
+uint64_t CFrameRing::GetSequence() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sequence;
+}
+
+CFrameRingReader::CFrameRingReader(const std::string &name)
+    : m_name(name), m_map(nullptr), m_mapSize(0), m_lastSeq(0), m_skipped(0)
+{
+    if (!Attach())
+    {
+        throw std::runtime_error("Could not attach to " + m_name);
+    }
+}
+
+CFrameRingReader::~CFrameRingReader()
+{
+    Detach();
+}
+
+bool CFrameRingReader::Attach()
+{
+    int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < pageSize)
+    {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    ring_header *header = (ring_header *)map;
+    bool valid = header->active.load(std::memory_order_acquire) && memcmp(header->magic, ringMagic, sizeof(ringMagic)) == 0;
+    valid = valid && header->nSlots > 0 && (uint64_t)st.st_size >= pageSize + header->slotSize * header->nSlots;
+    if (!valid)
+    {
+        munmap(map, st.st_size);
+        return false;
+    }
+    m_map = map;
+    m_mapSize = st.st_size;
+    m_lastSeq = 0;
+    return true;
+}
+
+void CFrameRingReader::Detach()
+{
+    if (m_map != nullptr)
+    {
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+    }
+}
+
+// Sequence number of the newest frame, 0 if none
+static uint64_t latest_sequence(void *map)
+{
+    ring_header *header = (ring_header *)map;
+    uint32_t latest = header->latest.load(std::memory_order_acquire);
+    if (latest == 0 || latest > header->nSlots)
+    {
+        return 0;
+    }
+    ring_slot *slot = get_slot(map, latest - 1);
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        uint32_t ticket = slot->lock.load(std::memory_order_acquire);
+        uint64_t sequence = slot->sequence;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!(ticket & 1) && slot->lock.load(std::memory_order_relaxed) == ticket)
+        {
+            return sequence;
+        }
+        sched_yield();
+    }
+    return 0; // publisher stuck in the middle of a write
+}
+
+bool CFrameRingReader::WaitForFrame(int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true)
+    {
+        int remaining = -1;
+        if (timeoutMs >= 0)
+        {
+            remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            remaining = remaining < 0 ? 0 : remaining;
+        }
+        if (m_map != nullptr && !((ring_header *)m_map)->active.load(std::memory_order_acquire))
+        {
+            Detach(); // publisher exited or restarted
+        }
+        if (m_map == nullptr && !Attach())
+        {
+            if (remaining == 0)
+            {
+                return false;
+            }
+            usleep((remaining < 0 || remaining > 100) ? 100000 : remaining * 1000); // poll for a new publisher
+            continue;
+        }
+        ring_header *header = (ring_header *)m_map;
+        uint32_t notify = header->notify.load(std::memory_order_acquire);
+        if (latest_sequence(m_map) > m_lastSeq)
+        {
+            return true;
+        }
+        if (remaining == 0)
+        {
+            return false;
+        }
+        futex_wait(&header->notify, notify, remaining);
+    }
+}
+
+bool CFrameRingReader::Acquire(CFrameRingView &view)
+{
+    if (m_map == nullptr && !Attach())
+    {
+        return false;
+    }
+    ring_header *header = (ring_header *)m_map;
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        uint32_t latest = header->latest.load(std::memory_order_acquire);
+        if (latest == 0 || latest > header->nSlots)
+        {
+            return false;
+        }
+        ring_slot *slot = get_slot(m_map, latest - 1);
+        uint32_t ticket = slot->lock.load(std::memory_order_acquire);
+        if (ticket & 1) // the publisher lapped the ring while we looked
+        {
+            sched_yield();
+            continue;
+        }
+        view.sequence = slot->sequence;
+        view.width = slot->width;
+        view.height = slot->height;
+        view.metadata = CImageMetadata();
+        view.metadata.timestamp = slot->timestamp;
+        view.metadata.exposureTime = slot->exposureTime;
+        view.metadata.temperature = slot->temperature;
+        view.metadata.binX = slot->binX;
+        view.metadata.binY = slot->binY;
+        view.metadata.imgLeft = slot->imgLeft;
+        view.metadata.imgTop = slot->imgTop;
+        view.metadata.minGain = slot->minGain;
+        view.metadata.maxGain = slot->maxGain;
+        view.metadata.gain = slot->gain;
+        view.metadata.offset = slot->offset;
+        view.metadata.cameraName = std::string(slot->cameraName, strnlen(slot->cameraName, sizeof(slot->cameraName)));
+        uint32_t extendedLength = slot->extendedLength < pageSize - sizeof(ring_slot) ? slot->extendedLength : pageSize - sizeof(ring_slot);
+        const char *ext = (const char *)slot + sizeof(ring_slot);
+        const char *end = ext + extendedLength;
+        while (ext < end)
+        {
+            std::string key(ext, strnlen(ext, end - ext));
+            ext += key.length() + 1;
+            if (ext >= end)
+            {
+                break;
+            }
+            std::string value(ext, strnlen(ext, end - ext));
+            ext += value.length() + 1;
+            view.metadata.extendedMetadata[key] = value;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->lock.load(std::memory_order_relaxed) != ticket || view.width > (int)header->maxWidth || view.height > (int)header->maxHeight)
+        {
+            continue;
+        }
+        view.data = (const unsigned short *)((const unsigned char *)slot + pageSize);
+        view.ticket = ticket;
+        view.slot = slot;
+        if (m_lastSeq > 0 && view.sequence > m_lastSeq + 1)
+        {
+            m_skipped += view.sequence - m_lastSeq - 1;
+        }
+        m_lastSeq = view.sequence > m_lastSeq ? view.sequence : m_lastSeq;
+        return true;
+    }
+    return false;
+}
+
+bool CFrameRingReader::Release(const CFrameRingView &view) const
+{
+    if (view.slot == nullptr)
+    {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ((const ring_slot *)view.slot)->lock.load(std::memory_order_relaxed) == view.ticket;
+}
+
+bool CFrameRingReader::Read(CImageData &img)
+{
+    CFrameRingView view;
+    for (int attempt = 0; attempt < 3; attempt++)
+    {
+        if (!Acquire(view))
+        {
+            return false;
+        }
+        CImageData copy(view.width, view.height, (unsigned short *)view.data, view.metadata);
+        if (Release(view))
+        {
+            img = copy;
+            return true;
+        }
+    }
+    return false;
+}
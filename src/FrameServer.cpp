@@ -0,0 +1,379 @@
+/**
+ * @file FrameServer.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Socket server and preview encoding shared by CFrameCache and CMJPEGServer implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "FrameServer.hpp"
+#include "jpge.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <list>
+#include <stdexcept>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CFRAMESERVER_DBG_LVL >= 1)
+#define CFRAMESERVER_DBG_ERR(fmt, ...)                                                                      \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CFRAMESERVER_DBG_ERR(fmt, ...)
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set on the client sockets instead
+#endif
+
+// Interval at which idle clients are handled, e.g. to time out requests, ms
+#define CFRAMESERVER_POLL_INTERVAL 1000
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return false;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+void CFrameServerClient::Queue(const std::string &head, const Buffer &body, const std::string &tail)
+{
+    this->head = head;
+    this->body = body;
+    this->tail = tail;
+    offset = 0;
+}
+
+bool CFrameServerClient::Send()
+{
+    while (Pending())
+    {
+        struct iovec iov[3];
+        size_t lens[3] = {head.size(), body ? body->size() : 0, tail.size()};
+        const void *bufs[3] = {head.data(), body ? body->data() : nullptr, tail.data()};
+        int niov = 0;
+        size_t skip = offset, total = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            total += lens[i];
+            if (skip >= lens[i])
+            {
+                skip -= lens[i];
+                continue;
+            }
+            iov[niov].iov_base = (void *)((const char *)bufs[i] + skip);
+            iov[niov].iov_len = lens[i] - skip;
+            skip = 0;
+            niov++;
+        }
+        if (niov == 0)
+        {
+            head.clear();
+            body.reset();
+            tail.clear();
+            break;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = niov;
+        ssize_t ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (ret < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        offset += ret;
+        if (offset >= total)
+        {
+            head.clear();
+            body.reset();
+            tail.clear();
+        }
+    }
+    return true;
+}
+
+CFrameServer::CFrameServer(const std::string &address, int port, const CFrameServerHandler &handler, int maxClients, int sendBuffer)
+    : m_handler(handler), m_maxClients(maxClients), m_sendBuffer(sendBuffer), m_listenFd(-1), m_clients(0), m_done(false)
+{
+    m_wakeFd[0] = m_wakeFd[1] = -1;
+
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    memset(&addr, 0, sizeof(addr));
+    bool unixSocket = port < 0;
+    if (unixSocket)
+    {
+        struct sockaddr_un *uaddr = (struct sockaddr_un *)&addr;
+        if (address.empty() || address.size() >= sizeof(uaddr->sun_path))
+        {
+            throw std::invalid_argument("Invalid socket path " + address);
+        }
+        uaddr->sun_family = AF_UNIX;
+        strncpy(uaddr->sun_path, address.c_str(), sizeof(uaddr->sun_path) - 1);
+        addrlen = sizeof(struct sockaddr_un);
+        struct stat st;
+        if (lstat(address.c_str(), &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode)) // do not remove anything but a stale socket
+            {
+                throw std::invalid_argument(address + " exists and is not a socket");
+            }
+            unlink(address.c_str());
+        }
+    }
+    else
+    {
+        struct sockaddr_in *iaddr = (struct sockaddr_in *)&addr;
+        iaddr->sin_family = AF_INET;
+        iaddr->sin_port = htons(port);
+        if (port == 0 || port > 65535 || inet_pton(AF_INET, address.empty() ? "127.0.0.1" : address.c_str(), &iaddr->sin_addr) != 1)
+        {
+            throw std::invalid_argument("Invalid address " + address + ":" + std::to_string(port));
+        }
+        addrlen = sizeof(struct sockaddr_in);
+    }
+
+    m_listenFd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (m_listenFd < 0)
+    {
+        throw std::runtime_error(std::string("Could not create socket: ") + strerror(errno));
+    }
+    if (!unixSocket)
+    {
+        int one = 1;
+        setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (!set_nonblocking(m_listenFd) || bind(m_listenFd, (struct sockaddr *)&addr, addrlen) < 0 || listen(m_listenFd, 16) < 0)
+    {
+        std::string err = strerror(errno);
+        close(m_listenFd);
+        throw std::runtime_error("Could not listen on " + address + ": " + err);
+    }
+    if (unixSocket)
+    {
+        m_socketPath = address;
+    }
+    if (pipe(m_wakeFd) < 0 || !set_nonblocking(m_wakeFd[0]) || !set_nonblocking(m_wakeFd[1]))
+    {
+        std::string err = strerror(errno);
+        if (m_wakeFd[0] >= 0)
+        {
+            close(m_wakeFd[0]);
+            close(m_wakeFd[1]);
+        }
+        close(m_listenFd);
+        if (unixSocket)
+            unlink(address.c_str());
+        throw std::runtime_error("Could not create pipe: " + err);
+    }
+
+    m_thread = std::thread(&CFrameServer::ServerThread, this);
+}
+
+CFrameServer::~CFrameServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+    Wake();
+    m_thread.join();
+    close(m_wakeFd[0]);
+    close(m_wakeFd[1]);
+    close(m_listenFd);
+    if (!m_socketPath.empty())
+        unlink(m_socketPath.c_str());
+}
+
+void CFrameServer::Wake()
+{
+    char c = 1;
+    if (write(m_wakeFd[1], &c, 1) < 0)
+    {
+        // pipe full, the server thread has a wake up pending already
+    }
+}
+
+int CFrameServer::GetClients() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_clients;
+}
+
+uint64_t CFrameServer::GetTime()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CFrameServerClient::Buffer CFrameServer::EncodeJPEG(CImageData &img, int quality, int maxWidth, int maxHeight)
+{
+    // bin down by the smallest power of 2 that fits
+    int levels = 0;
+    while ((maxWidth > 0 && (img.GetImageWidth() >> levels) > maxWidth) || (maxHeight > 0 && (img.GetImageHeight() >> levels) > maxHeight))
+        levels++;
+    img.SetJPEGQuality(quality);
+    std::vector<CImageData> pyramid;
+    CImageData *preview = &img;
+    if (levels > 0)
+    {
+        if (img.BuildPyramid(pyramid, levels) < levels)
+            return nullptr;
+        preview = &pyramid.back();
+    }
+
+    std::vector<unsigned char> *out = new std::vector<unsigned char>();
+    out->reserve((size_t)preview->GetImageWidth() * preview->GetImageHeight() / 4 + 1024); // grows if needed
+    jpge::vector_stream stream(*out);
+    if (!preview->WriteJPEG(&stream))
+    {
+        CFRAMESERVER_DBG_ERR("Failed to compress image to jpeg in memory");
+        delete out;
+        return nullptr;
+    }
+    return CFrameServerClient::Buffer(out);
+}
+
+void CFrameServer::ServerThread()
+{
+    std::list<CFrameServerClient> clients;
+    std::vector<struct pollfd> pfds;
+
+    while (true)
+    {
+        pfds.clear();
+        struct pollfd pfd;
+        pfd.fd = m_wakeFd[0];
+        pfd.events = POLLIN;
+        pfds.push_back(pfd);
+        pfd.fd = m_listenFd;
+        pfds.push_back(pfd);
+        for (auto it = clients.begin(); it != clients.end(); it++)
+        {
+            pfd.fd = it->fd;
+            pfd.events = POLLIN | (it->Pending() ? POLLOUT : 0);
+            pfds.push_back(pfd);
+        }
+
+        if (poll(pfds.data(), pfds.size(), CFRAMESERVER_POLL_INTERVAL) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            CFRAMESERVER_DBG_ERR("poll: %s", strerror(errno));
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN)
+        {
+            char buf[64];
+            while (read(m_wakeFd[0], buf, sizeof(buf)) > 0)
+                ;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_done)
+                break;
+        }
+
+        uint64_t now = GetTime();
+        if (pfds[1].revents & POLLIN)
+        {
+            while (true)
+            {
+                int fd = accept(m_listenFd, NULL, NULL);
+                if (fd < 0)
+                    break;
+                if ((m_maxClients > 0 && (int)clients.size() >= m_maxClients) || !set_nonblocking(fd))
+                {
+                    close(fd);
+                    continue;
+                }
+#ifdef SO_NOSIGPIPE
+                int one = 1;
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                if (m_sendBuffer > 0)
+                {
+                    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &m_sendBuffer, sizeof(m_sendBuffer));
+                }
+                clients.push_back(CFrameServerClient(fd, now));
+            }
+        }
+
+        size_t idx = 2;
+        for (auto it = clients.begin(); it != clients.end(); idx++)
+        {
+            CFrameServerClient &client = *it;
+            bool alive = true;
+            short revents = idx < pfds.size() && pfds[idx].fd == client.fd ? pfds[idx].revents : 0;
+
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                char buf[512];
+                ssize_t ret;
+                while ((ret = recv(client.fd, buf, sizeof(buf), 0)) > 0)
+                    client.request.append(buf, ret);
+                if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    alive = false;
+            }
+
+            // send the pending response, and let the handler queue the next one until the socket is full
+            while (alive)
+            {
+                if (client.Pending())
+                {
+                    alive = client.Send();
+                    if (!alive || client.Pending())
+                        break;
+                }
+                if (client.closing)
+                {
+                    alive = false;
+                    break;
+                }
+                alive = m_handler(client, now);
+                if (alive && !client.Pending())
+                {
+                    alive = !client.closing;
+                    break;
+                }
+            }
+
+            if (!alive)
+            {
+                close(client.fd);
+                it = clients.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_clients = clients.size();
+    }
+
+    for (auto it = clients.begin(); it != clients.end(); it++)
+        close(it->fd);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clients = 0;
+}
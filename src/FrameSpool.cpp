@@ -0,0 +1,505 @@
+/**
+ * @file FrameSpool.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Crash-safe memory-mapped raw frame spool implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "FrameSpool.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <stdexcept>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CFRAMESPOOL_DBG_LVL >= 3)
+#define CFRAMESPOOL_DBG_INFO(fmt, ...)                                                                       \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CFRAMESPOOL_DBG_INFO(fmt, ...)
+#endif
+
+#if (CFRAMESPOOL_DBG_LVL >= 2)
+#define CFRAMESPOOL_DBG_WARN(fmt, ...)                                                                         \
+    {                                                                                                          \
+        fprintf(stderr, "%s:%d:%s(): " YELLOW_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                        \
+    }
+#else
+#define CFRAMESPOOL_DBG_WARN(fmt, ...)
+#endif
+
+#if (CFRAMESPOOL_DBG_LVL >= 1)
+#define CFRAMESPOOL_DBG_ERR(fmt, ...)                                                                       \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CFRAMESPOOL_DBG_ERR(fmt, ...)
+#endif
+
+static_assert(sizeof(CFrameSpoolSlot) == 168, "Spool slot header must be 168 bytes");
+
+// Spool file header, at the start of the file
+typedef struct
+{
+    char magic[8];
+    uint32_t nSlots;
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+    uint32_t reserved;
+    uint64_t slotSize;
+} spool_file_header;
+
+static const char fileMagic[8] = {'C', 'F', 'S', 'P', 'O', 'O', 'L', '1'};
+static const char slotMagic[8] = {'C', 'F', 'S', 'S', 'L', 'O', 'T', '1'};
+static const size_t pageSize = 4096;     // file header and slot header size, slots are 4 KiB aligned whatever the system page size
+static const int maxConvertAttempts = 3; // sink attempts before a frame is given up
+
+// msync() a range of the spool, extended to the system pages it touches: on 16 or 64 KiB page
+// kernels the 4 KiB aligned slots do not start on a page boundary
+static bool sync_range(const void *addr, size_t len)
+{
+    static const uintptr_t sysPageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(sysPageSize - 1);
+    if (msync((void *)start, (uintptr_t)addr + len - start, MS_SYNC) < 0)
+    {
+        CFRAMESPOOL_DBG_ERR("msync: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+enum
+{
+    SLOT_EMPTY = 0,
+    SLOT_WRITING = 1,
+    SLOT_PENDING = 2,
+    SLOT_DONE = 3,
+};
+
+// Fletcher-64 over little-endian 32-bit words, chained through sum
+static uint64_t spool_checksum(const void *data, size_t len, uint64_t sum)
+{
+    const uint64_t mod = 0xffffffffULL;
+    uint64_t a = sum & mod, b = sum >> 32;
+    const unsigned char *ptr = (const unsigned char *)data;
+    while (len > 0)
+    {
+        size_t nwords = len / 4;
+        nwords = nwords > 65536 ? 65536 : nwords; // no overflow of b within a block
+        for (size_t i = 0; i < nwords; i++)
+        {
+            uint32_t word;
+            memcpy(&word, ptr + 4 * i, 4);
+            a += word;
+            b += a;
+        }
+        ptr += 4 * nwords;
+        len -= 4 * nwords;
+        if (nwords == 0) // tail, zero padded
+        {
+            uint32_t word = 0;
+            memcpy(&word, ptr, len);
+            a += word;
+            b += a;
+            len = 0;
+        }
+        a %= mod;
+        b %= mod;
+    }
+    return (b << 32) | a;
+}
+
+static uint64_t slot_checksum(const CFrameSpoolSlot *slot)
+{
+    CFrameSpoolSlot header = *slot;
+    header.state = 0;
+    header.checksum = 0;
+    uint64_t sum = spool_checksum(&header, sizeof(header), 0);
+    sum = spool_checksum((const unsigned char *)slot + sizeof(CFrameSpoolSlot), header.extendedLength, sum);
+    return spool_checksum((const unsigned char *)slot + pageSize, (size_t)header.width * header.height * sizeof(unsigned short), sum);
+}
+
+CFrameSpool::CFrameSpool(const std::string &fileName, int nSlots, int maxWidth, int maxHeight, const std::function<bool(CImageData &)> &sink, bool syncOnWrite)
+    : m_fileName(fileName), m_sink(sink), m_syncOnWrite(syncOnWrite), m_fd(-1), m_map(nullptr), m_mapSize(0), m_nextSeq(1), m_convertSeq(1), m_recovered(0), m_done(false)
+{
+    if (nSlots < 1 || maxWidth < 1 || maxHeight < 1)
+    {
+        throw std::invalid_argument("Spool size and image size must be positive");
+    }
+    uint32_t wantSlots = nSlots, wantWidth = maxWidth, wantHeight = maxHeight;
+    m_nSlots = wantSlots;
+    m_maxWidth = wantWidth;
+    m_maxHeight = wantHeight;
+
+    if (Map(false))
+    {
+        m_recovered = Recover();
+        if (m_nSlots != wantSlots || m_maxWidth != wantWidth || m_maxHeight != wantHeight)
+        {
+            // convert what is left with the old layout, then start over with the new one
+            CFRAMESPOOL_DBG_WARN("%s: Spool geometry changed, converting %d recovered frames first", m_fileName.c_str(), m_recovered);
+            m_done = true;
+            ConverterThread();
+            m_done = false;
+            Unmap();
+            m_nSlots = wantSlots;
+            m_maxWidth = wantWidth;
+            m_maxHeight = wantHeight;
+            m_nextSeq = m_convertSeq = 1;
+            if (!Map(true))
+            {
+                throw std::runtime_error("Could not create spool " + m_fileName);
+            }
+        }
+    }
+    else if (!Map(true))
+    {
+        throw std::runtime_error("Could not create spool " + m_fileName);
+    }
+    m_thread = std::thread(&CFrameSpool::ConverterThread, this);
+}
+
+CFrameSpool::~CFrameSpool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    Unmap();
+}
+
+bool CFrameSpool::Map(bool create)
+{
+    spool_file_header header;
+    if (create)
+    {
+        m_slotSize = (pageSize + (uint64_t)m_maxWidth * m_maxHeight * sizeof(unsigned short) + pageSize - 1) / pageSize * pageSize;
+        m_mapSize = pageSize + m_slotSize * m_nSlots;
+        m_fd = open(m_fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (m_fd < 0)
+        {
+            CFRAMESPOOL_DBG_ERR("Could not create %s: %s", m_fileName.c_str(), strerror(errno));
+            return false;
+        }
+        // allocate all blocks up front: writing into a hole of a full disk through a mapping raises SIGBUS
+        int err = posix_fallocate(m_fd, 0, m_mapSize);
+        if (err != 0)
+        {
+            CFRAMESPOOL_DBG_ERR("Could not allocate %zu bytes for %s: %s", m_mapSize, m_fileName.c_str(), strerror(err));
+            close(m_fd);
+            m_fd = -1;
+            unlink(m_fileName.c_str());
+            return false;
+        }
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.nSlots = m_nSlots;
+        header.maxWidth = m_maxWidth;
+        header.maxHeight = m_maxHeight;
+        header.slotSize = m_slotSize;
+        if (pwrite(m_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        {
+            CFRAMESPOOL_DBG_ERR("Could not write header of %s", m_fileName.c_str());
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+    }
+    else
+    {
+        m_fd = open(m_fileName.c_str(), O_RDWR);
+        if (m_fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        bool valid = fstat(m_fd, &st) == 0 && pread(m_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0;
+        valid = valid && header.nSlots > 0 && header.slotSize >= pageSize + (uint64_t)header.maxWidth * header.maxHeight * sizeof(unsigned short);
+        valid = valid && (uint64_t)st.st_size == pageSize + header.slotSize * header.nSlots;
+        if (!valid)
+        {
+            CFRAMESPOOL_DBG_WARN("%s is not a valid spool, replacing it", m_fileName.c_str());
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        m_nSlots = header.nSlots;
+        m_maxWidth = header.maxWidth;
+        m_maxHeight = header.maxHeight;
+        m_slotSize = header.slotSize;
+        m_mapSize = st.st_size;
+    }
+    void *map = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        CFRAMESPOOL_DBG_ERR("Could not map %s: %s", m_fileName.c_str(), strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_map = (unsigned char *)map;
+    return true;
+}
+
+void CFrameSpool::Unmap()
+{
+    if (m_map != nullptr)
+    {
+        sync_range(m_map, m_mapSize);
+        munmap(m_map, m_mapSize);
+        m_map = nullptr;
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+CFrameSpoolSlot *CFrameSpool::Slot(uint64_t sequence) const
+{
+    return (CFrameSpoolSlot *)(m_map + pageSize + (sequence % m_nSlots) * m_slotSize);
+}
+
+int CFrameSpool::Recover()
+{
+    uint64_t maxSeq = 0, minPending = UINT64_MAX;
+    int pending = 0, lost = 0;
+    for (uint32_t i = 0; i < m_nSlots; i++)
+    {
+        CFrameSpoolSlot *slot = (CFrameSpoolSlot *)(m_map + pageSize + i * m_slotSize);
+        if (memcmp(slot->magic, slotMagic, sizeof(slotMagic)) != 0)
+        {
+            continue;
+        }
+        maxSeq = slot->sequence > maxSeq ? slot->sequence : maxSeq;
+        if (slot->state == SLOT_PENDING)
+        {
+            bool valid = slot->sequence % m_nSlots == i && slot->width <= m_maxWidth && slot->height <= m_maxHeight && slot->extendedLength <= pageSize - sizeof(CFrameSpoolSlot);
+            if (valid && slot_checksum(slot) == slot->checksum)
+            {
+                minPending = slot->sequence < minPending ? slot->sequence : minPending;
+                pending++;
+                continue;
+            }
+        }
+        if (slot->state == SLOT_PENDING || slot->state == SLOT_WRITING) // interrupted while copying, or corrupt
+        {
+            lost++;
+            slot->state = SLOT_EMPTY;
+        }
+    }
+    m_nextSeq = maxSeq + 1;
+    m_convertSeq = pending > 0 ? minPending : m_nextSeq;
+    if (pending > 0 || lost > 0)
+    {
+        CFRAMESPOOL_DBG_WARN("%s: Recovered %d frames, %d incomplete frames lost", m_fileName.c_str(), pending, lost);
+    }
+    return pending;
+}
+
+bool CFrameSpool::Push(const CImageData &img)
+{
+    if (!img.HasData())
+    {
+        return false;
+    }
+    uint32_t width = img.GetImageWidth(), height = img.GetImageHeight();
+    if (width > m_maxWidth || height > m_maxHeight)
+    {
+        CFRAMESPOOL_DBG_ERR("Image %u x %u does not fit the spool (%u x %u)", width, height, m_maxWidth, m_maxHeight);
+        return false;
+    }
+    CImageMetadata metadata = img.GetImageMetadata();
+    std::string extended;
+    for (auto iter = metadata.extendedMetadata.begin(); iter != metadata.extendedMetadata.end(); iter++)
+    {
+        size_t len = iter->first.length() + iter->second.length() + 2;
+        if (sizeof(CFrameSpoolSlot) + extended.length() + len > pageSize)
+        {
+            CFRAMESPOOL_DBG_WARN("Extended metadata truncated at %s", iter->first.c_str());
+            break;
+        }
+        extended += iter->first;
+        extended.push_back('\0');
+        extended += iter->second;
+        extended.push_back('\0');
+    }
+
+    CFrameSpoolSlot header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, slotMagic, sizeof(slotMagic));
+    header.state = SLOT_WRITING;
+    header.width = width;
+    header.height = height;
+    header.extendedLength = extended.length();
+    header.timestamp = metadata.timestamp;
+    header.exposureTime = metadata.exposureTime;
+    header.temperature = metadata.temperature;
+    header.binX = metadata.binX;
+    header.binY = metadata.binY;
+    header.imgLeft = metadata.imgLeft;
+    header.imgTop = metadata.imgTop;
+    header.minGain = metadata.minGain;
+    header.maxGain = metadata.maxGain;
+    header.gain = metadata.gain;
+    header.offset = metadata.offset;
+    strncpy(header.cameraName, metadata.cameraName.c_str(), sizeof(header.cameraName) - 1);
+
+    CFrameSpoolSlot *slot;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_nextSeq - m_convertSeq >= m_nSlots)
+        {
+            return false; // full, the converter is behind
+        }
+        header.sequence = m_nextSeq++;
+        slot = Slot(header.sequence);
+        *slot = header;
+    }
+    memcpy((unsigned char *)slot + sizeof(CFrameSpoolSlot), extended.data(), extended.length());
+    memcpy((unsigned char *)slot + pageSize, img.GetImageData(), (size_t)width * height * sizeof(unsigned short));
+    slot->checksum = slot_checksum(slot);
+    if (m_syncOnWrite)
+    {
+        sync_range(slot, pageSize + (size_t)width * height * sizeof(unsigned short));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        slot->state = SLOT_PENDING;
+        if (m_syncOnWrite)
+        {
+            sync_range(slot, pageSize);
+        }
+    }
+    m_cond.notify_all();
+    return true;
+}
+
+int CFrameSpool::GetPending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nextSeq - m_convertSeq;
+}
+
+bool CFrameSpool::ReadSlot(const CFrameSpoolSlot *slot, CImageData &img) const
+{
+    CImageMetadata metadata = CImageMetadata();
+    metadata.timestamp = slot->timestamp;
+    metadata.exposureTime = slot->exposureTime;
+    metadata.temperature = slot->temperature;
+    metadata.binX = slot->binX;
+    metadata.binY = slot->binY;
+    metadata.imgLeft = slot->imgLeft;
+    metadata.imgTop = slot->imgTop;
+    metadata.minGain = slot->minGain;
+    metadata.maxGain = slot->maxGain;
+    metadata.gain = slot->gain;
+    metadata.offset = slot->offset;
+    metadata.cameraName = std::string(slot->cameraName, strnlen(slot->cameraName, sizeof(slot->cameraName)));
+    const char *ext = (const char *)slot + sizeof(CFrameSpoolSlot);
+    const char *end = ext + slot->extendedLength;
+    while (ext < end)
+    {
+        std::string key(ext, strnlen(ext, end - ext));
+        ext += key.length() + 1;
+        if (ext >= end)
+        {
+            break;
+        }
+        std::string value(ext, strnlen(ext, end - ext));
+        ext += value.length() + 1;
+        metadata.extendedMetadata[key] = value;
+    }
+    img = CImageData(slot->width, slot->height, (unsigned short *)((const unsigned char *)slot + pageSize), metadata);
+    return img.HasData();
+}
+
+void CFrameSpool::ConverterThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        if (m_convertSeq == m_nextSeq)
+        {
+            if (m_done)
+            {
+                break;
+            }
+            m_cond.wait(lock);
+            continue;
+        }
+        CFrameSpoolSlot *slot = Slot(m_convertSeq);
+        if (slot->sequence != m_convertSeq || (slot->state != SLOT_WRITING && slot->state != SLOT_PENDING)) // lost in a crash
+        {
+            m_convertSeq++;
+            continue;
+        }
+        if (slot->state == SLOT_WRITING) // still being copied in
+        {
+            m_cond.wait(lock);
+            continue;
+        }
+        lock.unlock();
+
+        CImageData img;
+        bool stored = false;
+        if (ReadSlot(slot, img))
+        {
+            for (int attempt = 0; attempt < maxConvertAttempts && !stored; attempt++)
+            {
+                if (attempt > 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                }
+                try
+                {
+                    stored = m_sink(img);
+                }
+                catch (const std::exception &e)
+                {
+                    CFRAMESPOOL_DBG_ERR("Frame %" PRIu64 ": %s", slot->sequence, e.what());
+                }
+            }
+        }
+        if (!stored)
+        {
+            CFRAMESPOOL_DBG_ERR("Could not store frame %" PRIu64 " (timestamp %" PRIu64 "), dropping it", slot->sequence, slot->timestamp);
+        }
+
+        lock.lock();
+        slot->state = SLOT_DONE;
+        if (m_syncOnWrite)
+        {
+            sync_range(slot, pageSize);
+        }
+        m_convertSeq++;
+    }
+}
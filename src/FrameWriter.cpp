@@ -0,0 +1,208 @@
+/**
+ * @file FrameWriter.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Frame writer with low disk space degradation implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "FrameWriter.hpp"
+#include "FileNameRegistry.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CFRAMEWRITER_DBG_LVL >= 2)
+#define CFRAMEWRITER_DBG_WARN(fmt, ...)                                                                        \
+    {                                                                                                          \
+        fprintf(stderr, "%s:%d:%s(): " YELLOW_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                        \
+    }
+#else
+#define CFRAMEWRITER_DBG_WARN(fmt, ...)
+#endif
+
+#if (CFRAMEWRITER_DBG_LVL >= 1)
+#define CFRAMEWRITER_DBG_ERR(fmt, ...)                                                                      \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CFRAMEWRITER_DBG_ERR(fmt, ...)
+#endif
+
+CFrameWriter::CFrameWriter(CStorageManager &storage, const std::string &filePrefix, uint64_t binnedBelow, uint64_t previewBelow, uint64_t metadataBelow, int binFactor, CImageArchive *archive, bool syncOnWrite)
+    : m_storage(storage), m_archive(archive), m_filePrefix(filePrefix), m_binFactor(binFactor < 2 ? 2 : binFactor), m_syncOnWrite(syncOnWrite), m_level(WRITE_FULL)
+{
+    m_thresholds[0] = binnedBelow;
+    m_thresholds[1] = previewBelow;
+    m_thresholds[2] = metadataBelow;
+    if (m_filePrefix.length() == 0)
+    {
+        m_filePrefix = "frame";
+    }
+}
+
+const char *CFrameWriter::LevelName(FrameWriteLevel level)
+{
+    switch (level)
+    {
+    case WRITE_FULL:
+        return "FULL";
+    case WRITE_BINNED:
+        return "BINNED";
+    case WRITE_PREVIEW:
+        return "PREVIEW";
+    case WRITE_METADATA:
+        return "METADATA";
+    }
+    return "UNKNOWN";
+}
+
+FrameWriteLevel CFrameWriter::GetLevel() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_level;
+}
+
+FrameWriteLevel CFrameWriter::LevelFor(uint64_t freeBytes, uint64_t margin) const
+{
+    int level = WRITE_FULL;
+    for (int i = 0; i < 3; i++)
+    {
+        uint64_t threshold = m_thresholds[i] + m_thresholds[i] / 100 * margin;
+        if (m_thresholds[i] > 0 && freeBytes < threshold)
+        {
+            level = i + 1;
+        }
+    }
+    return (FrameWriteLevel)level;
+}
+
+bool CFrameWriter::Write(CImageData &img)
+{
+    if (!img.HasData())
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string dirName = m_storage.GetDirectory();
+
+    // step down as soon as a threshold is crossed, step up only with 10% margin
+    uint64_t freeBytes = m_storage.GetFreeSpace();
+    FrameWriteLevel level = LevelFor(freeBytes, 0);
+    if (level < m_level)
+    {
+        FrameWriteLevel up = LevelFor(freeBytes, 10);
+        level = up < m_level ? up : m_level;
+    }
+
+    bool ret = false;
+    for (int lvl = level; lvl <= WRITE_METADATA; lvl++)
+    {
+        img.SetExtendedMetadata("SAVELVL", LevelName((FrameWriteLevel)lvl));
+        if (WriteLevel(img, dirName, (FrameWriteLevel)lvl))
+        {
+            level = (FrameWriteLevel)lvl;
+            ret = true;
+            break;
+        }
+        CFRAMEWRITER_DBG_ERR("Could not write frame %" PRIu64 " at level %s, free space %.1f MiB", img.GetTimestamp(), LevelName((FrameWriteLevel)lvl), freeBytes / 1048576.0);
+    }
+    if (ret && level != m_level)
+    {
+        CFRAMEWRITER_DBG_WARN("Output level %s -> %s, free space %.1f MiB", LevelName(m_level), LevelName(level), freeBytes / 1048576.0);
+        m_level = level;
+    }
+    m_storage.Update();
+    return ret;
+}
+
+bool CFrameWriter::WriteLevel(CImageData &img, const std::string &dirName, FrameWriteLevel level)
+{
+    switch (level)
+    {
+    case WRITE_FULL:
+        if (m_archive != nullptr)
+        {
+            m_archive->SetDirectory(dirName);
+            return m_archive->Append(img);
+        }
+        return img.SaveFITS(m_syncOnWrite, dirName.c_str(), m_filePrefix.c_str());
+    case WRITE_BINNED:
+    {
+        CImageData binned(img);
+        binned.ApplyBinning(m_binFactor, m_binFactor);
+        CImageMetadata metadata = binned.GetImageMetadata();
+        metadata.binX *= m_binFactor;
+        metadata.binY *= m_binFactor;
+        metadata.imgLeft /= m_binFactor;
+        metadata.imgTop /= m_binFactor;
+        binned.SetImageMetadata(metadata);
+        if (m_archive != nullptr)
+        {
+            m_archive->SetDirectory(dirName);
+            return m_archive->Append(binned);
+        }
+        return binned.SaveFITS(m_syncOnWrite, dirName.c_str(), m_filePrefix.c_str());
+    }
+    case WRITE_PREVIEW:
+    {
+        unsigned char *ptr = nullptr;
+        int sz = 0;
+        img.GetJPEGData(ptr, sz);
+        if (ptr == nullptr || sz <= 0)
+        {
+            return false;
+        }
+        std::string path;
+        std::string stem = m_filePrefix + "_" + std::to_string((unsigned long long)img.GetTimestamp());
+        return CFileNameRegistry::Instance().WriteUnique(dirName, stem, ".jpg", ptr, sz, path, m_syncOnWrite);
+    }
+    case WRITE_METADATA:
+        return WriteMetadata(img, dirName);
+    }
+    return false;
+}
+
+bool CFrameWriter::WriteMetadata(const CImageData &img, const std::string &dirName)
+{
+    CImageMetadata metadata = img.GetImageMetadata();
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "TIMESTAMP=%" PRIu64 "\tCAMERA=%s\tEXPOSURE_US=%.0f\tGAIN=%" PRId64 "\tOFFSET=%" PRId64 "\tCCDTEMP=%.2f\tBINX=%d\tBINY=%d\tORIGIN_X=%d\tORIGIN_Y=%d\tWIDTH=%d\tHEIGHT=%d",
+                       metadata.timestamp, metadata.cameraName.c_str(), metadata.exposureTime * 1e6, metadata.gain, metadata.offset, metadata.temperature,
+                       metadata.binX, metadata.binY, metadata.imgLeft, metadata.imgTop, img.GetImageWidth(), img.GetImageHeight());
+    std::string line(buf, len < (int)sizeof(buf) ? len : sizeof(buf) - 1);
+    for (auto iter = metadata.extendedMetadata.begin(); iter != metadata.extendedMetadata.end(); iter++)
+    {
+        line += "\t" + iter->first + "=" + iter->second;
+    }
+    line += "\n";
+
+    std::string path = dirName + "/" + m_filePrefix + "_metadata.log";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    // one write per line, so lines from an interrupted write do not interleave
+    bool ret = write(fd, line.c_str(), line.length()) == (ssize_t)line.length();
+    if (ret && m_syncOnWrite)
+    {
+        fsync(fd);
+    }
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file ImageArchive.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Rolling multi-extension FITS archive implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "ImageArchive.hpp"
+#include "FileNameRegistry.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <fitsio.h>
+
+#include <chrono>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CIMAGEARCHIVE_DBG_LVL >= 3)
+#define CIMAGEARCHIVE_DBG_INFO(fmt, ...)                                                                     \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CIMAGEARCHIVE_DBG_INFO(fmt, ...)
+#endif
+
+#if (CIMAGEARCHIVE_DBG_LVL >= 1)
+#define CIMAGEARCHIVE_DBG_ERR(fmt, ...)                                                                     \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CIMAGEARCHIVE_DBG_ERR(fmt, ...)
+#endif
+
+static_assert(sizeof(CImageArchiveIndexEntry) == 64, "Index record must be 64 bytes");
+
+static const char indexMagic[8] = {'C', 'I', 'A', 'I', 'D', 'X', '0', '1'};
+static const off_t indexHeaderSize = 16;
+
+static inline uint64_t getTime()
+{
+    return ((std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now())).time_since_epoch())).count());
+}
+
+// fsync a file by name, e.g. the container that cfitsio writes through its own FILE *
+static bool sync_file(const std::string &name)
+{
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ret = fsync(fd) == 0;
+    close(fd);
+    return ret;
+}
+
+CImageArchive::CImageArchive(const std::string &dirName, const std::string &filePrefix, int maxFrames, int maxMinutes, bool syncOnWrite)
+    : m_dirName(dirName), m_filePrefix(filePrefix), m_maxFrames(maxFrames < 1 ? 1 : maxFrames), m_maxMinutes(maxMinutes < 0 ? 0 : maxMinutes), m_syncOnWrite(syncOnWrite), m_fptr(nullptr), m_indexFd(-1), m_fileName(""), m_frameCount(0), m_openTime(0)
+{
+    if (m_filePrefix.length() == 0)
+    {
+        m_filePrefix = "archive";
+    }
+}
+
+CImageArchive::~CImageArchive()
+{
+    Close();
+}
+
+bool CImageArchive::OpenContainer(uint64_t timestamp)
+{
+    std::string stem = m_filePrefix + "_" + std::to_string((unsigned long long)timestamp);
+    std::string name;
+    int reserved = CFileNameRegistry::Instance().CreateUnique(m_dirName, stem, ".fits", name);
+    if (reserved < 0)
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not create container %s/%s.fits: %s", m_dirName.c_str(), stem.c_str(), strerror(errno));
+        return false;
+    }
+    close(reserved);
+
+    // the name is reserved, let cfitsio replace the empty file
+    fitsfile *fptr = nullptr;
+    int status = 0;
+    if (fits_create_file(&fptr, ("!" + name + "[compress]").c_str(), &status))
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not create container %s, status %d", name.c_str(), status);
+        unlink(name.c_str());
+        return false;
+    }
+
+    int fd = open((name + ".idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not create index for %s: %s", name.c_str(), strerror(errno));
+        fits_delete_file(fptr, &status);
+        return false;
+    }
+    char header[indexHeaderSize];
+    memset(header, 0, sizeof(header));
+    memcpy(header, indexMagic, sizeof(indexMagic));
+    uint32_t entrySize = sizeof(CImageArchiveIndexEntry);
+    memcpy(header + sizeof(indexMagic), &entrySize, sizeof(entrySize));
+    if (write(fd, header, sizeof(header)) != (ssize_t)sizeof(header))
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not write index header for %s", name.c_str());
+        close(fd);
+        unlink((name + ".idx").c_str());
+        fits_delete_file(fptr, &status);
+        return false;
+    }
+
+    m_fptr = fptr;
+    m_indexFd = fd;
+    m_fileName = name;
+    m_frameCount = 0;
+    m_openTime = getTime();
+    CIMAGEARCHIVE_DBG_INFO("Opened container %s", name.c_str());
+    return true;
+}
+
+void CImageArchive::CloseUnlocked()
+{
+    if (m_fptr != nullptr)
+    {
+        int status = 0;
+        fits_close_file((fitsfile *)m_fptr, &status);
+        if (status)
+        {
+            CIMAGEARCHIVE_DBG_ERR("Error closing container %s, status %d", m_fileName.c_str(), status);
+        }
+        m_fptr = nullptr;
+        if (m_syncOnWrite && !sync_file(m_fileName))
+        {
+            CIMAGEARCHIVE_DBG_ERR("Could not sync container %s: %s", m_fileName.c_str(), strerror(errno));
+        }
+    }
+    if (m_indexFd >= 0)
+    {
+        if (m_syncOnWrite)
+        {
+            fsync(m_indexFd);
+        }
+        close(m_indexFd);
+        m_indexFd = -1;
+    }
+    m_fileName = "";
+    m_frameCount = 0;
+}
+
+void CImageArchive::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CloseUnlocked();
+}
+
+void CImageArchive::SetDirectory(const std::string &dirName)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (dirName == m_dirName)
+    {
+        return;
+    }
+    CloseUnlocked();
+    m_dirName = dirName;
+}
+
+std::string CImageArchive::GetCurrentFile() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_fileName;
+}
+
+int CImageArchive::GetFrameCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frameCount;
+}
+
+bool CImageArchive::Append(const CImageData &img)
+{
+    if (!img.HasData())
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // roll over
+    if (m_fptr != nullptr)
+    {
+        bool roll = m_frameCount >= m_maxFrames;
+        if (m_maxMinutes > 0 && (getTime() - m_openTime) >= (uint64_t)m_maxMinutes * 60000LLU)
+        {
+            roll = true;
+        }
+        if (roll)
+        {
+            CloseUnlocked();
+        }
+    }
+    if (m_fptr == nullptr && !OpenContainer(img.GetTimestamp()))
+    {
+        return false;
+    }
+
+    fitsfile *fptr = (fitsfile *)m_fptr;
+    char extName[32];
+    snprintf(extName, sizeof(extName), "FRAME_%d", m_frameCount);
+    int status = img.WriteFITSHDU(fptr, extName);
+    // flush so that every completed frame is valid on disk and the HDU addresses are final
+    fits_flush_file(fptr, &status);
+    if (status)
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not append frame %d to %s, status %d", m_frameCount, m_fileName.c_str(), status);
+        CloseUnlocked();
+        return false;
+    }
+    // the frame data must be on disk before the index entry that points at it
+    if (m_syncOnWrite && !sync_file(m_fileName))
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not sync frame %d of %s: %s", m_frameCount, m_fileName.c_str(), strerror(errno));
+        CloseUnlocked();
+        return false;
+    }
+
+    CImageArchiveIndexEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    int hdu = 0;
+    LONGLONG headStart = 0, dataStart = 0, dataEnd = 0;
+    fits_get_hdu_num(fptr, &hdu);
+    fits_get_hduaddrll(fptr, &headStart, &dataStart, &dataEnd, &status);
+    entry.frame = m_frameCount;
+    entry.hdu = hdu;
+    entry.timestamp = img.GetTimestamp();
+    entry.headerOffset = headStart;
+    entry.dataOffset = dataStart;
+    entry.dataEnd = dataEnd;
+    entry.width = img.GetImageWidth();
+    entry.height = img.GetImageHeight();
+    entry.exposure = img.GetExposure();
+    if (pwrite(m_indexFd, &entry, sizeof(entry), indexHeaderSize + (off_t)m_frameCount * sizeof(entry)) != (ssize_t)sizeof(entry))
+    {
+        // a hole in the index, start a new container instead
+        CIMAGEARCHIVE_DBG_ERR("Could not write index entry %d for %s: %s", m_frameCount, m_fileName.c_str(), strerror(errno));
+        CloseUnlocked();
+        return false;
+    }
+    if (m_syncOnWrite && fsync(m_indexFd) < 0)
+    {
+        CIMAGEARCHIVE_DBG_ERR("Could not sync index entry %d for %s: %s", m_frameCount, m_fileName.c_str(), strerror(errno));
+        CloseUnlocked();
+        return false;
+    }
+    m_frameCount++;
+    return true;
+}
+
+bool CImageArchive::ReadIndex(const std::string &containerName, int frame, CImageArchiveIndexEntry &entry)
+{
+    if (frame < 0)
+    {
+        return false;
+    }
+    int fd = open((containerName + ".idx").c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    char header[indexHeaderSize];
+    bool ret = false;
+    uint32_t entrySize = 0;
+    if (pread(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) && memcmp(header, indexMagic, sizeof(indexMagic)) == 0)
+    {
+        memcpy(&entrySize, header + sizeof(indexMagic), sizeof(entrySize));
+    }
+    if (entrySize == sizeof(entry))
+    {
+        ret = pread(fd, &entry, sizeof(entry), indexHeaderSize + (off_t)frame * sizeof(entry)) == (ssize_t)sizeof(entry);
+    }
+    close(fd);
+    return ret;
+}
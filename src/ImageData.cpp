@@ -30,6 +30,7 @@ static inline void sync()
 #include <algorithm>
 #include <chrono>
 #include <mutex>
+#include <thread>
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
@@ -47,6 +48,31 @@ static inline void sync()
 #endif
 #define CIMAGE_PROGNAME_STRING TOSTRING(CIMAGE_PROGNAME)
 
+#if !defined(CIMAGEDATA_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+#define CIMAGEDATA_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CIMAGEDATA_NEON
+#include <arm_neon.h>
+#endif
+#endif // CIMAGEDATA_NO_SIMD
+
+#ifndef CIMAGEDATA_HIST_MT_PIXELS
+// Histograms (and so the analysis) of images with at least this many pixels are built in parallel blocks when more than one CPU is available
+#define CIMAGEDATA_HIST_MT_PIXELS (1 << 22)
+#endif
+
+#ifndef CIMAGEDATA_ADD_MT_PIXELS
+// Images with at least this many pixels are added in parallel blocks when more than one CPU is available
+#define CIMAGEDATA_ADD_MT_PIXELS (1 << 22)
+#endif
+
+#ifndef CIMAGEDATA_JPEG_MT_PIXELS
+// Images with at least this many pixels are JPEG encoded in parallel strips when more than one CPU is available
+#define CIMAGEDATA_JPEG_MT_PIXELS (1 << 20)
+#endif
+
 #if !defined(OS_Windows)
 #define YELLOW_FG "\033[33m"
 #define RED_FG "\033[31m"
@@ -196,21 +222,19 @@ void CImageData::ClearImage()
     m_metadata.imgLeft = 0;
     m_metadata.imgTop = 0;
 
-    if (m_jpegData != nullptr)
-    {
-        delete[] m_jpegData;
-        m_jpegData = nullptr;
-    }
+    m_jpegData.clear();
+    jpegDirty = true;
+    m_analysis.reset();
 }
 
 CImageData::CImageData()
-    : m_imageHeight(0), m_imageWidth(0), m_imageData(NULL), m_jpegData(nullptr), sz_jpegData(-1), convert_jpeg(false), JpegQuality(100), pixelMin(-1), pixelMax(-1)
+    : m_imageHeight(0), m_imageWidth(0), m_imageData(NULL), sz_jpegData(-1), jpegDirty(true), JpegQuality(100), pixelMin(-1), pixelMax(-1), autoscale(true), jpegOverlay(false), jpegStretch(STRETCH_LINEAR), jpegStretchParam(0), blackPercentile(0), whitePercentile(100)
 {
     ClearImage();
 }
 
-CImageData::CImageData(int imageWidth, int imageHeight, unsigned short *imageData, CImageMetadata metadata, bool is8bit, bool enableJpeg, int JpegQuality, int pixelMin, int pixelMax, bool autoscale)
-    : m_imageData(NULL), m_jpegData(nullptr), sz_jpegData(-1), convert_jpeg(false)
+CImageData::CImageData(int imageWidth, int imageHeight, unsigned short *imageData, CImageMetadata metadata, bool is8bit, bool /* enableJpeg */, int JpegQuality, int pixelMin, int pixelMax, bool autoscale)
+    : m_imageData(NULL), sz_jpegData(-1), jpegDirty(true), jpegOverlay(false), jpegStretch(STRETCH_LINEAR), jpegStretchParam(0), blackPercentile(0), whitePercentile(100)
 {
     ClearImage();
     std::lock_guard<std::mutex> lock(m_mutex);
@@ -255,12 +279,7 @@ CImageData::CImageData(int imageWidth, int imageHeight, unsigned short *imageDat
     this->pixelMin = pixelMin;
     this->pixelMax = pixelMax;
     this->autoscale = autoscale;
-
-    if (enableJpeg)
-    {
-        convert_jpeg = true;
-        ConvertJPEG();
-    }
+    jpegDirty = true;
 }
 
 void CImageData::SetImageMetadata(float exposureTime, int imageLeft, int imageTop, int binX, int binY, float temperature, uint64_t timestamp, std::string cameraName)
@@ -287,7 +306,7 @@ void CImageData::SetImageMetadata(CImageMetadata metadata)
 }
 
 CImageData::CImageData(const CImageData &rhs)
-    : m_imageData(NULL), m_jpegData(nullptr), sz_jpegData(-1), convert_jpeg(false)
+    : m_imageData(NULL), sz_jpegData(-1), jpegDirty(true), jpegOverlay(false), jpegStretch(STRETCH_LINEAR), jpegStretchParam(0), blackPercentile(0), whitePercentile(100)
 {
     ClearImage();
     std::unique_lock<std::mutex> lock1(m_mutex, std::defer_lock);
@@ -310,13 +329,19 @@ CImageData::CImageData(const CImageData &rhs)
     m_imageHeight = rhs.m_imageHeight;
     m_metadata = rhs.m_metadata;
 
-    m_jpegData = nullptr;
+    m_jpegData.clear();
     sz_jpegData = -1;
-    convert_jpeg = false;
+    jpegDirty = true;
     JpegQuality = rhs.JpegQuality;
     pixelMin = rhs.pixelMin;
     pixelMax = rhs.pixelMax;
     autoscale = rhs.autoscale;
+    jpegOverlay = rhs.jpegOverlay;
+    jpegStretch = rhs.jpegStretch;
+    jpegStretchParam = rhs.jpegStretchParam;
+    blackPercentile = rhs.blackPercentile;
+    whitePercentile = rhs.whitePercentile;
+    m_analysis = rhs.m_analysis; // same pixels
 
     m_metadata = rhs.m_metadata;
 }
@@ -351,13 +376,19 @@ CImageData &CImageData::operator=(const CImageData &rhs)
     m_imageHeight = rhs.m_imageHeight;
     m_metadata = rhs.m_metadata;
 
-    m_jpegData = nullptr;
+    m_jpegData.clear();
     sz_jpegData = -1;
-    convert_jpeg = false;
+    jpegDirty = true;
     JpegQuality = rhs.JpegQuality;
     pixelMin = rhs.pixelMin;
     pixelMax = rhs.pixelMax;
     autoscale = rhs.autoscale;
+    jpegOverlay = rhs.jpegOverlay;
+    jpegStretch = rhs.jpegStretch;
+    jpegStretchParam = rhs.jpegStretchParam;
+    blackPercentile = rhs.blackPercentile;
+    whitePercentile = rhs.whitePercentile;
+    m_analysis = rhs.m_analysis; // same pixels
     return *this;
 }
 
@@ -368,88 +399,61 @@ CImageData::~CImageData()
 
 ImageStats CImageData::GetStats() const
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     if (!m_imageData)
     {
         return ImageStats(0, 0, 0, 0);
     }
+    return GetAnalysisUnlocked()->GetStats();
+}
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    int min = 0xFFFF;
-    int max = 0;
-    double mean = 0.0;
-
-    // Calculate min max and mean
-
-    unsigned short *imageDataPtr = m_imageData;
-    double rowDivisor = m_imageHeight * m_imageWidth;
-    unsigned long rowSum;
-    double rowAverage;
-    unsigned short currentPixelValue;
-
-    int rowIndex;
-    int columnIndex;
-
-    for (rowIndex = 0; rowIndex < m_imageHeight; rowIndex++)
+// dst = min(dst + src, 0xffff)
+static void AddSaturate(uint16_t *dst, const uint16_t *src, size_t count)
+{
+    size_t i = 0;
+#if defined(CIMAGEDATA_SSE2)
+    for (; i + 8 <= count; i += 8)
     {
-        rowSum = 0L;
-
-        for (columnIndex = 0; columnIndex < m_imageWidth; columnIndex++)
-        {
-            currentPixelValue = *imageDataPtr;
-
-            if (currentPixelValue < min)
-            {
-                min = currentPixelValue;
-            }
-
-            if (currentPixelValue > max)
-            {
-                max = currentPixelValue;
-            }
-
-            rowSum += currentPixelValue;
-
-            imageDataPtr++;
-        }
-
-        rowAverage = static_cast<double>(rowSum) / rowDivisor;
-
-        mean += rowAverage;
+        __m128i x = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epu16(x, y));
     }
-
-    // Calculate standard deviation
-
-    double varianceSum = 0.0;
-    imageDataPtr = m_imageData;
-
-    for (rowIndex = 0; rowIndex < m_imageHeight; rowIndex++)
+#elif defined(CIMAGEDATA_NEON)
+    for (; i + 8 <= count; i += 8)
     {
-        for (columnIndex = 0; columnIndex < m_imageWidth; columnIndex++)
-        {
-            double tempValue = (*imageDataPtr) - mean;
-            varianceSum += tempValue * tempValue;
-            imageDataPtr++;
-        }
+        vst1q_u16(dst + i, vqaddq_u16(vld1q_u16(dst + i), vld1q_u16(src + i)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        uint32_t sum = (uint32_t)dst[i] + src[i];
+        dst[i] = sum > 0xffff ? 0xffff : (uint16_t)sum;
     }
-
-    double stddev = sqrt(varianceSum / static_cast<double>((m_imageWidth * m_imageHeight) - 1));
-
-    return ImageStats(min, max, mean, stddev);
 }
 
 void CImageData::Add(const CImageData &rhs)
 {
-    unsigned short *sourcePixelPtr = rhs.m_imageData;
-    unsigned short *targetPixelPtr = m_imageData;
-    unsigned long newPixelValue;
+    std::unique_lock<std::mutex> lock1(m_mutex, std::defer_lock);
+    std::unique_lock<std::mutex> lock2;
+    if (&rhs == this)
+    {
+        lock1.lock(); // adding the image to itself
+    }
+    else
+    {
+        lock2 = std::unique_lock<std::mutex>(rhs.m_mutex, std::defer_lock);
+        std::lock(lock1, lock2);
+    }
 
-    if (!rhs.HasData())
+    if (rhs.m_imageData == NULL)
         return;
 
     // if we don't have data yet we simply copy the rhs data
-    if (!this->HasData())
+    if (m_imageData == NULL)
     {
+        lock1.unlock();
+        if (lock2)
+            lock2.unlock();
         *this = rhs;
         return;
     }
@@ -458,29 +462,32 @@ void CImageData::Add(const CImageData &rhs)
     if ((rhs.m_imageWidth != m_imageWidth) || (rhs.m_imageHeight != m_imageHeight))
         return;
 
-    for (int pixelIndex = 0;
-         pixelIndex < (m_imageWidth * m_imageHeight);
-         pixelIndex++)
+    size_t npix = (size_t)m_imageWidth * m_imageHeight;
+    unsigned int nThreads = 1;
+    if (npix >= CIMAGEDATA_ADD_MT_PIXELS)
     {
-        newPixelValue = *targetPixelPtr + *sourcePixelPtr;
-
-        if (newPixelValue > 0xFFFF)
-        {
-            *targetPixelPtr = 0xFFFF;
-        }
-        else
-        {
-            *targetPixelPtr = static_cast<unsigned short>(newPixelValue);
-        }
-
-        sourcePixelPtr++;
-        targetPixelPtr++;
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    auto worker = [&](unsigned int t)
+    {
+        size_t begin = npix * t / nThreads, end = npix * (t + 1) / nThreads;
+        AddSaturate(m_imageData + begin, rhs.m_imageData + begin, end - begin);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < nThreads; t++)
+    {
+        threads.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (auto &thr : threads)
+    {
+        thr.join();
     }
 
     m_metadata.exposureTime += rhs.m_metadata.exposureTime;
 
-    if (convert_jpeg)
-        ConvertJPEG();
+    jpegDirty = true;
+    m_analysis.reset();
 }
 
 void CImageData::ApplyBinning(int binX, int binY)
@@ -532,8 +539,8 @@ void CImageData::ApplyBinning(int binX, int binY)
     m_imageWidth = newImageWidth;
     m_imageHeight = newImageHeight;
 
-    if (convert_jpeg)
-        ConvertJPEG();
+    jpegDirty = true;
+    m_analysis.reset();
 }
 
 void CImageData::FlipHorizontal()
@@ -543,136 +550,624 @@ void CImageData::FlipHorizontal()
         std::reverse(m_imageData + row * m_imageWidth, m_imageData + (row + 1) * m_imageWidth);
     }
 
-    if (convert_jpeg)
-        ConvertJPEG();
+    jpegDirty = true;
 }
 
-#include <stdint.h>
+// Average 2x2 pixel blocks of two rows into one row of outWidth pixels, rounded to nearest
+static void DownsampleRow2x2(const uint16_t *row0, const uint16_t *row1, uint16_t *dst, int outWidth)
+{
+    int i = 0;
+#if defined(CIMAGEDATA_SSE2)
+    // madd only multiplies signed words: bias the pixels by -32768, add the 4 biased pixels of
+    // each block in 32 bits and remove the bias again after the rounding shift
+    const __m128i sign = _mm_set1_epi16((short)0x8000);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi32(4 * 0x8000 + 2);
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    for (; i + 8 <= outWidth; i += 8)
+    {
+        __m128i a0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row0 + 2 * i)), sign);
+        __m128i a1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row0 + 2 * i + 8)), sign);
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row1 + 2 * i)), sign);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row1 + 2 * i + 8)), sign);
+        __m128i s0 = _mm_add_epi32(_mm_madd_epi16(a0, ones), _mm_madd_epi16(b0, ones));
+        __m128i s1 = _mm_add_epi32(_mm_madd_epi16(a1, ones), _mm_madd_epi16(b1, ones));
+        s0 = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(s0, round), 2), bias);
+        s1 = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(s1, round), 2), bias);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_packs_epi32(s0, s1), sign));
+    }
+#elif defined(CIMAGEDATA_NEON)
+    for (; i + 8 <= outWidth; i += 8)
+    {
+        uint32x4_t s0 = vpadalq_u16(vpaddlq_u16(vld1q_u16(row0 + 2 * i)), vld1q_u16(row1 + 2 * i));
+        uint32x4_t s1 = vpadalq_u16(vpaddlq_u16(vld1q_u16(row0 + 2 * i + 8)), vld1q_u16(row1 + 2 * i + 8));
+        vst1q_u16(dst + i, vcombine_u16(vrshrn_n_u32(s0, 2), vrshrn_n_u32(s1, 2)));
+    }
+#endif
+    for (; i < outWidth; i++)
+    {
+        dst[i] = (uint16_t)(((uint32_t)row0[2 * i] + row0[2 * i + 1] + row1[2 * i] + row1[2 * i + 1] + 2) >> 2);
+    }
+}
 
-uint16_t CImageData::DataMin()
+int CImageData::BuildPyramid(std::vector<CImageData> &levels, int numLevels) const
 {
-    uint16_t res = 0xffff;
-    if (!HasData())
+    levels.clear();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_imageData == NULL)
+        return 0;
+    // levels smaller than a pixel are dropped
+    int nlevels = 0;
+    while (nlevels < numLevels && (m_imageWidth >> (nlevels + 1)) > 0 && (m_imageHeight >> (nlevels + 1)) > 0)
+        nlevels++;
+    if (nlevels == 0)
+        return 0;
+
+    levels.resize(nlevels);
+    for (int lvl = 0; lvl < nlevels; lvl++)
     {
-        return 0xffff;
+        CImageData &img = levels[lvl];
+        int factor = 2 << lvl;
+        img.m_imageWidth = m_imageWidth / factor;
+        img.m_imageHeight = m_imageHeight / factor;
+        img.m_imageData = new unsigned short[(size_t)img.m_imageWidth * img.m_imageHeight];
+        img.m_metadata = m_metadata;
+        img.m_metadata.binX *= factor;
+        img.m_metadata.binY *= factor;
+        img.m_metadata.imgLeft /= factor;
+        img.m_metadata.imgTop /= factor;
+        img.JpegQuality = JpegQuality;
+        img.pixelMin = pixelMin;
+        img.pixelMax = pixelMax;
+        img.autoscale = autoscale;
+        img.jpegOverlay = jpegOverlay;
+        img.jpegStretch = jpegStretch;
+        img.jpegStretchParam = jpegStretchParam;
+        img.blackPercentile = blackPercentile;
+        img.whitePercentile = whitePercentile;
     }
-    int idx = m_imageWidth * m_imageHeight;
-    while (idx--)
+
+    // Every pair of rows of a level is reduced into the next level as soon as it is complete,
+    // while it is still in the cache, so the full image is read exactly once.
+    for (int row = 0; row < levels[0].m_imageHeight; row++)
     {
-        if (res > m_imageData[idx])
+        const unsigned short *src = m_imageData + (size_t)2 * row * m_imageWidth;
+        DownsampleRow2x2(src, src + m_imageWidth, levels[0].m_imageData + (size_t)row * levels[0].m_imageWidth, levels[0].m_imageWidth);
+        int lrow = row;
+        for (int lvl = 1; lvl < nlevels && (lrow & 1) && (lrow >> 1) < levels[lvl].m_imageHeight; lvl++)
         {
-            res = m_imageData[idx];
+            const CImageData &prev = levels[lvl - 1];
+            CImageData &img = levels[lvl];
+            lrow >>= 1;
+            const unsigned short *psrc = prev.m_imageData + (size_t)2 * lrow * prev.m_imageWidth;
+            DownsampleRow2x2(psrc, psrc + prev.m_imageWidth, img.m_imageData + (size_t)lrow * img.m_imageWidth, img.m_imageWidth);
         }
     }
-    return res;
+    return nlevels;
 }
 
-uint16_t CImageData::DataMax()
+CImageHistogram::CImageHistogram(const uint16_t *data, size_t count, int bins, int nThreads)
+    : total_(count), shift_(0)
 {
-    uint16_t res = 0;
-    if (!HasData())
+    while (shift_ < 16 && (0x10000 >> shift_) > bins)
+        shift_++;
+    counts_.assign(0x10000 >> shift_, 0);
+    if (nThreads <= 0)
     {
-        return 0xffff;
+        nThreads = count >= CIMAGEDATA_HIST_MT_PIXELS ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+    }
+    // every thread fills a private histogram of its block, no contention on the bins
+    std::vector<std::vector<uint32_t>> partial(nThreads - 1);
+    auto worker = [&](int t)
+    {
+        uint32_t *hist = counts_.data();
+        if (t > 0)
+        {
+            partial[t - 1].assign(counts_.size(), 0);
+            hist = partial[t - 1].data();
+        }
+        size_t begin = count * t / nThreads, end = count * (t + 1) / nThreads;
+        int shift = shift_;
+        // alternate pixels go to a second histogram: runs of equal pixels (flat or saturated areas)
+        // would otherwise wait on the increment of the same bin
+        std::vector<uint32_t> odd(counts_.size(), 0);
+        size_t i = begin;
+        for (; i + 2 <= end; i += 2)
+        {
+            hist[data[i] >> shift]++;
+            odd[data[i + 1] >> shift]++;
+        }
+        for (; i < end; i++)
+        {
+            hist[data[i] >> shift]++;
+        }
+        for (size_t j = 0; j < odd.size(); j++)
+        {
+            hist[j] += odd[j];
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++)
+    {
+        threads.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (auto &thr : threads)
+    {
+        thr.join();
     }
-    int idx = m_imageWidth * m_imageHeight;
-    while (idx--)
+    for (auto &hist : partial)
     {
-        if (res < m_imageData[idx])
+        for (size_t i = 0; i < counts_.size(); i++)
         {
-            res = m_imageData[idx];
+            counts_[i] += hist[i];
         }
     }
+}
+
+CImageHistogram CImageHistogram::Rebin(int bins) const
+{
+    CImageHistogram res;
+    res.total_ = total_;
+    res.shift_ = shift_;
+    while (res.shift_ < 16 && (0x10000 >> res.shift_) > bins)
+        res.shift_++;
+    res.counts_.assign(0x10000 >> res.shift_, 0);
+    int shift = res.shift_ - shift_;
+    for (size_t i = 0; i < counts_.size(); i++)
+    {
+        res.counts_[i >> shift] += counts_[i];
+    }
     return res;
 }
 
+uint16_t CImageHistogram::GetRank(uint64_t rank) const
+{
+    if (rank >= total_)
+        return 0xffff;
+    uint64_t count = 0;
+    for (size_t i = 0; i < counts_.size(); i++)
+    {
+        count += counts_[i];
+        if (count > rank)
+            return (uint16_t)(i << shift_);
+    }
+    return 0xffff;
+}
+
+uint16_t CImageHistogram::GetPercentile(float percentile) const
+{
+    if (total_ == 0)
+        return 0xffff;
+    percentile = percentile < 0 ? 0 : (percentile > 100 ? 100 : percentile);
+    return GetRank((uint64_t)(percentile / 100.0 * (total_ - 1))); // 0 -> minimum, 100 -> maximum
+}
+
+uint16_t CImageHistogram::GetMode() const
+{
+    if (total_ == 0)
+        return 0xffff;
+    size_t mode = std::max_element(counts_.begin(), counts_.end()) - counts_.begin();
+    return (uint16_t)(mode << shift_);
+}
+
+CImageAnalysis::CImageAnalysis(const uint16_t *data, size_t count, int nThreads)
+    : histogram_(data, count, 0x10000, nThreads), min_(0), max_(0), sum_(0), sumsq_(0), saturated_(0)
+{
+    // the histogram is the only pass over the pixels, everything else is exact from the bins
+    const std::vector<uint32_t> &counts = histogram_.GetCounts();
+    bool first = true;
+    for (uint32_t i = 0; i < counts.size(); i++)
+    {
+        uint64_t n = counts[i];
+        if (n == 0)
+            continue;
+        if (first)
+        {
+            min_ = (uint16_t)i;
+            first = false;
+        }
+        max_ = (uint16_t)i;
+        sum_ += n * i;
+        sumsq_ += n * i * i; // fits for less than 2^32 pixels
+    }
+    saturated_ = counts[0xffff];
+}
+
+double CImageAnalysis::GetMean() const
+{
+    uint64_t n = GetCount();
+    return n > 0 ? (double)sum_ / n : 0;
+}
+
+double CImageAnalysis::GetStandardDeviation() const
+{
+    uint64_t n = GetCount();
+    if (n < 2)
+        return 0;
+    // sum of (x - mean)^2 = sum of (x - q)^2 - r^2 / n for sum = q n + r; the first term is an exact
+    // integer (modular arithmetic, the true value fits), so there is no cancellation
+    uint64_t q = sum_ / n, r = sum_ % n;
+    uint64_t dev = sumsq_ - 2 * q * sum_ + q * q * n;
+    double varianceSum = (double)dev - (double)r * (double)r / n;
+    return sqrt(varianceSum / (double)(n - 1));
+}
+
+std::shared_ptr<const CImageAnalysis> CImageData::GetAnalysis() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return GetAnalysisUnlocked();
+}
+
+std::shared_ptr<const CImageAnalysis> CImageData::GetAnalysisUnlocked() const
+{
+    if (!m_analysis)
+    {
+        m_analysis = std::make_shared<const CImageAnalysis>(m_imageData, m_imageData ? (size_t)m_imageWidth * m_imageHeight : 0);
+    }
+    return m_analysis;
+}
+
+std::shared_ptr<const CImageHistogram> CImageData::GetHistogram(int bins) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<const CImageAnalysis> analysis = GetAnalysisUnlocked();
+    const CImageHistogram &hist = analysis->GetHistogram();
+    if (bins >= hist.GetBins())
+        return std::shared_ptr<const CImageHistogram>(analysis, &hist); // shares the cached analysis
+    return std::make_shared<const CImageHistogram>(hist.Rebin(bins));
+}
+
+void CImageData::DataPercentiles(float lowPercentile, float highPercentile, uint16_t &low, uint16_t &high)
+{
+    std::shared_ptr<const CImageAnalysis> analysis = GetAnalysisUnlocked();
+    highPercentile = highPercentile < lowPercentile ? lowPercentile : highPercentile;
+    low = analysis->GetHistogram().GetPercentile(lowPercentile);
+    high = analysis->GetHistogram().GetPercentile(highPercentile);
+}
+
 #include <stdio.h>
 
+void CImageData::SetJPEGStretch(CImageStretch stretch, float parameter, float blackPercentile, float whitePercentile)
+{
+    jpegStretch = stretch;
+    jpegStretchParam = parameter;
+    this->blackPercentile = blackPercentile < 0 ? 0 : (blackPercentile > 100 ? 100 : blackPercentile);
+    this->whitePercentile = whitePercentile < 0 ? 0 : (whitePercentile > 100 ? 100 : whitePercentile);
+    jpegDirty = true;
+}
+
+void CImageData::BuildToneMap(uint8_t *lut, uint16_t black, uint16_t white, CImageStretch stretch, float parameter)
+{
+    if (white <= black) // degenerate range, threshold at black
+    {
+        memset(lut, 0, black + 1);
+        memset(lut + black + 1, 0xff, 0xffff - black);
+        return;
+    }
+    memset(lut, 0, black);
+    memset(lut + white, 0xff, 0x10000 - white);
+    double range = white - black;
+    double norm = 1;
+    switch (stretch)
+    {
+    case STRETCH_GAMMA:
+        parameter = parameter > 0 ? parameter : 2.2;
+        break;
+    case STRETCH_LOG:
+        parameter = parameter > 0 ? parameter : 1000;
+        norm = log1p(parameter);
+        break;
+    case STRETCH_ASINH:
+        parameter = parameter > 0 ? parameter : 10;
+        norm = asinh(parameter);
+        break;
+    default:
+        stretch = STRETCH_LINEAR;
+        break;
+    }
+    for (int val = black; val < white; val++)
+    {
+        double x = (val - black) / range;
+        double y;
+        switch (stretch)
+        {
+        case STRETCH_GAMMA:
+            y = pow(x, 1.0 / parameter);
+            break;
+        case STRETCH_LOG:
+            y = log1p(parameter * x) / norm;
+            break;
+        case STRETCH_ASINH:
+            y = asinh(parameter * x) / norm;
+            break;
+        default:
+            y = x;
+            break;
+        }
+        lut[val] = (uint8_t)(y * 255 + 0.5);
+    }
+}
+
+// Convert a row of raw pixels to JPEG source bitmap pixels
+static void ConvertJPEGRow(const uint16_t *src, uint8_t *dst, int width, const uint8_t *lut, uint16_t max, bool overlay)
+{
+    if (!overlay)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            dst[i] = lut[src[i]]; // saturation and limit are white
+        }
+        return;
+    }
+    for (int i = 0; i < width; i++) // for each pixel in raw image
+    {
+        int idx = 3 * i;      // RGB pixel in JPEG source bitmap
+        if (src[i] == 0xffff) // saturation
+        {
+            dst[idx + 0] = 0xff;
+            dst[idx + 1] = 0x0;
+            dst[idx + 2] = 0x0;
+        }
+        else if (src[i] > max) // limit
+        {
+            dst[idx + 0] = 0xff;
+            dst[idx + 1] = 0xa5;
+            dst[idx + 2] = 0x0;
+        }
+        else // scaling
+        {
+            uint8_t tmp = lut[src[i]];
+            dst[idx + 0] = tmp;
+            dst[idx + 1] = tmp;
+            dst[idx + 2] = tmp;
+        }
+    }
+}
+
 void CImageData::ConvertJPEG()
 {
+    m_jpegData.clear();
+    sz_jpegData = -1;
+    jpegDirty = false;
     // Check if data exists
     if (!HasData())
         return;
+    // typical JPEG images take well under 2 bits per pixel, the buffer grows if needed
+    m_jpegData.reserve((size_t)m_imageWidth * m_imageHeight * (jpegOverlay ? 3 : 1) / 4 + 1024);
+    jpge::vector_stream stream(m_jpegData);
+    if (!WriteJPEGUnlocked(&stream))
+    {
+        CIMAGEDATA_DBG_ERR("Failed to compress image to jpeg in memory");
+        return;
+    }
+    sz_jpegData = m_jpegData.size();
+}
+
+bool CImageData::WriteJPEG(jpge::output_stream *stream)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return WriteJPEGUnlocked(stream);
+}
+
+bool CImageData::WriteJPEGUnlocked(jpge::output_stream *stream)
+{
+    // Check if data exists
+    if (!HasData() || stream == nullptr)
+        return false;
     // source raw image
     uint16_t *imgptr = m_imageData;
-    // temporary bitmap buffer
-    uint8_t *data = new uint8_t[m_imageWidth * m_imageHeight * 3]; // 3 channels for RGB
     // autoscale
     uint16_t min, max;
     if (autoscale)
     {
-        min = DataMin();
-        max = DataMax();
+        // 0 and 100 percentiles are the minimum and maximum
+        DataPercentiles(blackPercentile, whitePercentile, min, max);
     }
     else
     {
         min = pixelMin < 0 ? 0 : (pixelMin > 0xffff ? 0xffff : pixelMin);
         max = (uint16_t)(pixelMax < 0 ? 0xffff : (pixelMax > 0xffff ? 0xffff : pixelMax));
     }
-    // scaling
-    float scale = 0xffff / ((float)(max - min));
-    // Data conversion
-    for (int i = 0; i < m_imageWidth * m_imageHeight; i++) // for each pixel in raw image
+    // scaling, one table lookup per pixel
+    std::vector<uint8_t> lut(0x10000);
+    BuildToneMap(lut.data(), min, max, jpegStretch, jpegStretchParam);
+    // grayscale: 1 byte per pixel, color overlay: RGB
+    int channels = jpegOverlay ? 3 : 1;
+    // JPEG parameters
+    jpge::params params;
+    params.m_quality = JpegQuality;
+    params.m_subsampling = jpegOverlay ? jpge::H2V1 : jpge::Y_ONLY;
+    bool ok = true;
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads > 1 && (size_t)m_imageWidth * m_imageHeight >= CIMAGEDATA_JPEG_MT_PIXELS)
     {
-        int idx = 3 * i;         // RGB pixel in JPEG source bitmap
-        if (imgptr[i] == 0xffff) // saturation
-        {
-            data[idx + 0] = 0xff;
-            data[idx + 1] = 0x0;
-            data[idx + 2] = 0x0;
-        }
-        else if (imgptr[i] > max) // limit
+        // encoded in parallel strips, every thread converts the rows of its strips into its own scanline buffer
+        int width = m_imageWidth;
+        const uint8_t *table = lut.data();
+        bool overlay = jpegOverlay;
+        ok = jpge::compress_scanlines_to_jpeg_stream_mt(stream, m_imageWidth, m_imageHeight, channels, [=](int row, uint8_t *line)
+                                                        {
+                                                            ConvertJPEGRow(imgptr + (size_t)row * width, line, width, table, max, overlay);
+                                                            return (const uint8_t *)line; },
+                                                        params, threads);
+    }
+    else
+    {
+        // one encoder per thread, keeps its scanline buffer and tables from image to image
+        static thread_local jpge::jpeg_encoder encoder;
+        if (!encoder.init(stream, m_imageWidth, m_imageHeight, channels, params))
         {
-            data[idx + 0] = 0xff;
-            data[idx + 1] = 0xa5;
-            data[idx + 2] = 0x0;
+            CIMAGEDATA_DBG_ERR("Failed to initialize jpeg encoder");
+            return false;
         }
-        else // scaling
+        // scanline buffer, converted row by row and fed to the encoder
+        std::vector<uint8_t> line((size_t)m_imageWidth * channels);
+        for (uint32_t pass = 0; ok && pass < encoder.get_total_passes(); pass++)
         {
-            uint8_t tmp = ((imgptr[i] - min) / 0x100) * scale;
-            data[idx + 0] = tmp;
-            data[idx + 1] = tmp;
-            data[idx + 2] = tmp;
+            for (int row = 0; ok && row < m_imageHeight; row++)
+            {
+                ConvertJPEGRow(imgptr + (size_t)row * m_imageWidth, line.data(), m_imageWidth, lut.data(), max, jpegOverlay);
+                ok = encoder.process_scanline(line.data());
+            }
+            ok = ok && encoder.process_scanline(NULL);
         }
     }
-    // JPEG output buffer, has to be larger than expected JPEG size
-    if (m_jpegData != nullptr)
-    {
-        delete[] m_jpegData;
-        m_jpegData = nullptr;
-    }
-    m_jpegData = new uint8_t[m_imageWidth * m_imageHeight * 4 + 1024]; // extra room for JPEG conversion
-    // JPEG parameters
-    jpge::params params;
-    params.m_quality = JpegQuality;
-    params.m_subsampling = static_cast<jpge::subsampling_t>(2); // 0 == grey, 2 == RGB
-    // JPEG compression and image update
-    if (!jpge::compress_image_to_jpeg_file_in_memory(m_jpegData, sz_jpegData, m_imageWidth, m_imageHeight, 3, data, params))
-    {
-        CIMAGEDATA_DBG_ERR("Failed to compress image to jpeg in memory");
-    }
-    delete[] data;
+    return ok;
 }
 
 void CImageData::GetJPEGData(unsigned char *&ptr, int &sz)
 {
-    if (!convert_jpeg)
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (jpegDirty)
     {
-        convert_jpeg = true;
         ConvertJPEG();
     }
-    ptr = m_jpegData;
+    ptr = m_jpegData.empty() ? nullptr : m_jpegData.data();
     sz = sz_jpegData;
 }
 
-/* Sorting */
-int _compare_uint16(const void *a, const void *b)
+uint64_t CImageData::MeterUnlocked(const CImageMetering &metering, std::vector<uint64_t> &hist) const
+{
+    hist.assign(0x10000, 0);
+    if (m_imageData == NULL)
+        return 0;
+    bool weighted = metering.mode == METERING_WEIGHTED;
+    int scale = std::max(1, metering.weightsScale);
+    if (weighted && (metering.weightsWidth <= 0 || metering.weightsHeight <= 0 || metering.weights.size() < (size_t)metering.weightsWidth * metering.weightsHeight))
+    {
+        CIMAGEDATA_DBG_ERR("Weight mask is smaller than %d x %d", metering.weightsWidth, metering.weightsHeight);
+        return 0;
+    }
+    int stride = std::max(1, metering.stride);
+    // image pixel (x, y) is centered on sensor pixel ((left + x + 0.5) binX, (top + y + 0.5) binY)
+    int binX = std::max(1, m_metadata.binX), binY = std::max(1, m_metadata.binY);
+    int left = m_metadata.imgLeft, top = m_metadata.imgTop;
+    // first image row and column with the center at or after the sensor position, and the last one before it
+    auto firstX = [&](double sx) { return (int)std::max(-1.0, std::min((double)m_imageWidth, ceil(sx / binX - 0.5) - left)); };
+    auto firstY = [&](double sy) { return (int)std::max(-1.0, std::min((double)m_imageHeight, ceil(sy / binY - 0.5) - top)); };
+
+    int y0 = 0, y1 = m_imageHeight;
+    if (metering.mode == METERING_ROI)
+    {
+        y0 = firstY(metering.roiTop);
+        y1 = firstY(metering.roiTop + metering.roiHeight);
+    }
+    else if (metering.mode == METERING_CIRCLE)
+    {
+        y0 = firstY(metering.centerY - metering.radius);
+        y1 = firstY(std::nextafter(metering.centerY + metering.radius, INFINITY));
+    }
+    y0 = std::max(0, y0);
+
+    uint64_t total = 0;
+    // strided pixels are on a fixed grid of the image, whatever the selection
+    for (int y = y0 + (stride - y0 % stride) % stride; y < y1; y += stride)
+    {
+        int x0 = 0, x1 = m_imageWidth;
+        if (metering.mode == METERING_ROI)
+        {
+            x0 = firstX(metering.roiLeft);
+            x1 = firstX(metering.roiLeft + metering.roiWidth);
+        }
+        else if (metering.mode == METERING_CIRCLE)
+        {
+            double dy = (top + y + 0.5) * binY - metering.centerY;
+            double half = (double)metering.radius * metering.radius - dy * dy;
+            if (half < 0)
+                continue;
+            half = sqrt(half);
+            x0 = firstX(metering.centerX - half);
+            x1 = firstX(std::nextafter(metering.centerX + half, INFINITY));
+        }
+        x0 = std::max(0, x0);
+        const unsigned short *row = m_imageData + (size_t)y * m_imageWidth;
+        int x = x0 + (stride - x0 % stride) % stride;
+        if (!weighted)
+        {
+            for (; x < x1; x += stride)
+            {
+                hist[row[x]]++;
+                total++;
+            }
+            continue;
+        }
+        int my = ((top + y) * binY + binY / 2) / scale;
+        if (my < 0 || my >= metering.weightsHeight)
+            continue;
+        const uint8_t *wrow = metering.weights.data() + (size_t)my * metering.weightsWidth;
+        for (; x < x1; x += stride)
+        {
+            int mx = ((left + x) * binX + binX / 2) / scale;
+            if (mx < 0 || mx >= metering.weightsWidth)
+                continue;
+            hist[row[x]] += wrow[mx];
+            total += wrow[mx];
+        }
+    }
+    return total;
+}
+
+bool CImageData::GetMeteredPercentile(uint16_t &value, float percentilePixel, int numPixelExclusion, const CImageMetering *metering) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return MeteredPercentileUnlocked(value, percentilePixel, numPixelExclusion, metering);
+}
+
+bool CImageData::MeteredPercentileUnlocked(uint16_t &value, float percentilePixel, int numPixelExclusion, const CImageMetering *metering) const
 {
-    return (*((unsigned short *)a) - *((unsigned short *)b));
+    value = 0xffff;
+    if (m_imageData == NULL)
+        return false;
+
+    // histogram of the metered pixels: the cached one for the whole image, in units of 1/255 pixel for a weight mask
+    std::shared_ptr<const CImageAnalysis> analysis;
+    std::vector<uint64_t> meterHist;
+    uint64_t m_imageSize, unit = 1;
+    if (metering == nullptr || (metering->mode == METERING_FULL && metering->stride <= 1))
+    {
+        analysis = GetAnalysisUnlocked();
+        m_imageSize = analysis->GetCount();
+    }
+    else
+    {
+        m_imageSize = MeterUnlocked(*metering, meterHist);
+        unit = metering->mode == METERING_WEIGHTED ? 255 : 1;
+        if (m_imageSize == 0)
+        {
+            CIMAGEDATA_DBG_WARN("No pixel metered");
+            return false;
+        }
+    }
+    uint64_t exclusion = numPixelExclusion > 0 ? (uint64_t)numPixelExclusion * unit : 0;
+
+    // pixel count at the percentile rank, read off the histogram instead of sorting a copy
+    uint64_t coord;
+    if (percentilePixel > 99.99)
+        coord = m_imageSize - 1;
+    else
+        coord = floor((percentilePixel * (m_imageSize - 1) * 0.01));
+    uint64_t validPixelCoord = m_imageSize - 1 - coord;
+    if (validPixelCoord < exclusion)
+        coord = m_imageSize - 1 > exclusion ? m_imageSize - 1 - exclusion : 0;
+    if (analysis)
+    {
+        value = analysis->GetHistogram().GetRank(coord);
+    }
+    else
+    {
+        uint64_t count = 0;
+        int idx = 0;
+        while ((count += meterHist[idx]) <= coord && idx < 0xffff)
+            idx++;
+        value = idx;
+    }
+    return true;
 }
-/* End Sorting */
 
-bool CImageData::FindOptimumExposure(float &targetExposure, int &bin, float percentilePixel, int pixelTarget, float maxAllowedExposure, int maxAllowedBin, int numPixelExclusion, int pixelTargetUncertainty)
+bool CImageData::FindOptimumExposure(float &targetExposure, int &bin, float percentilePixel, int pixelTarget, float maxAllowedExposure, int maxAllowedBin, int numPixelExclusion, int pixelTargetUncertainty, const CImageMetering *metering)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     double exposure = m_metadata.exposureTime;
     targetExposure = exposure;
     bool changeBin = true;
@@ -689,32 +1184,10 @@ bool CImageData::FindOptimumExposure(float &targetExposure, int &bin, float perc
     dbprintlf("Input: %lf s, bin %d x %d", exposure, m_metadata.binX, m_metadata.binY);
 #endif
     double val;
-    int m_imageSize = m_imageHeight * m_imageWidth;
-    uint16_t *picdata = new uint16_t[m_imageSize];
-    memcpy(picdata, m_imageData, m_imageSize * sizeof(uint16_t));
-    qsort(picdata, m_imageSize, sizeof(unsigned short), _compare_uint16);
-
-    bool direction;
-    if (picdata[0] < picdata[m_imageSize - 1])
-        direction = true;
-    else
-        direction = false;
-    unsigned int coord;
-    if (percentilePixel > 99.99)
-        coord = m_imageSize - 1;
-    else
-        coord = floor((percentilePixel * (m_imageSize - 1) * 0.01));
-    int validPixelCoord = m_imageSize - 1 - coord;
-    if (validPixelCoord < numPixelExclusion)
-        coord = m_imageSize - 1 - numPixelExclusion;
-    if (direction)
-        val = picdata[coord];
-    else
-    {
-        if (coord == 0)
-            coord = 1;
-        val = picdata[m_imageSize - coord];
-    }
+    uint16_t pixel;
+    if (!MeteredPercentileUnlocked(pixel, percentilePixel, numPixelExclusion, metering))
+        return false;
+    val = pixel;
 
     float targetExposure_;
     int bin_ = bin;
@@ -779,14 +1252,13 @@ ret:
 #ifdef CIMAGE_OPTIMUM_EXP_DEBUG
     dbprintlf(YELLOW_FG "Final exposure and bin: %f s, %d", targetExposure, bin);
 #endif
-    delete[] picdata;
     return true;
 }
 
-bool CImageData::FindOptimumExposure(float &targetExposure, float percentilePixel, int pixelTarget, float maxAllowedExposure, int numPixelExclusion, int pixelTargetUncertainty)
+bool CImageData::FindOptimumExposure(float &targetExposure, float percentilePixel, int pixelTarget, float maxAllowedExposure, int numPixelExclusion, int pixelTargetUncertainty, const CImageMetering *metering)
 {
     int bin = 1;
-    return FindOptimumExposure(targetExposure, bin, percentilePixel, pixelTarget, maxAllowedExposure, -1, numPixelExclusion, pixelTargetUncertainty);
+    return FindOptimumExposure(targetExposure, bin, percentilePixel, pixelTarget, maxAllowedExposure, -1, numPixelExclusion, pixelTargetUncertainty, metering);
 }
 
 #if !defined(OS_Windows)
@@ -797,6 +1269,57 @@ bool CImageData::FindOptimumExposure(float &targetExposure, float percentilePixe
 #endif
 
 #include "utilities.h"
+#include "FileNameRegistry.hpp"
+#include <errno.h>
+#include <fcntl.h>
+
+int CImageData::WriteFITSHDU(void *fptr, const char *extName) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return WriteFITSHDUUnlocked(fptr, extName);
+}
+
+int CImageData::WriteFITSHDUUnlocked(void *_fptr, const char *extName) const
+{
+    fitsfile *fptr = (fitsfile *)_fptr;
+    int status = 0, bitpix = USHORT_IMG, naxis = 2;
+    if (fptr == nullptr || m_imageData == nullptr)
+    {
+        return -1;
+    }
+    long naxes[2] = {(long)(m_imageWidth), (long)(m_imageHeight)};
+    unsigned int exposureTime = m_metadata.exposureTime * 1000000U;
+    CImageMetadata metadata = m_metadata; // cfitsio takes non-const pointers
+
+    fits_create_img(fptr, bitpix, naxis, naxes, &status);
+    if (extName != nullptr && strlen(extName) > 0)
+    {
+        fits_write_key(fptr, TSTRING, "EXTNAME", (void *)extName, NULL, &status);
+    }
+    fits_write_key(fptr, TSTRING, "PROGRAM", (void *)CIMAGE_PROGNAME_STRING, NULL, &status);
+    fits_write_key(fptr, TSTRING, "CAMERA", (void *)(metadata.cameraName.c_str()), NULL, &status);
+    fits_write_key(fptr, TLONGLONG, "TIMESTAMP", &(metadata.timestamp), NULL, &status);
+    fits_write_key(fptr, TFLOAT, "CCDTEMP", &(metadata.temperature), NULL, &status);
+    fits_write_key(fptr, TUINT, "EXPOSURE_US", &(exposureTime), NULL, &status);
+    fits_write_key(fptr, TUINT, "ORIGIN_X", &(metadata.imgLeft), NULL, &status);
+    fits_write_key(fptr, TUINT, "ORIGIN_Y", &(metadata.imgTop), NULL, &status);
+    fits_write_key(fptr, TUSHORT, "BINX", &(metadata.binX), NULL, &status);
+    fits_write_key(fptr, TUSHORT, "BINY", &(metadata.binY), NULL, &status);
+    fits_write_key(fptr, TLONGLONG, "GAIN", &(metadata.gain), NULL, &status);
+    fits_write_key(fptr, TLONGLONG, "OFFSET", &(metadata.offset), NULL, &status);
+    fits_write_key(fptr, TINT, "GAIN_MIN", &(metadata.minGain), NULL, &status);
+    fits_write_key(fptr, TINT, "GAIN_MAX", &(metadata.maxGain), NULL, &status);
+
+    for (auto iter = metadata.extendedMetadata.begin(); iter != metadata.extendedMetadata.end(); iter++)
+    {
+        fits_write_key(fptr, TSTRING, iter->first.c_str(), (void *)(iter->second.c_str()), NULL, &status);
+    }
+
+    long fpixel[] = {1, 1};
+    fits_write_pix(fptr, TUSHORT, fpixel, (m_imageWidth) * (m_imageHeight), m_imageData, &status);
+    return status;
+}
+
 bool CImageData::SaveFITS(bool syncOnWrite, const char *DirNamePrefix, const char *fileNameFormat, ...)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
@@ -804,7 +1327,7 @@ bool CImageData::SaveFITS(bool syncOnWrite, const char *DirNamePrefix, const cha
     static char defaultDirPrefix[] = "." DIR_DELIM "fits" DIR_DELIM;
     char *DirPrefix = nullptr;
     if ((DirNamePrefix == nullptr) || (strlen(DirNamePrefix) == 0))
-        DirNamePrefix = defaultDirPrefix;
+        DirPrefix = defaultDirPrefix;
     else
         DirPrefix = (char *)DirNamePrefix;
     // Default case: need to make directory if does not exist
@@ -857,65 +1380,606 @@ bool CImageData::SaveFITS(bool syncOnWrite, const char *DirNamePrefix, const cha
         } while (cond);
     }
     // Get the full file name
-    std::string full_name_base = string_format("%s" DIR_DELIM "%s", DirPrefix, fname.c_str());
-    std::string full_name = full_name_base.c_str(); // make a copy
-    int ctr = 0;
-    // Check if the file exists
-    do
+    std::string dir_name = DirPrefix;
+    size_t delim = fname.find_last_of(DIR_DELIM);
+    if (delim != std::string::npos) // name format contains a subdirectory
+    {
+        dir_name = string_format("%s" DIR_DELIM "%s", DirPrefix, fname.substr(0, delim).c_str());
+        fname = fname.substr(delim + 1);
+    }
+
+    // Compress the image in memory, the file is only created once the final size is known
+    fitsfile *fptr;
+    int status = 0;
+    size_t buf_size = 2880 * 4 + (size_t)m_imageWidth * m_imageHeight; // expected compressed size
+    void *buf = malloc(buf_size);
+    if (buf == nullptr)
     {
-        FILE *fp = fopen(full_name.c_str(), "r");
-        if (fp != NULL)
+        CIMAGEDATA_DBG_ERR("Could not allocate %zu bytes", buf_size);
+        return false;
+    }
+    if (fits_create_memfile(&fptr, &buf, &buf_size, 2880 * 16, realloc, &status))
+    {
+        CIMAGEDATA_DBG_ERR("Could not create memory file for %s, status %d", fname.c_str(), status);
+        free(buf);
+        return false;
+    }
+    LONGLONG head_start = 0, data_start = 0, file_size = 0;
+    fits_set_compression_type(fptr, RICE_1, &status);
+    status = WriteFITSHDUUnlocked(fptr, nullptr);
+    fits_flush_file(fptr, &status); // finalizes the HDU, the end of its data unit is the end of the file
+    fits_get_hduaddrll(fptr, &head_start, &data_start, &file_size, &status);
+    fits_close_file(fptr, &status);
+    if (status)
+    {
+        CIMAGEDATA_DBG_ERR("Could not compress image %s, status %d", fname.c_str(), status);
+        free(buf);
+        return false;
+    }
+
+    // Create the file (unique name without probing, O_CREAT | O_EXCL), preallocate and write
+    std::string full_name;
+    bool ret = CFileNameRegistry::Instance().WriteUnique(dir_name, fname, ".fits", buf, (size_t)file_size, full_name, syncOnWrite);
+    if (!ret)
+    {
+        CIMAGEDATA_DBG_ERR("Could not write file %s" DIR_DELIM "%s.fits: %s", dir_name.c_str(), fname.c_str(), strerror(errno));
+    }
+    free(buf);
+    return ret;
+}
+
+/* FITS loading */
+#include <thread>
+#include <atomic>
+#if !defined(OS_Windows)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Position of the highest set bit (1 - 8) of a byte, 0 for 0
+struct rice_nonzero_count
+{
+    unsigned char count[256];
+    rice_nonzero_count()
+    {
+        count[0] = 0;
+        for (int i = 1; i < 256; i++)
         {
-            fclose(fp);
-            full_name = string_format("%s_%d", full_name_base.c_str(), ++ctr);
+            count[i] = count[i >> 1] + 1;
         }
-        else
+    }
+};
+
+/**
+ * @brief Decode a RICE_1 compressed tile of 16-bit pixels (BYTEPIX = 2), the inverse of
+ * fits_rcomp_short in cfitsio. Reads never go past the end of the compressed buffer.
+ *
+ * @param c Compressed data.
+ * @param clen Length of compressed data.
+ * @param array Decoded pixels (output), as stored in the file (BZERO not applied).
+ * @param nx Number of pixels in the tile.
+ * @param nblock Rice block size (BLOCKSIZE).
+ * @return bool Returns true on success, false if the data is corrupt.
+ */
+static bool rice_decode_short(const unsigned char *c, size_t clen, unsigned short *array, int nx, int nblock)
+{
+    static const rice_nonzero_count nonzero;
+    const int fsbits = 4, fsmax = 14, bbits = 1 << fsbits;
+    const unsigned char *cend = c + clen;
+    bool overflow = false;
+#define RICE_NEXT_BYTE() (c < cend ? (unsigned int)(*c++) : (overflow = true, 0U))
+
+    if (clen < 3 || nblock <= 0)
+    {
+        return false;
+    }
+    unsigned int lastpix = ((unsigned int)c[0] << 8) | c[1]; // first pixel is stored as is
+    c += 2;
+    unsigned int b = *c++; // bit buffer
+    int nbits = 8;         // number of bits remaining in b
+    for (int i = 0; i < nx && !overflow;)
+    {
+        // get the FS value from the first fsbits
+        nbits -= fsbits;
+        while (nbits < 0)
+        {
+            b = (b << 8) | RICE_NEXT_BYTE();
+            nbits += 8;
+        }
+        int fs = (int)(b >> nbits) - 1;
+        b &= (1U << nbits) - 1;
+        int imax = i + nblock;
+        if (imax > nx)
+        {
+            imax = nx;
+        }
+        if (fs < 0) // low-entropy case, all differences zero
+        {
+            for (; i < imax; i++)
+            {
+                array[i] = lastpix;
+            }
+        }
+        else if (fs == fsmax) // high-entropy case, differences stored directly
+        {
+            for (; i < imax; i++)
+            {
+                int k = bbits - nbits;
+                unsigned int diff = b << k;
+                for (k -= 8; k >= 0; k -= 8)
+                {
+                    b = RICE_NEXT_BYTE();
+                    diff |= b << k;
+                }
+                if (nbits > 0)
+                {
+                    b = RICE_NEXT_BYTE();
+                    diff |= b >> (-k);
+                    b &= (1U << nbits) - 1;
+                }
+                else
+                {
+                    b = 0;
+                }
+                diff = (diff & 1) == 0 ? diff >> 1 : ~(diff >> 1); // undo the zig-zag mapping
+                array[i] = diff + lastpix;
+                lastpix = array[i];
+            }
+        }
+        else // normal case, Rice coding
+        {
+            for (; i < imax && !overflow; i++)
+            {
+                // count the number of leading zeros
+                while (b == 0 && !overflow)
+                {
+                    nbits += 8;
+                    b = RICE_NEXT_BYTE();
+                }
+                int nzero = nbits - nonzero.count[b & 0xff];
+                nbits -= nzero + 1;
+                b ^= 1U << nbits; // flip the leading one-bit
+                // get the fs trailing bits
+                nbits -= fs;
+                while (nbits < 0)
+                {
+                    b = (b << 8) | RICE_NEXT_BYTE();
+                    nbits += 8;
+                }
+                unsigned int diff = ((unsigned int)nzero << fs) | (b >> nbits);
+                b &= (1U << nbits) - 1;
+                diff = (diff & 1) == 0 ? diff >> 1 : ~(diff >> 1);
+                array[i] = diff + lastpix;
+                lastpix = array[i];
+            }
+        }
+    }
+#undef RICE_NEXT_BYTE
+    return !overflow;
+}
+
+/**
+ * @brief Read a RICE_1 compressed 16-bit image without cfitsio's sequential tile decoder. The compressed
+ * tiles are read through cfitsio, and decoded on multiple threads.
+ *
+ * @param fptr cfitsio file, at the compressed image HDU.
+ * @param width Image width.
+ * @param height Image height.
+ * @param bzero Offset to apply (32768 for unsigned 16-bit images).
+ * @param data Output pixels.
+ * @param nThreads Number of decoding threads.
+ * @return bool Returns true on success, false if the image uses an unsupported layout and should be read through cfitsio.
+ */
+static bool read_rice_tiles(fitsfile *fptr, int width, int height, int bzero, unsigned short *data, int nThreads)
+{
+    int status = 0;
+    char cmptype[FLEN_VALUE] = {0};
+    int zbitpix = 0;
+    fits_read_key(fptr, TSTRING, "ZCMPTYPE", cmptype, NULL, &status);
+    fits_read_key(fptr, TINT, "ZBITPIX", &zbitpix, NULL, &status);
+    if (status || strcmp(cmptype, "RICE_1") != 0 || zbitpix != SHORT_IMG)
+    {
+        return false;
+    }
+    long tile[2] = {width, 1}; // default is row by row
+    for (int i = 0; i < 2; i++)
+    {
+        char key[FLEN_KEYWORD];
+        snprintf(key, sizeof(key), "ZTILE%d", i + 1);
+        status = 0;
+        fits_read_key(fptr, TLONG, key, &tile[i], NULL, &status);
+    }
+    int blocksize = 32, bytepix = 4;
+    for (int i = 1;; i++)
+    {
+        char key[FLEN_KEYWORD], name[FLEN_VALUE];
+        snprintf(key, sizeof(key), "ZNAME%d", i);
+        status = 0;
+        if (fits_read_key(fptr, TSTRING, key, name, NULL, &status))
         {
             break;
         }
-    } while (true);
+        snprintf(key, sizeof(key), "ZVAL%d", i);
+        int val = 0;
+        fits_read_key(fptr, TINT, key, &val, NULL, &status);
+        if (strcmp(name, "BLOCKSIZE") == 0)
+        {
+            blocksize = val;
+        }
+        else if (strcmp(name, "BYTEPIX") == 0)
+        {
+            bytepix = val;
+        }
+    }
+    status = 0;
+    int col = 0, nullcol = 0;
+    LONGLONG nrows = 0;
+    fits_get_colnum(fptr, CASEINSEN, (char *)"COMPRESSED_DATA", &col, &status);
+    fits_get_num_rowsll(fptr, &nrows, &status);
+    if (status || bytepix != 2 || tile[0] <= 0 || tile[1] <= 0)
+    {
+        return false;
+    }
+    if (fits_get_colnum(fptr, CASEINSEN, (char *)"ZBLANK", &nullcol, &status) == 0) // null pixels, let cfitsio handle them
+    {
+        return false;
+    }
+    status = 0;
+    long ntx = (width + tile[0] - 1) / tile[0];
+    long nty = (height + tile[1] - 1) / tile[1];
+    if (nrows != (LONGLONG)ntx * nty)
+    {
+        return false;
+    }
 
-    full_name = full_name.append(".fits[compress]"); // append the format
+    // read the compressed tiles, sequential I/O
+    std::vector<std::vector<unsigned char>> tiles(nrows);
+    for (LONGLONG row = 1; row <= nrows; row++)
+    {
+        LONGLONG repeat = 0, offset = 0;
+        fits_read_descriptll(fptr, col, row, &repeat, &offset, &status);
+        if (status || repeat <= 0) // tile stored with a different algorithm
+        {
+            return false;
+        }
+        std::vector<unsigned char> &buf = tiles[row - 1];
+        buf.resize(repeat);
+        fits_read_col(fptr, TBYTE, col, row, 1, repeat, NULL, buf.data(), NULL, &status);
+        if (status)
+        {
+            return false;
+        }
+    }
 
-    fitsfile *fptr;
-    int status = 0, bitpix = USHORT_IMG, naxis = 2;
-    long naxes[2] = {(long)(m_imageWidth), (long)(m_imageHeight)};
-    unsigned int exposureTime = m_metadata.exposureTime * 1000000U;
+    // decode the tiles in parallel
+    std::atomic<long> next(0);
+    std::atomic<bool> ok(true);
+    unsigned short offset = (unsigned short)bzero;
+    auto worker = [&]()
+    {
+        std::vector<unsigned short> pixels(tile[0] * tile[1]);
+        long t;
+        while (ok && (t = next++) < nrows)
+        {
+            long x0 = (t % ntx) * tile[0], y0 = (t / ntx) * tile[1];
+            long tw = std::min(tile[0], width - x0), th = std::min(tile[1], height - y0);
+            if (!rice_decode_short(tiles[t].data(), tiles[t].size(), pixels.data(), tw * th, blocksize))
+            {
+                ok = false;
+                break;
+            }
+            for (long y = 0; y < th; y++)
+            {
+                const unsigned short *src = pixels.data() + y * tw;
+                unsigned short *dst = data + (y0 + y) * width + x0;
+                for (long x = 0; x < tw; x++)
+                {
+                    dst[x] = src[x] + offset; // wraps from signed storage
+                }
+            }
+        }
+    };
+    if (nThreads > nrows)
+    {
+        nThreads = nrows;
+    }
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &thr : threads)
+    {
+        thr.join();
+    }
+    if (!ok)
+    {
+        CIMAGEDATA_DBG_WARN("Corrupt compressed tile, reading through cfitsio");
+    }
+    return ok;
+}
 
-    if (!fits_create_file(&fptr, full_name.c_str(), &status))
+#if !defined(OS_Windows)
+/**
+ * @brief Convert the big-endian 16-bit data unit of an uncompressed image from a memory mapping of the file.
+ *
+ * @return bool Returns true on success, false if the file can not be mapped.
+ */
+static bool read_mapped_image(const std::string &fileName, LONGLONG dataStart, int width, int height, int bzero, unsigned short *data)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    size_t npix = (size_t)width * height;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < (uint64_t)dataStart + npix * 2)
     {
-        fits_create_img(fptr, bitpix, naxis, naxes, &status);
-        fits_write_key(fptr, TSTRING, "PROGRAM", (void *)CIMAGE_PROGNAME_STRING, NULL, &status);
-        fits_write_key(fptr, TSTRING, "CAMERA", (void *)(m_metadata.cameraName.c_str()), NULL, &status);
-        fits_write_key(fptr, TLONGLONG, "TIMESTAMP", &(m_metadata.timestamp), NULL, &status);
-        fits_write_key(fptr, TFLOAT, "CCDTEMP", &(m_metadata.temperature), NULL, &status);
-        fits_write_key(fptr, TUINT, "EXPOSURE_US", &(exposureTime), NULL, &status);
-        fits_write_key(fptr, TUINT, "ORIGIN_X", &(m_metadata.imgLeft), NULL, &status);
-        fits_write_key(fptr, TUINT, "ORIGIN_Y", &(m_metadata.imgTop), NULL, &status);
-        fits_write_key(fptr, TUSHORT, "BINX", &(m_metadata.binX), NULL, &status);
-        fits_write_key(fptr, TUSHORT, "BINY", &(m_metadata.binY), NULL, &status);
-        fits_write_key(fptr, TLONGLONG, "GAIN", &(m_metadata.gain), NULL, &status);
-        fits_write_key(fptr, TLONGLONG, "OFFSET", &(m_metadata.offset), NULL, &status);
-        fits_write_key(fptr, TINT, "GAIN_MIN", &(m_metadata.minGain), NULL, &status);
-        fits_write_key(fptr, TINT, "GAIN_MAX", &(m_metadata.maxGain), NULL, &status);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    const unsigned char *src = (const unsigned char *)map + dataStart;
+    unsigned short offset = (unsigned short)bzero;
+    for (size_t i = 0; i < npix; i++)
+    {
+        data[i] = (((unsigned short)src[2 * i] << 8) | src[2 * i + 1]) + offset;
+    }
+    munmap(map, st.st_size);
+    return true;
+}
+#endif
 
-        for (auto iter = m_metadata.extendedMetadata.begin(); iter != m_metadata.extendedMetadata.end(); iter++)
+// Check if a keyword is reserved by the tile compression convention, i.e. describes the compressed
+// image (ZNAXISn etc.) or holds a keyword of the uncompressed header (ZSIMPLE etc.)
+static bool is_compression_key(const std::string &key)
+{
+    static const char *reserved[] = {"ZIMAGE", "ZCMPTYPE", "ZBITPIX", "ZQUANTIZ", "ZDITHER0", "ZSIMPLE", "ZTENSION", "ZEXTEND", "ZBLOCKED", "ZPCOUNT", "ZGCOUNT", "ZHECKSUM", "ZDATASUM", "ZSCALE", "ZZERO", "ZBLANK"};
+    static const char *indexed[] = {"ZNAXIS", "ZTILE", "ZNAME", "ZVAL"}; // followed by a number
+    if (std::find(reserved, reserved + sizeof(reserved) / sizeof(reserved[0]), key) != reserved + sizeof(reserved) / sizeof(reserved[0]))
+    {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(indexed) / sizeof(indexed[0]); i++)
+    {
+        size_t len = strlen(indexed[i]);
+        if (key.compare(0, len, indexed[i]) == 0 && key.find_first_not_of("0123456789", len) == std::string::npos)
         {
-            fits_write_key(fptr, TSTRING, iter->first.c_str(), (void *)(iter->second.c_str()), NULL, &status);
+            return true;
         }
+    }
+    return false;
+}
 
-        long fpixel[] = {1, 1};
-        fits_write_pix(fptr, TUSHORT, fpixel, (m_imageWidth) * (m_imageHeight), m_imageData, &status);
+// Read the metadata written by WriteFITSHDU from the current HDU
+static void read_fits_metadata(fitsfile *fptr, bool compressed, CImageMetadata &metadata)
+{
+    static const char *known[] = {"PROGRAM", "CAMERA", "TIMESTAMP", "CCDTEMP", "EXPOSURE_US", "ORIGIN_X", "ORIGIN_Y", "BINX", "BINY", "GAIN", "OFFSET", "GAIN_MIN", "GAIN_MAX"};
+    int status = 0;
+    char str[FLEN_VALUE] = {0};
+    long long ival;
+    double dval;
+    if (fits_read_key(fptr, TSTRING, "CAMERA", str, NULL, &status) == 0)
+        metadata.cameraName = str;
+    status = 0;
+    if (fits_read_key(fptr, TLONGLONG, "TIMESTAMP", &ival, NULL, &status) == 0)
+        metadata.timestamp = ival;
+    status = 0;
+    if (fits_read_key(fptr, TDOUBLE, "CCDTEMP", &dval, NULL, &status) == 0)
+        metadata.temperature = dval;
+    status = 0;
+    if (fits_read_key(fptr, TDOUBLE, "EXPOSURE_US", &dval, NULL, &status) == 0)
+        metadata.exposureTime = dval * 1e-6;
+    status = 0;
+    fits_read_key(fptr, TINT, "ORIGIN_X", &metadata.imgLeft, NULL, &status);
+    status = 0;
+    fits_read_key(fptr, TINT, "ORIGIN_Y", &metadata.imgTop, NULL, &status);
+    status = 0;
+    fits_read_key(fptr, TINT, "BINX", &metadata.binX, NULL, &status);
+    status = 0;
+    fits_read_key(fptr, TINT, "BINY", &metadata.binY, NULL, &status);
+    status = 0;
+    if (fits_read_key(fptr, TLONGLONG, "GAIN", &ival, NULL, &status) == 0)
+        metadata.gain = ival;
+    status = 0;
+    if (fits_read_key(fptr, TLONGLONG, "OFFSET", &ival, NULL, &status) == 0)
+        metadata.offset = ival;
+    status = 0;
+    fits_read_key(fptr, TINT, "GAIN_MIN", &metadata.minGain, NULL, &status);
+    status = 0;
+    fits_read_key(fptr, TINT, "GAIN_MAX", &metadata.maxGain, NULL, &status);
+
+    // everything else that is not a FITS (or tile compression) keyword is extended metadata
+    status = 0;
+    int nkeys = 0;
+    fits_get_hdrspace(fptr, &nkeys, NULL, &status);
+    for (int i = 1; i <= nkeys && !status; i++)
+    {
+        char card[FLEN_CARD], name[FLEN_KEYWORD];
+        int len = 0;
+        if (fits_read_record(fptr, i, card, &status) || fits_get_keyclass(card) != TYP_USER_KEY)
+        {
+            continue;
+        }
+        fits_get_keyname(card, name, &len, &status);
+        std::string key = name;
+        if (key.compare(0, 9, "HIERARCH ") == 0)
+        {
+            key = key.substr(9);
+        }
+        if (key.length() == 0 || std::find(known, known + sizeof(known) / sizeof(known[0]), key) != known + sizeof(known) / sizeof(known[0]))
+        {
+            continue;
+        }
+        if (compressed && (is_compression_key(key) || key.compare(0, 5, "TTYPE") == 0 || key.compare(0, 5, "TFORM") == 0))
+        {
+            continue;
+        }
+        if (fits_read_key(fptr, TSTRING, key.c_str(), str, NULL, &status) == 0)
+        {
+            metadata.extendedMetadata[key] = str;
+        }
+        status = 0;
+    }
+}
+
+bool CImageData::LoadFITS(const std::string &fileName, int hdu, int nThreads)
+{
+    fitsfile *fptr = nullptr;
+    int status = 0;
+    if (fits_open_file(&fptr, fileName.c_str(), READONLY, &status))
+    {
+        CIMAGEDATA_DBG_ERR("Could not open %s, status %d", fileName.c_str(), status);
+        return false;
+    }
+    int naxis = 0, bitpix = 0;
+    long naxes[2] = {0, 0};
+    if (hdu > 0)
+    {
+        fits_movabs_hdu(fptr, hdu, NULL, &status);
+        fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status);
+    }
+    else // first HDU with an image, e.g. after the empty primary HDU of a compressed file
+    {
+        while (!status)
+        {
+            int hdutype = 0;
+            fits_get_hdu_type(fptr, &hdutype, &status);
+            if ((hdutype == IMAGE_HDU || fits_is_compressed_image(fptr, &status)) && fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status) == 0 && naxis > 0)
+            {
+                break;
+            }
+            fits_movrel_hdu(fptr, 1, NULL, &status);
+        }
+    }
+    if (status || naxis != 2 || naxes[0] <= 0 || naxes[1] <= 0)
+    {
+        CIMAGEDATA_DBG_ERR("%s: No 2-D image found, status %d", fileName.c_str(), status);
         fits_close_file(fptr, &status);
-        if (syncOnWrite)
+        return false;
+    }
+    int width = naxes[0], height = naxes[1];
+    int equivtype = 0;
+    double bzero = 0, bscale = 1;
+    bool compressed = fits_is_compressed_image(fptr, &status) != 0;
+    fits_get_img_equivtype(fptr, &equivtype, &status);
+    int keystatus = 0;
+    fits_read_key(fptr, TDOUBLE, "BZERO", &bzero, NULL, &keystatus);
+    keystatus = 0;
+    fits_read_key(fptr, TDOUBLE, "BSCALE", &bscale, NULL, &keystatus);
+
+    CImageMetadata metadata = CImageMetadata();
+    metadata.binX = metadata.binY = 1;
+    read_fits_metadata(fptr, compressed, metadata);
+
+    if (nThreads <= 0)
+    {
+        nThreads = std::thread::hardware_concurrency();
+        nThreads = nThreads < 1 ? 1 : nThreads;
+    }
+    if (!fits_is_reentrant())
+    {
+        nThreads = 1;
+    }
+
+    unsigned short *data = new unsigned short[(size_t)width * height];
+    bool done = false;
+    // 16-bit images stored as written by SaveFITS are converted directly, anything else goes through cfitsio
+    bool direct = (bitpix == SHORT_IMG) && (equivtype == USHORT_IMG) && (bscale == 1) && (bzero == 32768);
+    if (direct && compressed)
+    {
+        done = read_rice_tiles(fptr, width, height, (int)bzero, data, nThreads);
+    }
+#if !defined(OS_Windows)
+    else if (direct)
+    {
+        LONGLONG headStart = 0, dataStart = 0, dataEnd = 0;
+        if (fits_get_hduaddrll(fptr, &headStart, &dataStart, &dataEnd, &status) == 0)
         {
-            sync();
+            done = read_mapped_image(fileName, dataStart, width, height, (int)bzero, data);
         }
-        return true;
     }
-    else
+#endif
+    if (!done)
+    {
+        long fpixel[] = {1, 1};
+        status = 0;
+        fits_read_pix(fptr, TUSHORT, fpixel, (LONGLONG)width * height, NULL, data, NULL, &status);
+        done = status == 0;
+    }
+    status = 0;
+    fits_close_file(fptr, &status);
+    if (!done)
     {
-        CIMAGEDATA_DBG_ERR("Could not create file %s", full_name.c_str());
+        CIMAGEDATA_DBG_ERR("Could not read image from %s", fileName.c_str());
+        delete[] data;
+        return false;
     }
-    return false;
-}
\ No newline at end of file
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_imageData != nullptr)
+    {
+        delete[] m_imageData;
+    }
+    m_jpegData.clear();
+    sz_jpegData = -1;
+    m_imageData = data;
+    m_imageWidth = width;
+    m_imageHeight = height;
+    m_metadata = metadata;
+    jpegDirty = true;
+    m_analysis.reset();
+    return true;
+}
+
+size_t CImageData::LoadFITSBatch(const std::vector<std::string> &fileNames, const std::function<void(size_t, CImageData &)> &callback, int nThreads)
+{
+    if (nThreads <= 0)
+    {
+        nThreads = std::thread::hardware_concurrency();
+        nThreads = nThreads < 1 ? 1 : nThreads;
+    }
+    if (!fits_is_reentrant())
+    {
+        nThreads = 1;
+    }
+    if ((size_t)nThreads > fileNames.size())
+    {
+        nThreads = fileNames.size();
+    }
+    std::atomic<size_t> next(0), loaded(0);
+    // parallel over files: each file is decoded on one thread
+    int tileThreads = nThreads > 1 ? 1 : 0;
+    auto worker = [&]()
+    {
+        size_t i;
+        while ((i = next++) < fileNames.size())
+        {
+            CImageData img;
+            if (img.LoadFITS(fileNames[i], 0, tileThreads))
+            {
+                loaded++;
+                callback(i, img);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &thr : threads)
+    {
+        thr.join();
+    }
+    return loaded;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file MJPEGServer.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Live MJPEG-over-HTTP preview server implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "MJPEGServer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <stdexcept>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CMJPEGSERVER_DBG_LVL >= 3)
+#define CMJPEGSERVER_DBG_INFO(fmt, ...)                                                                      \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CMJPEGSERVER_DBG_INFO(fmt, ...)
+#endif
+
+#if (CMJPEGSERVER_DBG_LVL >= 1)
+#define CMJPEGSERVER_DBG_ERR(fmt, ...)                                                                      \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CMJPEGSERVER_DBG_ERR(fmt, ...)
+#endif
+
+#define CMJPEGSERVER_BOUNDARY "asicamframe"
+// Longest HTTP request header accepted
+#define CMJPEGSERVER_MAX_REQUEST 4096
+// Time a client has to send its request, ms
+#define CMJPEGSERVER_REQUEST_TIMEOUT 5000
+// Socket send buffer of a client, kept small so that a slow client drops frames instead of queueing them in the kernel
+#define CMJPEGSERVER_SNDBUF 65536
+
+enum
+{
+    CLIENT_REQUEST = 0, // reading the HTTP request
+    CLIENT_STREAM       // sending MJPEG parts
+};
+
+CMJPEGServer::CMJPEGServer(const std::string &address, int port, float maxRate, int maxWidth, int maxHeight, int jpegQuality)
+    : m_address(address), m_maxRate(maxRate), m_maxWidth(maxWidth < 16 ? 16 : maxWidth), m_maxHeight(maxHeight < 16 ? 16 : maxHeight), m_server(nullptr), m_pending(nullptr), m_lastSubmit(0), m_sequence(0), m_dropped(0), m_done(false)
+{
+    m_jpegQuality = jpegQuality < 10 ? 10 : (jpegQuality > 100 ? 100 : jpegQuality);
+    bool unixSocket = !address.empty() && address[0] == '/';
+    if (!unixSocket && port <= 0)
+    {
+        throw std::invalid_argument("Invalid address " + address + ":" + std::to_string(port));
+    }
+    m_server = new CFrameServer(address, unixSocket ? -1 : port, [this](CFrameServerClient &client, uint64_t now)
+                                { return ServeClient(client, now); },
+                                CMJPEGSERVER_MAX_CLIENTS, CMJPEGSERVER_SNDBUF);
+    m_encoder = std::thread(&CMJPEGServer::EncoderThread, this);
+    if (unixSocket)
+    {
+        CMJPEGSERVER_DBG_INFO("Serving preview on %s", address.c_str());
+    }
+    else
+    {
+        CMJPEGSERVER_DBG_INFO("Serving preview on http://%s:%d/", address.c_str(), port);
+    }
+}
+
+CMJPEGServer::~CMJPEGServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+    m_cond.notify_all();
+    m_encoder.join();
+    delete m_server;
+    delete m_pending;
+}
+
+bool CMJPEGServer::Submit(const CImageData &img)
+{
+    uint64_t now = CFrameServer::GetTime();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!img.HasData())
+            return false;
+        if (m_maxRate > 0 && m_lastSubmit != 0 && (now - m_lastSubmit) < (uint64_t)(1000 / m_maxRate))
+            return false;
+        m_lastSubmit = now;
+    }
+    CImageData *frame = new CImageData(img);
+    CImageData *old = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        old = m_pending;
+        m_pending = frame;
+    }
+    m_cond.notify_one();
+    delete old;
+    return true;
+}
+
+int CMJPEGServer::GetClients() const
+{
+    return m_server->GetClients();
+}
+
+uint64_t CMJPEGServer::GetDropped() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void CMJPEGServer::EncoderThread()
+{
+    while (true)
+    {
+        CImageData *frame = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]
+                        { return m_done || m_pending != nullptr; });
+            if (m_done)
+                break;
+            frame = m_pending;
+            m_pending = nullptr;
+        }
+        Buffer jpeg = CFrameServer::EncodeJPEG(*frame, m_jpegQuality, m_maxWidth, m_maxHeight);
+        delete frame;
+        if (!jpeg)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_frame = jpeg;
+            m_sequence++;
+        }
+        m_server->Wake(); // stream clients waiting for a new frame
+    }
+}
+
+static void queue_frame(CFrameServerClient &client, uint64_t sequence, const CFrameServerClient::Buffer &frame)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "--" CMJPEGSERVER_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", frame->size());
+    client.Queue(buf, frame, "\r\n");
+    client.lastSeq = sequence;
+}
+
+// Parse the request line once the headers are complete
+static void handle_request(CFrameServerClient &client, uint64_t sequence, const CFrameServerClient::Buffer &frame)
+{
+    size_t eol = client.request.find("\r\n");
+    std::string line = client.request.substr(0, eol);
+    client.request.clear();
+    client.closing = true;
+
+    char method[16], path[256];
+    if (sscanf(line.c_str(), "%15s %255s", method, path) != 2 || strcmp(method, "GET") != 0)
+    {
+        client.Queue("HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    if (strcmp(path, "/") == 0 || strcmp(path, "/stream") == 0)
+    {
+        client.Queue("HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=" CMJPEGSERVER_BOUNDARY "\r\n"
+                     "Cache-Control: no-cache, no-store\r\nPragma: no-cache\r\nConnection: close\r\n\r\n");
+        client.state = CLIENT_STREAM;
+        client.closing = false;
+    }
+    else if (strcmp(path, "/snapshot.jpg") == 0)
+    {
+        if (!frame)
+        {
+            client.Queue("HTTP/1.0 503 Service Unavailable\r\nRetry-After: 1\r\nConnection: close\r\n\r\n");
+            return;
+        }
+        char buf[160];
+        snprintf(buf, sizeof(buf), "HTTP/1.0 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\nCache-Control: no-cache, no-store\r\nConnection: close\r\n\r\n", frame->size());
+        client.Queue(buf, frame);
+        client.lastSeq = sequence;
+    }
+    else
+    {
+        client.Queue("HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n");
+    }
+}
+
+bool CMJPEGServer::ServeClient(CFrameServerClient &client, uint64_t now)
+{
+    uint64_t sequence;
+    Buffer frame;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sequence = m_sequence;
+        frame = m_frame;
+    }
+    if (client.state == CLIENT_REQUEST)
+    {
+        if (client.request.find("\r\n\r\n") != std::string::npos || client.request.find("\n\n") != std::string::npos)
+        {
+            handle_request(client, sequence, frame);
+            return true;
+        }
+        return client.request.size() <= CMJPEGSERVER_MAX_REQUEST && now - client.connected <= CMJPEGSERVER_REQUEST_TIMEOUT;
+    }
+    client.request.clear(); // nothing is expected after the request
+    // a client still sending an older frame skips the frames encoded meanwhile
+    if (frame && sequence > client.lastSeq)
+    {
+        if (client.lastSeq != 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dropped += sequence - client.lastSeq - 1;
+        }
+        queue_frame(client, sequence, frame);
+    }
+    return true;
+}
@@ -0,0 +1,402 @@
+/**
+ * @file MedianCombiner.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Tile-based median and percentile combination of frames with bounded memory implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "MedianCombiner.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <fitsio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CMEDIANCOMBINER_DBG_LVL >= 3)
+#define CMEDIANCOMBINER_DBG_INFO(fmt, ...)                                                                   \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CMEDIANCOMBINER_DBG_INFO(fmt, ...)
+#endif
+
+#if (CMEDIANCOMBINER_DBG_LVL >= 2)
+#define CMEDIANCOMBINER_DBG_WARN(fmt, ...)                                                                     \
+    {                                                                                                          \
+        fprintf(stderr, "%s:%d:%s(): " YELLOW_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                        \
+    }
+#else
+#define CMEDIANCOMBINER_DBG_WARN(fmt, ...)
+#endif
+
+#if (CMEDIANCOMBINER_DBG_LVL >= 1)
+#define CMEDIANCOMBINER_DBG_ERR(fmt, ...)                                                                   \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CMEDIANCOMBINER_DBG_ERR(fmt, ...)
+#endif
+
+static inline uint64_t getTime()
+{
+    return ((std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now())).time_since_epoch())).count());
+}
+
+// Open a FITS file at the image HDU, as CImageData::LoadFITS() does. Returns null on error.
+static fitsfile *open_image(const std::string &fileName, int hdu, long naxes[2])
+{
+    fitsfile *fptr = nullptr;
+    int status = 0, naxis = 0, bitpix = 0;
+    naxes[0] = naxes[1] = 0;
+    if (fits_open_file(&fptr, fileName.c_str(), READONLY, &status))
+    {
+        return nullptr;
+    }
+    if (hdu > 0)
+    {
+        fits_movabs_hdu(fptr, hdu, NULL, &status);
+        fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status);
+    }
+    else // first HDU with an image, e.g. after the empty primary HDU of a compressed file
+    {
+        while (!status)
+        {
+            int hdutype = 0;
+            fits_get_hdu_type(fptr, &hdutype, &status);
+            if ((hdutype == IMAGE_HDU || fits_is_compressed_image(fptr, &status)) && fits_get_img_param(fptr, 2, &bitpix, &naxis, naxes, &status) == 0 && naxis > 0)
+            {
+                break;
+            }
+            fits_movrel_hdu(fptr, 1, NULL, &status);
+        }
+    }
+    if (status || naxis != 2 || naxes[0] <= 0 || naxes[1] <= 0)
+    {
+        status = 0;
+        fits_close_file(fptr, &status);
+        return nullptr;
+    }
+    return fptr;
+}
+
+// Read rows [row, row + rows) of a FITS image of the given width, only the tiles of a compressed image
+// that hold them are decompressed. The file is opened on the first call and stays open in fptr.
+static bool read_fits_rows(fitsfile *&fptr, const std::string &fileName, int hdu, int width, int row, int rows, uint16_t *data)
+{
+    if (fptr == nullptr)
+    {
+        long naxes[2];
+        fptr = open_image(fileName, hdu, naxes);
+        if (fptr == nullptr)
+        {
+            CMEDIANCOMBINER_DBG_ERR("Could not open %s", fileName.c_str());
+            return false;
+        }
+    }
+    int status = 0, anynul = 0;
+    long blc[2] = {1, (long)row + 1}, trc[2] = {(long)width, (long)row + rows}, inc[2] = {1, 1};
+    unsigned short nulval = 0;
+    fits_read_subset(fptr, TUSHORT, blc, trc, inc, &nulval, data, &anynul, &status);
+    if (status)
+    {
+        CMEDIANCOMBINER_DBG_ERR("Could not read rows %d - %d of %s, status %d", row, row + rows - 1, fileName.c_str(), status);
+    }
+    return status == 0;
+}
+
+// Value at a fractional rank of n samples, the samples are reordered
+static inline float percentile_of(uint16_t *samples, int n, double position)
+{
+    int k = (int)position;
+    double frac = position - k;
+    std::nth_element(samples, samples + k, samples + n);
+    float value = samples[k];
+    if (frac > 0 && k + 1 < n)
+    {
+        // the samples after k are all >= samples[k], the next one is their minimum
+        uint16_t next = *std::min_element(samples + k + 1, samples + n);
+        value += (float)(frac * (next - samples[k]));
+    }
+    return value;
+}
+
+CMedianCombiner::CMedianCombiner(size_t memoryBudget, int nThreads)
+    : m_memoryBudget(memoryBudget), m_nThreads(nThreads), m_files(false), m_width(0), m_height(0)
+{
+    if (m_nThreads <= 0)
+    {
+        m_nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+bool CMedianCombiner::AddFile(const std::string &fileName, int hdu)
+{
+    long naxes[2];
+    fitsfile *fptr = open_image(fileName, hdu, naxes);
+    if (fptr == nullptr)
+    {
+        CMEDIANCOMBINER_DBG_ERR("%s: No 2-D image found", fileName.c_str());
+        return false;
+    }
+    int status = 0;
+    fits_close_file(fptr, &status);
+    Source source;
+    source.fileName = fileName;
+    source.hdu = hdu;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!AddSourceUnlocked(naxes[0], naxes[1], source))
+    {
+        return false;
+    }
+    m_files = true;
+    return true;
+}
+
+bool CMedianCombiner::AddSource(int width, int height, const CMedianCombinerReader &reader)
+{
+    if (!reader)
+    {
+        return false;
+    }
+    Source source;
+    source.hdu = 0;
+    source.reader = reader;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return AddSourceUnlocked(width, height, source);
+}
+
+bool CMedianCombiner::AddSourceUnlocked(int width, int height, const Source &source)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return false;
+    }
+    if (m_sources.size() > 0 && (width != m_width || height != m_height))
+    {
+        CMEDIANCOMBINER_DBG_ERR("Frame is %d x %d, the first frame is %d x %d", width, height, m_width, m_height);
+        return false;
+    }
+    m_width = width;
+    m_height = height;
+    m_sources.push_back(source);
+    return true;
+}
+
+bool CMedianCombiner::Combine(std::vector<float> &data, float percentile) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return CombineUnlocked(data, percentile);
+}
+
+bool CMedianCombiner::CombineUnlocked(std::vector<float> &data, float percentile) const
+{
+    int nFrames = m_sources.size();
+    if (nFrames == 0)
+    {
+        return false;
+    }
+    percentile = percentile < 0 ? 0 : (percentile > 100 ? 100 : percentile);
+    double position = percentile / 100.0 * (nFrames - 1);
+
+    int nThreads = m_nThreads;
+    if (m_files && !fits_is_reentrant())
+    {
+        nThreads = 1;
+    }
+    // tile height from the memory budget: every thread holds the tile of every frame
+    size_t rowBytes = (size_t)m_width * sizeof(uint16_t) * nFrames;
+    int tileRows = (int)std::min((size_t)m_height, m_memoryBudget / nThreads / rowBytes);
+    if (tileRows < 1)
+    {
+        CMEDIANCOMBINER_DBG_WARN("Memory budget of %zu bytes is below one row of every frame per thread, using %zu bytes", m_memoryBudget, rowBytes * nThreads);
+        tileRows = 1;
+    }
+    int nTiles = (m_height + tileRows - 1) / tileRows;
+    nThreads = std::min(nThreads, nTiles);
+
+    try
+    {
+        data.resize((size_t)m_width * m_height);
+    }
+    catch (const std::bad_alloc &)
+    {
+        CMEDIANCOMBINER_DBG_ERR("Could not allocate the output image");
+        return false;
+    }
+
+    uint64_t start = getTime();
+    std::atomic<int> nextTile(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&]()
+    {
+        std::vector<uint16_t> tile;
+        std::vector<uint16_t> samples(nFrames);
+        std::vector<fitsfile *> files(nFrames, nullptr); // opened at the first tile, closed at the end
+        try
+        {
+            tile.resize((size_t)tileRows * m_width * nFrames);
+        }
+        catch (const std::bad_alloc &)
+        {
+            CMEDIANCOMBINER_DBG_ERR("Could not allocate a tile of %d rows", tileRows);
+            failed = true;
+            return;
+        }
+        int t;
+        while (!failed && (t = nextTile++) < nTiles)
+        {
+            int row = t * tileRows;
+            int rows = std::min(tileRows, m_height - row);
+            size_t tilePixels = (size_t)rows * m_width;
+            // frame-major: the rows of frame f at f * tilePixels
+            for (int f = 0; f < nFrames && !failed; f++)
+            {
+                const Source &source = m_sources[f];
+                uint16_t *band = tile.data() + f * tilePixels;
+                bool ok = source.fileName.empty() ? source.reader(row, rows, band) : read_fits_rows(files[f], source.fileName, source.hdu, m_width, row, rows, band);
+                if (!ok)
+                {
+                    failed = true;
+                }
+            }
+            if (failed)
+                break;
+            float *dst = data.data() + (size_t)row * m_width;
+            for (size_t p = 0; p < tilePixels; p++)
+            {
+                // consecutive pixels read neighbouring words of every frame, which stay in cache
+                for (int f = 0; f < nFrames; f++)
+                {
+                    samples[f] = tile[f * tilePixels + p];
+                }
+                dst[p] = percentile_of(samples.data(), nFrames, position);
+            }
+        }
+        for (fitsfile *fptr : files)
+        {
+            int status = 0;
+            if (fptr != nullptr)
+                fits_close_file(fptr, &status);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &thr : threads)
+    {
+        thr.join();
+    }
+    if (failed)
+    {
+        return false;
+    }
+    CMEDIANCOMBINER_DBG_INFO("Combined %d frames of %d x %d in %d tiles of %d rows on %d threads, %" PRIu64 " ms", nFrames, m_width, m_height, nTiles, tileRows, nThreads, getTime() - start);
+    return true;
+}
+
+bool CMedianCombiner::SaveFITS(const std::string &fileName, float percentile, const CImageMetadata *metadata) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<float> data;
+    if (!CombineUnlocked(data, percentile))
+    {
+        CMEDIANCOMBINER_DBG_ERR("Could not combine the frames for %s", fileName.c_str());
+        return false;
+    }
+
+    fitsfile *fptr = nullptr;
+    int status = 0;
+    if (fits_create_file(&fptr, ("!" + fileName).c_str(), &status))
+    {
+        CMEDIANCOMBINER_DBG_ERR("Could not create %s, status %d", fileName.c_str(), status);
+        return false;
+    }
+    long naxes[2] = {(long)m_width, (long)m_height};
+    const char *combineName = percentile == 50 ? "MEDIAN" : "PERCENTILE";
+    int frames = m_sources.size();
+
+    fits_create_img(fptr, FLOAT_IMG, 2, naxes, &status);
+    fits_write_key(fptr, TSTRING, "COMBINE", (void *)combineName, "Combination of the frames", &status);
+    fits_write_key(fptr, TFLOAT, "PERCENT", &percentile, "Percentile of the frames", &status);
+    fits_write_key(fptr, TINT, "NFRAMES", &frames, "Number of frames", &status);
+    if (metadata != nullptr)
+    {
+        CImageMetadata meta = *metadata; // cfitsio takes non-const pointers
+        unsigned int exposureTime = meta.exposureTime * 1000000U;
+        fits_write_key(fptr, TSTRING, "CAMERA", (void *)(meta.cameraName.c_str()), NULL, &status);
+        fits_write_key(fptr, TLONGLONG, "TIMESTAMP", &(meta.timestamp), NULL, &status);
+        fits_write_key(fptr, TFLOAT, "CCDTEMP", &(meta.temperature), NULL, &status);
+        fits_write_key(fptr, TUINT, "EXPOSURE_US", &(exposureTime), NULL, &status);
+        fits_write_key(fptr, TUINT, "ORIGIN_X", &(meta.imgLeft), NULL, &status);
+        fits_write_key(fptr, TUINT, "ORIGIN_Y", &(meta.imgTop), NULL, &status);
+        fits_write_key(fptr, TUSHORT, "BINX", &(meta.binX), NULL, &status);
+        fits_write_key(fptr, TUSHORT, "BINY", &(meta.binY), NULL, &status);
+        fits_write_key(fptr, TLONGLONG, "GAIN", &(meta.gain), NULL, &status);
+        fits_write_key(fptr, TLONGLONG, "OFFSET", &(meta.offset), NULL, &status);
+    }
+    long fpixel[] = {1, 1};
+    fits_write_pix(fptr, TFLOAT, fpixel, data.size(), data.data(), &status);
+    if (status)
+    {
+        CMEDIANCOMBINER_DBG_ERR("Could not write %s, status %d", fileName.c_str(), status);
+        int status2 = 0;
+        fits_delete_file(fptr, &status2);
+        return false;
+    }
+    fits_close_file(fptr, &status);
+    if (status)
+    {
+        CMEDIANCOMBINER_DBG_ERR("Error closing %s, status %d", fileName.c_str(), status);
+        return false;
+    }
+    return true;
+}
+
+int CMedianCombiner::GetFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sources.size();
+}
+
+int CMedianCombiner::GetWidth() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_width;
+}
+
+int CMedianCombiner::GetHeight() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_height;
+}
+
+void CMedianCombiner::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sources.clear();
+    m_files = false;
+    m_width = m_height = 0;
+}
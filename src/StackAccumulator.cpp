@@ -0,0 +1,366 @@
+/**
+ * @file StackAccumulator.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Streaming frame stacker with wide accumulators implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "StackAccumulator.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fitsio.h>
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CSTACKACCUMULATOR_DBG_LVL >= 3)
+#define CSTACKACCUMULATOR_DBG_INFO(fmt, ...)                                                                 \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CSTACKACCUMULATOR_DBG_INFO(fmt, ...)
+#endif
+
+#if (CSTACKACCUMULATOR_DBG_LVL >= 1)
+#define CSTACKACCUMULATOR_DBG_ERR(fmt, ...)                                                                 \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CSTACKACCUMULATOR_DBG_ERR(fmt, ...)
+#endif
+
+#ifndef CSTACKACCUMULATOR_MT_PIXELS
+// Frames with at least this many pixels are accumulated in parallel blocks when more than one CPU is available
+#define CSTACKACCUMULATOR_MT_PIXELS (1 << 20)
+#endif
+
+// Sample value in the accumulator type
+static inline uint32_t Sample(uint16_t v, float, uint32_t *)
+{
+    return v;
+}
+
+static inline double Sample(uint16_t v, float scale, double *)
+{
+    return (double)v * scale;
+}
+
+// Add pixels [begin, end) of a frame to the sums. sumsq is null without the sum of squares,
+// clip2 is the square of the clipping threshold, 0 without clipping.
+template <typename S, typename Q>
+static void AccumulateBlock(const uint16_t *src, size_t begin, size_t end, float scale, S *sum, Q *sumsq, uint16_t *count, S *rejSum, uint16_t *rejCount, double clip2, int minFrames)
+{
+    if (sumsq == nullptr)
+    {
+        // branchless, vectorized by the compiler
+        for (size_t i = begin; i < end; i++)
+        {
+            uint16_t valid = src[i] != 0xffff;
+            sum[i] += valid ? Sample(src[i], scale, sum) : 0;
+            count[i] += valid;
+        }
+        return;
+    }
+    double floor = (double)scale * scale; // variance of at least one count, identical samples do not reject everything else
+    for (size_t i = begin; i < end; i++)
+    {
+        if (src[i] == 0xffff)
+            continue;
+        S x = Sample(src[i], scale, sum);
+        uint16_t n = count[i];
+        if (clip2 > 0 && n >= minFrames)
+        {
+            double mean = (double)sum[i] / n;
+            double var = std::max(floor, ((double)sumsq[i] - mean * (double)sum[i]) / (n - 1));
+            double d = (double)x - mean;
+            if (d * d > clip2 * var)
+            {
+                rejSum[i] += x;
+                rejCount[i]++;
+                continue;
+            }
+        }
+        sum[i] += x;
+        sumsq[i] += (Q)x * x;
+        count[i]++;
+    }
+}
+
+// Combine the sums of pixels [begin, end)
+template <typename S>
+static void CombineBlock(size_t begin, size_t end, CStackCombine combine, int frames, const S *sum, const uint16_t *count, const S *rejSum, const uint16_t *rejCount, float *dst)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        double s = sum[i];
+        unsigned int n = count[i];
+        if (rejCount != nullptr && (combine != STACK_SIGMA_CLIPPED || n == 0))
+        {
+            // everything, or the rejected samples if none were accepted
+            s += rejSum[i];
+            n += rejCount[i];
+        }
+        double mean = n > 0 ? s / n : NAN;
+        dst[i] = (float)(combine == STACK_SUM ? mean * frames : mean);
+    }
+}
+
+// Run fcn(begin, end) over blocks of count pixels, in parallel for large frames
+template <typename F>
+static void ForBlocks(size_t count, F fcn)
+{
+    unsigned int nThreads = 1;
+    if (count >= CSTACKACCUMULATOR_MT_PIXELS)
+    {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < nThreads; t++)
+    {
+        threads.push_back(std::thread(fcn, count * t / nThreads, count * (t + 1) / nThreads));
+    }
+    fcn(0, count / nThreads);
+    for (auto &thr : threads)
+    {
+        thr.join();
+    }
+}
+
+CStackAccumulator::CStackAccumulator(CStackAccumulatorType type, bool sumSquares, float clipSigma, int clipMinFrames)
+    : m_type(type), m_sumSquares(sumSquares || clipSigma > 0), m_clipSigma(clipSigma > 0 ? clipSigma : 0), m_clipMinFrames(clipMinFrames < 3 ? 3 : clipMinFrames), m_width(0), m_height(0), m_frames(0), m_lastTimestamp(0)
+{
+}
+
+bool CStackAccumulator::Allocate(int width, int height)
+{
+    size_t npix = (size_t)width * height;
+    try
+    {
+        if (m_type == STACK_INT32)
+        {
+            m_sumInt.assign(npix, 0);
+            if (m_sumSquares)
+                m_sumSqInt.assign(npix, 0);
+            if (m_clipSigma > 0)
+                m_rejectInt.assign(npix, 0);
+        }
+        else
+        {
+            m_sumFloat.assign(npix, 0);
+            if (m_sumSquares)
+                m_sumSqFloat.assign(npix, 0);
+            if (m_clipSigma > 0)
+                m_rejectFloat.assign(npix, 0);
+        }
+        m_count.assign(npix, 0);
+        if (m_clipSigma > 0)
+            m_rejectCount.assign(npix, 0);
+    }
+    catch (const std::bad_alloc &)
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Could not allocate the sums for %d x %d pixels", width, height);
+        Free();
+        return false;
+    }
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+bool CStackAccumulator::Add(const CImageData &img, float scale)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint16_t *src = img.GetImageData();
+    if (src == nullptr)
+    {
+        return false;
+    }
+    if (m_type == STACK_INT32 && scale != 1)
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Scaled frames need a STACK_FLOAT accumulator");
+        return false;
+    }
+    if (m_frames >= CSTACKACCUMULATOR_MAX_FRAMES)
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Stack is full (%d frames)", m_frames);
+        return false;
+    }
+    if (m_frames == 0)
+    {
+        if (!Allocate(img.GetImageWidth(), img.GetImageHeight()))
+            return false;
+        m_metadata = img.GetImageMetadata();
+        m_metadata.exposureTime = 0;
+    }
+    else if (img.GetImageWidth() != m_width || img.GetImageHeight() != m_height)
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Frame is %d x %d, stack is %d x %d", img.GetImageWidth(), img.GetImageHeight(), m_width, m_height);
+        return false;
+    }
+
+    double clip2 = (double)m_clipSigma * m_clipSigma;
+    if (m_type == STACK_INT32)
+    {
+        ForBlocks((size_t)m_width * m_height, [&](size_t begin, size_t end)
+                  { AccumulateBlock(src, begin, end, scale, m_sumInt.data(), m_sumSquares ? m_sumSqInt.data() : (uint64_t *)nullptr, m_count.data(), m_rejectInt.data(), m_rejectCount.data(), clip2, m_clipMinFrames); });
+    }
+    else
+    {
+        ForBlocks((size_t)m_width * m_height, [&](size_t begin, size_t end)
+                  { AccumulateBlock(src, begin, end, scale, m_sumFloat.data(), m_sumSquares ? m_sumSqFloat.data() : (double *)nullptr, m_count.data(), m_rejectFloat.data(), m_rejectCount.data(), clip2, m_clipMinFrames); });
+    }
+    m_frames++;
+    m_metadata.exposureTime += img.GetExposure();
+    m_lastTimestamp = img.GetTimestamp();
+    return true;
+}
+
+bool CStackAccumulator::GetImage(CStackCombine combine, std::vector<float> &data) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return GetImageUnlocked(combine, data);
+}
+
+bool CStackAccumulator::GetImageUnlocked(CStackCombine combine, std::vector<float> &data) const
+{
+    if (m_frames == 0)
+    {
+        return false;
+    }
+    size_t npix = (size_t)m_width * m_height;
+    data.resize(npix);
+    const uint16_t *rejCount = m_clipSigma > 0 ? m_rejectCount.data() : nullptr;
+    if (m_type == STACK_INT32)
+    {
+        ForBlocks(npix, [&](size_t begin, size_t end)
+                  { CombineBlock(begin, end, combine, m_frames, m_sumInt.data(), m_count.data(), m_rejectInt.data(), rejCount, data.data()); });
+    }
+    else
+    {
+        ForBlocks(npix, [&](size_t begin, size_t end)
+                  { CombineBlock(begin, end, combine, m_frames, m_sumFloat.data(), m_count.data(), m_rejectFloat.data(), rejCount, data.data()); });
+    }
+    return true;
+}
+
+bool CStackAccumulator::SaveFITS(const std::string &fileName, CStackCombine combine) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<float> data;
+    if (!GetImageUnlocked(combine, data))
+    {
+        CSTACKACCUMULATOR_DBG_ERR("No frames to save to %s", fileName.c_str());
+        return false;
+    }
+
+    fitsfile *fptr = nullptr;
+    int status = 0;
+    if (fits_create_file(&fptr, ("!" + fileName).c_str(), &status))
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Could not create %s, status %d", fileName.c_str(), status);
+        return false;
+    }
+    long naxes[2] = {(long)m_width, (long)m_height};
+    CImageMetadata metadata = m_metadata; // cfitsio takes non-const pointers
+    const char *combineName = combine == STACK_SUM ? "SUM" : (combine == STACK_SIGMA_CLIPPED && m_clipSigma > 0 ? "SIGMA_CLIPPED" : "MEAN");
+    int frames = m_frames;
+    uint64_t lastTimestamp = m_lastTimestamp;
+    float clipSigma = m_clipSigma;
+
+    fits_create_img(fptr, FLOAT_IMG, 2, naxes, &status);
+    fits_write_key(fptr, TSTRING, "CAMERA", (void *)(metadata.cameraName.c_str()), NULL, &status);
+    fits_write_key(fptr, TSTRING, "COMBINE", (void *)combineName, "Combination of the frames", &status);
+    fits_write_key(fptr, TINT, "NFRAMES", &frames, "Number of frames", &status);
+    fits_write_key(fptr, TLONGLONG, "TIMESTAMP", &(metadata.timestamp), "First frame", &status);
+    fits_write_key(fptr, TLONGLONG, "TIMESTAMP_END", &lastTimestamp, "Last frame", &status);
+    fits_write_key(fptr, TDOUBLE, "EXPTOTAL", &(metadata.exposureTime), "Total exposure of the frames, s", &status);
+    if (m_clipSigma > 0)
+    {
+        fits_write_key(fptr, TFLOAT, "CLIPSIG", &clipSigma, "Sigma clipping threshold", &status);
+    }
+    fits_write_key(fptr, TFLOAT, "CCDTEMP", &(metadata.temperature), NULL, &status);
+    fits_write_key(fptr, TUINT, "ORIGIN_X", &(metadata.imgLeft), NULL, &status);
+    fits_write_key(fptr, TUINT, "ORIGIN_Y", &(metadata.imgTop), NULL, &status);
+    fits_write_key(fptr, TUSHORT, "BINX", &(metadata.binX), NULL, &status);
+    fits_write_key(fptr, TUSHORT, "BINY", &(metadata.binY), NULL, &status);
+    fits_write_key(fptr, TLONGLONG, "GAIN", &(metadata.gain), NULL, &status);
+    fits_write_key(fptr, TLONGLONG, "OFFSET", &(metadata.offset), NULL, &status);
+    long fpixel[] = {1, 1};
+    fits_write_pix(fptr, TFLOAT, fpixel, data.size(), data.data(), &status);
+    if (status)
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Could not write %s, status %d", fileName.c_str(), status);
+        int status2 = 0;
+        fits_delete_file(fptr, &status2);
+        return false;
+    }
+    fits_close_file(fptr, &status);
+    if (status)
+    {
+        CSTACKACCUMULATOR_DBG_ERR("Error closing %s, status %d", fileName.c_str(), status);
+        return false;
+    }
+    CSTACKACCUMULATOR_DBG_INFO("Saved %s stack of %d frames to %s", combineName, frames, fileName.c_str());
+    return true;
+}
+
+int CStackAccumulator::GetFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frames;
+}
+
+int CStackAccumulator::GetWidth() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_width;
+}
+
+int CStackAccumulator::GetHeight() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_height;
+}
+
+CImageMetadata CStackAccumulator::GetImageMetadata() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_metadata;
+}
+
+void CStackAccumulator::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Free();
+}
+
+void CStackAccumulator::Free()
+{
+    // assign empty vectors, clear() keeps the memory
+    m_width = m_height = 0;
+    m_frames = 0;
+    m_lastTimestamp = 0;
+    m_sumInt = std::vector<uint32_t>();
+    m_sumFloat = std::vector<double>();
+    m_sumSqInt = std::vector<uint64_t>();
+    m_sumSqFloat = std::vector<double>();
+    m_count = std::vector<uint16_t>();
+    m_rejectInt = std::vector<uint32_t>();
+    m_rejectFloat = std::vector<double>();
+    m_rejectCount = std::vector<uint16_t>();
+}
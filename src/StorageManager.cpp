@@ -0,0 +1,387 @@
+/**
+ * @file StorageManager.cpp
+ * @author Sunip K. Mukherjee (sunipkmukherjee@gmail.com)
+ * @brief Dated output directories with quota and retention implementation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+#include "StorageManager.hpp"
+#include "FileNameRegistry.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include <stdexcept>
+
+#define YELLOW_FG "\033[33m"
+#define RED_FG "\033[31m"
+#define CYAN_FG "\033[36m"
+#define RESET "\033[0m"
+
+#if (CSTORAGEMANAGER_DBG_LVL >= 3)
+#define CSTORAGEMANAGER_DBG_INFO(fmt, ...)                                                                   \
+    {                                                                                                        \
+        fprintf(stderr, "%s:%d:%s(): " CYAN_FG fmt RESET "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                      \
+    }
+#else
+#define CSTORAGEMANAGER_DBG_INFO(fmt, ...)
+#endif
+
+#if (CSTORAGEMANAGER_DBG_LVL >= 2)
+#define CSTORAGEMANAGER_DBG_WARN(fmt, ...)                                                                     \
+    {                                                                                                          \
+        fprintf(stderr, "%s:%d:%s(): " YELLOW_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                        \
+    }
+#else
+#define CSTORAGEMANAGER_DBG_WARN(fmt, ...)
+#endif
+
+#if (CSTORAGEMANAGER_DBG_LVL >= 1)
+#define CSTORAGEMANAGER_DBG_ERR(fmt, ...)                                                                   \
+    {                                                                                                       \
+        fprintf(stderr, "%s:%d:%s(): " RED_FG fmt "\n" RESET, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                                     \
+    }
+#else
+#define CSTORAGEMANAGER_DBG_ERR(fmt, ...)
+#endif
+
+#define FREE_SPACE_CHECK_INTERVAL 10 // seconds
+#define USAGE_SCAN_INTERVAL 60       // seconds
+
+static bool is_dated_name(const char *name)
+{
+    int i;
+    for (i = 0; name[i] != '\0'; i++)
+    {
+        if (i >= 8 || !isdigit((unsigned char)name[i]))
+        {
+            return false;
+        }
+    }
+    return i == 8;
+}
+
+// Disk usage of a directory tree in bytes
+static uint64_t dir_usage(const std::string &path)
+{
+    uint64_t total = 0;
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+    {
+        return 0;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+        std::string child = path + "/" + ent->d_name;
+        struct stat st;
+        if (lstat(child.c_str(), &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            total += dir_usage(child);
+        }
+        else
+        {
+            total += (uint64_t)st.st_blocks * 512;
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+// Equivalent of rm -rf, without forking a shell
+static bool remove_tree(const std::string &path)
+{
+    bool ret = true;
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+    {
+        return unlink(path.c_str()) == 0;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+        std::string child = path + "/" + ent->d_name;
+        struct stat st;
+        if (lstat(child.c_str(), &st) != 0)
+        {
+            ret = false;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            ret = remove_tree(child) && ret;
+        }
+        else if (unlink(child.c_str()) != 0)
+        {
+            ret = false;
+        }
+    }
+    closedir(dir);
+    return (rmdir(path.c_str()) == 0) && ret;
+}
+
+bool CStorageManager::MakeDirectories(const std::string &path, mode_t mode)
+{
+    if (path.length() == 0)
+    {
+        return false;
+    }
+    size_t pos = 0;
+    while (pos != std::string::npos)
+    {
+        pos = path.find('/', pos + 1);
+        std::string prefix = path.substr(0, pos);
+        if (mkdir(prefix.c_str(), mode) != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+    }
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) && S_ISDIR(st.st_mode);
+}
+
+CStorageManager::CStorageManager(const std::string &rootDir, int rolloverHour, bool useUTC, uint64_t quotaBytes, uint64_t minFreeBytes)
+    : m_root(rootDir), m_rolloverHour(rolloverHour), m_useUTC(useUTC), m_quotaBytes(quotaBytes), m_minFreeBytes(minFreeBytes), m_currentName(""), m_currentDir(""), m_validFrom(0), m_validUntil(0), m_lastFreeCheck(0), m_lastScan(0), m_totalUsage(0)
+{
+    while (m_root.length() > 1 && m_root[m_root.length() - 1] == '/')
+    {
+        m_root.erase(m_root.length() - 1);
+    }
+    if (m_rolloverHour < 0 || m_rolloverHour > 23)
+    {
+        throw std::invalid_argument("Rollover hour must be between 0 and 23");
+    }
+    if (!MakeDirectories(m_root))
+    {
+        CSTORAGEMANAGER_DBG_ERR("Could not create root directory %s: %s", m_root.c_str(), strerror(errno));
+        throw std::runtime_error("Could not create root directory " + m_root);
+    }
+    ScanUnlocked();
+}
+
+void CStorageManager::ScanUnlocked()
+{
+    m_usage.clear();
+    m_totalUsage = 0;
+    DIR *dir = opendir(m_root.c_str());
+    if (dir == nullptr)
+    {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        if (!is_dated_name(ent->d_name))
+        {
+            continue;
+        }
+        std::string path = m_root + "/" + ent->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        {
+            continue;
+        }
+        uint64_t usage = dir_usage(path);
+        m_usage[ent->d_name] = usage;
+        m_totalUsage += usage;
+    }
+    closedir(dir);
+    CSTORAGEMANAGER_DBG_INFO("%s: %zu dated directories, %.1f MiB", m_root.c_str(), m_usage.size(), m_totalUsage / 1048576.0);
+}
+
+std::string CStorageManager::DateName(time_t tnow, time_t &validFrom, time_t &validUntil) const
+{
+    time_t shifted = tnow - (time_t)m_rolloverHour * 3600;
+    struct tm tm_;
+    if (m_useUTC)
+    {
+        gmtime_r(&shifted, &tm_);
+    }
+    else
+    {
+        localtime_r(&shifted, &tm_);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%04d%02d%02d", tm_.tm_year + 1900, tm_.tm_mon + 1, tm_.tm_mday);
+
+    // directory is valid from the rollover hour of its date to the rollover hour of the next date
+    struct tm start = tm_;
+    start.tm_hour = m_rolloverHour;
+    start.tm_min = 0;
+    start.tm_sec = 0;
+    start.tm_isdst = -1;
+    struct tm end = start;
+    end.tm_mday += 1;
+    if (m_useUTC)
+    {
+        validFrom = timegm(&start);
+        validUntil = timegm(&end);
+    }
+    else
+    {
+        validFrom = mktime(&start);
+        validUntil = mktime(&end);
+    }
+    return name;
+}
+
+std::string CStorageManager::GetDirectory(time_t tnow)
+{
+    if (tnow == 0)
+    {
+        tnow = time(NULL);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_currentDir.length() > 0 && tnow >= m_validFrom && tnow < m_validUntil)
+    {
+        return m_currentDir; // cached, no file system access
+    }
+    std::string name = DateName(tnow, m_validFrom, m_validUntil);
+    std::string path = m_root + "/" + name;
+    if (!MakeDirectories(path))
+    {
+        CSTORAGEMANAGER_DBG_ERR("Could not create directory %s: %s", path.c_str(), strerror(errno));
+        m_currentDir = "";
+        throw std::runtime_error("Could not create directory " + path);
+    }
+    if (name != m_currentName)
+    {
+        CSTORAGEMANAGER_DBG_INFO("Saving to %s", path.c_str());
+    }
+    m_currentName = name;
+    m_currentDir = path;
+    if (m_usage.find(name) == m_usage.end())
+    {
+        m_usage[name] = 0;
+    }
+    EnforceQuotaUnlocked();
+    return m_currentDir;
+}
+
+void CStorageManager::Invalidate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_currentDir = "";
+}
+
+void CStorageManager::Account(const std::string &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return;
+    }
+    Account((uint64_t)st.st_blocks * 512);
+}
+
+void CStorageManager::Account(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_currentName.length() > 0)
+    {
+        m_usage[m_currentName] += bytes;
+    }
+    m_totalUsage += bytes;
+    EnforceQuotaUnlocked();
+}
+
+void CStorageManager::Update()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    time_t now = time(NULL);
+    if (m_currentDir.length() > 0 && (now - m_lastScan >= USAGE_SCAN_INTERVAL || now < m_lastScan))
+    {
+        m_lastScan = now;
+        uint64_t usage = dir_usage(m_currentDir);
+        uint64_t &current = m_usage[m_currentName];
+        m_totalUsage = m_totalUsage - current + usage;
+        current = usage;
+    }
+    EnforceQuotaUnlocked();
+}
+
+int CStorageManager::EnforceQuota()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastFreeCheck = 0; // force a free space check
+    return EnforceQuotaUnlocked();
+}
+
+int CStorageManager::EnforceQuotaUnlocked()
+{
+    bool over = (m_quotaBytes > 0) && (m_totalUsage > m_quotaBytes);
+    bool low = false;
+    if (m_minFreeBytes > 0)
+    {
+        time_t now = time(NULL);
+        if (now - m_lastFreeCheck >= FREE_SPACE_CHECK_INTERVAL || now < m_lastFreeCheck)
+        {
+            m_lastFreeCheck = now;
+            low = GetFreeSpace() < m_minFreeBytes;
+        }
+    }
+    int deleted = 0;
+    while (over || low)
+    {
+        auto oldest = m_usage.begin();
+        // never delete the current directory (or anything dated after it)
+        if (oldest == m_usage.end() || m_currentName.length() == 0 || oldest->first >= m_currentName)
+        {
+            CSTORAGEMANAGER_DBG_WARN("%s: No more directories to delete, usage %.1f MiB, free %.1f MiB", m_root.c_str(), m_totalUsage / 1048576.0, GetFreeSpace() / 1048576.0);
+            break;
+        }
+        std::string path = m_root + "/" + oldest->first;
+        CSTORAGEMANAGER_DBG_WARN("Deleting %s (%.1f MiB)", path.c_str(), oldest->second / 1048576.0);
+        if (!remove_tree(path))
+        {
+            CSTORAGEMANAGER_DBG_ERR("Could not delete all of %s", path.c_str());
+        }
+        CFileNameRegistry::Instance().Forget(path);
+        m_totalUsage -= oldest->second < m_totalUsage ? oldest->second : m_totalUsage;
+        m_usage.erase(oldest);
+        deleted++;
+        over = (m_quotaBytes > 0) && (m_totalUsage > m_quotaBytes);
+        low = (m_minFreeBytes > 0) && (GetFreeSpace() < m_minFreeBytes);
+    }
+    return deleted;
+}
+
+uint64_t CStorageManager::GetUsage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_totalUsage;
+}
+
+uint64_t CStorageManager::GetFreeSpace() const
+{
+    struct statvfs st;
+    if (statvfs(m_root.c_str(), &st) != 0)
+    {
+        return 0;
+    }
+    return (uint64_t)st.f_bavail * st.f_frsize;
+}
@@ -14,6 +14,32 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+#ifndef JPGE_NO_SIMD
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define JPGE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define JPGE_AVX2
+#define JPGE_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define JPGE_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 #define JPGE_MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define JPGE_MIN(a, b) (((a) < (b)) ? (a) : (b))
 
@@ -32,6 +58,8 @@ namespace jpge
         M_EOI = 0xD9,
         M_SOS = 0xDA,
         M_DQT = 0xDB,
+        M_DRI = 0xDD,
+        M_RST0 = 0xD0,
         M_APP0 = 0xE0
     };
     enum
@@ -196,6 +224,595 @@ namespace jpge
         }
     }
 
+    // SIMD kernels. The DCT runs the DCT1D() butterflies on 4 or 8 rows/columns at once, with the same int16 truncation
+    // of the multiplicands as DCT_MUL(), and the quantizer divides in single precision, which is exact after truncation
+    // for dividends below 2^15, so the output is bit-exact with the scalar code.
+#define JPGE_DCT1D_SIMD(V, ADD, SUB, MUL, s0, s1, s2, s3, s4, s5, s6, s7)                                               \
+    {                                                                                                                    \
+        V t0 = ADD(s0, s7), t7 = SUB(s0, s7), t1 = ADD(s1, s6), t6 = SUB(s1, s6);                                        \
+        V t2 = ADD(s2, s5), t5 = SUB(s2, s5), t3 = ADD(s3, s4), t4 = SUB(s3, s4);                                        \
+        V t10 = ADD(t0, t3), t13 = SUB(t0, t3), t11 = ADD(t1, t2), t12 = SUB(t1, t2);                                    \
+        V u1 = MUL(ADD(t12, t13), 4433);                                                                                 \
+        s2 = ADD(u1, MUL(t13, 6270));                                                                                    \
+        s6 = ADD(u1, MUL(t12, -15137));                                                                                  \
+        u1 = ADD(t4, t7);                                                                                                \
+        V u2 = ADD(t5, t6), u3 = ADD(t4, t6), u4 = ADD(t5, t7);                                                          \
+        V z5 = MUL(ADD(u3, u4), 9633);                                                                                   \
+        t4 = MUL(t4, 2446);                                                                                              \
+        t5 = MUL(t5, 16819);                                                                                             \
+        t6 = MUL(t6, 25172);                                                                                             \
+        t7 = MUL(t7, 12299);                                                                                             \
+        u1 = MUL(u1, -7373);                                                                                             \
+        u2 = MUL(u2, -20995);                                                                                            \
+        u3 = MUL(u3, -16069);                                                                                            \
+        u4 = MUL(u4, -3196);                                                                                             \
+        u3 = ADD(u3, z5);                                                                                                \
+        u4 = ADD(u4, z5);                                                                                                \
+        s0 = ADD(t10, t11);                                                                                              \
+        s1 = ADD(ADD(t7, u1), u4);                                                                                       \
+        s3 = ADD(ADD(t6, u2), u3);                                                                                       \
+        s4 = SUB(t10, t11);                                                                                              \
+        s5 = ADD(ADD(t5, u2), u4);                                                                                       \
+        s7 = ADD(ADD(t4, u1), u3);                                                                                       \
+    }
+
+    // Offsets of the 8 or 16 samples of one component in a row of interleaved YCbCr (or RGB) pixels.
+    static const uint8 s_stride3[16] = {0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45};
+    // Rounding of the 2x2 chroma averages in load_block_16_8(), alternating between columns and rows.
+    static const uint16 s_round_16_8[2][8] = {{0, 2, 0, 2, 0, 2, 0, 2}, {2, 0, 2, 0, 2, 0, 2, 0}};
+
+#ifdef JPGE_SSE2
+    // madd of the low 16 bits of each lane with c and of the high 16 bits with 0 is DCT_MUL().
+#define JPGE_SSE2_MUL(x, c) _mm_madd_epi16(x, _mm_set1_epi32((c)&0xFFFF))
+#define JPGE_SSE2_DESCALE(x, n) _mm_srai_epi32(_mm_add_epi32(x, _mm_set1_epi32(1 << ((n)-1))), n)
+
+    static inline void transpose_4x4_sse2(__m128i &a, __m128i &b, __m128i &c, __m128i &d)
+    {
+        __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpacklo_epi32(c, d);
+        __m128i t2 = _mm_unpackhi_epi32(a, b), t3 = _mm_unpackhi_epi32(c, d);
+        a = _mm_unpacklo_epi64(t0, t1);
+        b = _mm_unpackhi_epi64(t0, t1);
+        c = _mm_unpacklo_epi64(t2, t3);
+        d = _mm_unpackhi_epi64(t2, t3);
+    }
+
+    // m[h][i] holds columns 4h to 4h + 3 of row i.
+    static inline void transpose_8x8_sse2(__m128i m[2][8])
+    {
+        transpose_4x4_sse2(m[0][0], m[0][1], m[0][2], m[0][3]);
+        transpose_4x4_sse2(m[1][4], m[1][5], m[1][6], m[1][7]);
+        transpose_4x4_sse2(m[1][0], m[1][1], m[1][2], m[1][3]);
+        transpose_4x4_sse2(m[0][4], m[0][5], m[0][6], m[0][7]);
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i t = m[1][i];
+            m[1][i] = m[0][4 + i];
+            m[0][4 + i] = t;
+        }
+    }
+
+    static void DCT2D_sse2(int32 *p)
+    {
+        __m128i m[2][8];
+        for (int i = 0; i < 8; i++)
+        {
+            m[0][i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 8));
+            m[1][i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 8 + 4));
+        }
+        transpose_8x8_sse2(m);
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i *s = m[h];
+            JPGE_DCT1D_SIMD(__m128i, _mm_add_epi32, _mm_sub_epi32, JPGE_SSE2_MUL, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+            s[0] = _mm_slli_epi32(s[0], ROW_BITS);
+            s[1] = JPGE_SSE2_DESCALE(s[1], CONST_BITS - ROW_BITS);
+            s[2] = JPGE_SSE2_DESCALE(s[2], CONST_BITS - ROW_BITS);
+            s[3] = JPGE_SSE2_DESCALE(s[3], CONST_BITS - ROW_BITS);
+            s[4] = _mm_slli_epi32(s[4], ROW_BITS);
+            s[5] = JPGE_SSE2_DESCALE(s[5], CONST_BITS - ROW_BITS);
+            s[6] = JPGE_SSE2_DESCALE(s[6], CONST_BITS - ROW_BITS);
+            s[7] = JPGE_SSE2_DESCALE(s[7], CONST_BITS - ROW_BITS);
+        }
+        transpose_8x8_sse2(m);
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i *s = m[h];
+            JPGE_DCT1D_SIMD(__m128i, _mm_add_epi32, _mm_sub_epi32, JPGE_SSE2_MUL, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+            s[0] = JPGE_SSE2_DESCALE(s[0], ROW_BITS + 3);
+            s[1] = JPGE_SSE2_DESCALE(s[1], CONST_BITS + ROW_BITS + 3);
+            s[2] = JPGE_SSE2_DESCALE(s[2], CONST_BITS + ROW_BITS + 3);
+            s[3] = JPGE_SSE2_DESCALE(s[3], CONST_BITS + ROW_BITS + 3);
+            s[4] = JPGE_SSE2_DESCALE(s[4], ROW_BITS + 3);
+            s[5] = JPGE_SSE2_DESCALE(s[5], CONST_BITS + ROW_BITS + 3);
+            s[6] = JPGE_SSE2_DESCALE(s[6], CONST_BITS + ROW_BITS + 3);
+            s[7] = JPGE_SSE2_DESCALE(s[7], CONST_BITS + ROW_BITS + 3);
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i * 8), m[0][i]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i * 8 + 4), m[1][i]);
+        }
+    }
+
+    // Rounded division of j by q with the sign of j, see load_quantized_coefficients().
+    static inline __m128i quantize4_sse2(__m128i j, __m128i q)
+    {
+        const __m128i sign = _mm_srai_epi32(j, 31);
+        __m128i n = _mm_add_epi32(_mm_sub_epi32(_mm_xor_si128(j, sign), sign), _mm_srai_epi32(q, 1));
+        n = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(n), _mm_cvtepi32_ps(q)));
+        return _mm_sub_epi32(_mm_xor_si128(n, sign), sign);
+    }
+
+    static void quantize_sse2(int16 *pDst, const int32 *pSamples, const int32 *q)
+    {
+        int32 zag[64];
+        for (int i = 0; i < 64; i++)
+            zag[i] = pSamples[s_zag[i]];
+        for (int i = 0; i < 64; i += 8)
+        {
+            __m128i lo = quantize4_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(zag + i)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(q + i)));
+            __m128i hi = quantize4_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(zag + i + 4)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(q + i + 4)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + i), _mm_packs_epi32(lo, hi));
+        }
+    }
+
+    static void load_block_8_8_grey_sse2(int32 *pDst, uint8 *const *pLines, int x)
+    {
+        const __m128i zero = _mm_setzero_si128(), level = _mm_set1_epi16(128);
+        x <<= 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+        {
+            __m128i s = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pLines[i] + x)), zero), level);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst), _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + 4), _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        }
+    }
+#endif
+
+#ifdef JPGE_AVX2
+#define JPGE_AVX2_MUL(x, c) _mm256_madd_epi16(x, _mm256_set1_epi32((c)&0xFFFF))
+#define JPGE_AVX2_DESCALE(x, n) _mm256_srai_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(1 << ((n)-1))), n)
+
+    JPGE_AVX2_TARGET static inline void transpose_8x8_avx2(__m256i *r)
+    {
+        __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+        __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+        __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+        __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+        r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+        r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+        r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+        r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+        r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+        r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+        r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+        r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+    }
+
+    JPGE_AVX2_TARGET static void DCT2D_avx2(int32 *p)
+    {
+        __m256i s[8];
+        for (int i = 0; i < 8; i++)
+            s[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i * 8));
+        transpose_8x8_avx2(s);
+        JPGE_DCT1D_SIMD(__m256i, _mm256_add_epi32, _mm256_sub_epi32, JPGE_AVX2_MUL, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+        s[0] = _mm256_slli_epi32(s[0], ROW_BITS);
+        s[1] = JPGE_AVX2_DESCALE(s[1], CONST_BITS - ROW_BITS);
+        s[2] = JPGE_AVX2_DESCALE(s[2], CONST_BITS - ROW_BITS);
+        s[3] = JPGE_AVX2_DESCALE(s[3], CONST_BITS - ROW_BITS);
+        s[4] = _mm256_slli_epi32(s[4], ROW_BITS);
+        s[5] = JPGE_AVX2_DESCALE(s[5], CONST_BITS - ROW_BITS);
+        s[6] = JPGE_AVX2_DESCALE(s[6], CONST_BITS - ROW_BITS);
+        s[7] = JPGE_AVX2_DESCALE(s[7], CONST_BITS - ROW_BITS);
+        transpose_8x8_avx2(s);
+        JPGE_DCT1D_SIMD(__m256i, _mm256_add_epi32, _mm256_sub_epi32, JPGE_AVX2_MUL, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+        s[0] = JPGE_AVX2_DESCALE(s[0], ROW_BITS + 3);
+        s[1] = JPGE_AVX2_DESCALE(s[1], CONST_BITS + ROW_BITS + 3);
+        s[2] = JPGE_AVX2_DESCALE(s[2], CONST_BITS + ROW_BITS + 3);
+        s[3] = JPGE_AVX2_DESCALE(s[3], CONST_BITS + ROW_BITS + 3);
+        s[4] = JPGE_AVX2_DESCALE(s[4], ROW_BITS + 3);
+        s[5] = JPGE_AVX2_DESCALE(s[5], CONST_BITS + ROW_BITS + 3);
+        s[6] = JPGE_AVX2_DESCALE(s[6], CONST_BITS + ROW_BITS + 3);
+        s[7] = JPGE_AVX2_DESCALE(s[7], CONST_BITS + ROW_BITS + 3);
+        for (int i = 0; i < 8; i++)
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(p + i * 8), s[i]);
+    }
+
+    JPGE_AVX2_TARGET static void quantize_avx2(int16 *pDst, const int32 *pSamples, const int32 *q)
+    {
+        int32 zag[64];
+        for (int i = 0; i < 64; i++)
+            zag[i] = pSamples[s_zag[i]];
+        for (int i = 0; i < 64; i += 8)
+        {
+            const __m256i j = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(zag + i));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q + i));
+            const __m256i sign = _mm256_srai_epi32(j, 31);
+            __m256i n = _mm256_add_epi32(_mm256_abs_epi32(j), _mm256_srai_epi32(d, 1));
+            n = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(n), _mm256_cvtepi32_ps(d)));
+            n = _mm256_sub_epi32(_mm256_xor_si256(n, sign), sign);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + i), _mm_packs_epi32(_mm256_castsi256_si128(n), _mm256_extracti128_si256(n, 1)));
+        }
+    }
+
+    JPGE_AVX2_TARGET static void load_block_8_8_grey_avx2(int32 *pDst, uint8 *const *pLines, int x)
+    {
+        const __m256i level = _mm256_set1_epi32(128);
+        x <<= 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst), _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pLines[i] + x))), level));
+    }
+
+    // Shuffle masks picking every third byte starting at byte c from 48 (16 pixels) or 24 (8 pixels) bytes loaded as
+    // three or two 16 byte vectors. Mask bytes with the top bit set select 0.
+    JPGE_AVX2_TARGET static inline void stride3_masks_avx2(int c, __m128i &m0, __m128i &m1, __m128i &m2)
+    {
+        const __m128i fifteen = _mm_set1_epi8(15), sixteen = _mm_set1_epi8(16);
+        const __m128i i0 = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s_stride3)), _mm_set1_epi8(static_cast<char>(c)));
+        const __m128i i1 = _mm_sub_epi8(i0, sixteen);
+        m0 = _mm_or_si128(i0, _mm_cmpgt_epi8(i0, fifteen));
+        m1 = _mm_or_si128(i1, _mm_cmpgt_epi8(i1, fifteen));
+        m2 = _mm_sub_epi8(i1, sixteen);
+    }
+
+    JPGE_AVX2_TARGET static void load_block_8_8_avx2(int32 *pDst, uint8 *const *pLines, int x, int c)
+    {
+        const __m256i level = _mm256_set1_epi32(128);
+        __m128i m0, m1, m2;
+        stride3_masks_avx2(c, m0, m1, m2);
+        x *= 8 * 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+        {
+            const uint8 *pSrc = pLines[i] + x;
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc)), m0);
+            v = _mm_or_si128(v, _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pSrc + 16)), m1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst), _mm256_sub_epi32(_mm256_cvtepu8_epi32(v), level));
+        }
+    }
+
+    // Sums of horizontally adjacent samples of component c of the 16 pixels at pSrc.
+    JPGE_AVX2_TARGET static inline __m128i load_pairs_avx2(const uint8 *pSrc, const __m128i &m0, const __m128i &m1, const __m128i &m2)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc)), m0);
+        v = _mm_or_si128(v, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + 16)), m1));
+        v = _mm_or_si128(v, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + 32)), m2));
+        return _mm_maddubs_epi16(v, _mm_set1_epi8(1));
+    }
+
+    JPGE_AVX2_TARGET static void load_block_16_8_avx2(int32 *pDst, uint8 *const *pLines, int x, int c)
+    {
+        const __m128i level = _mm_set1_epi16(128);
+        __m128i m0, m1, m2;
+        stride3_masks_avx2(c, m0, m1, m2);
+        x *= 16 * 3;
+        for (int i = 0; i < 16; i += 2, pDst += 8)
+        {
+            __m128i s = _mm_add_epi16(load_pairs_avx2(pLines[i] + x, m0, m1, m2), load_pairs_avx2(pLines[i + 1] + x, m0, m1, m2));
+            s = _mm_add_epi16(s, _mm_loadu_si128(reinterpret_cast<const __m128i *>(s_round_16_8[(i >> 1) & 1])));
+            s = _mm_sub_epi16(_mm_srli_epi16(s, 2), level);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst), _mm256_cvtepi16_epi32(s));
+        }
+    }
+
+    JPGE_AVX2_TARGET static void load_block_16_8_8_avx2(int32 *pDst, uint8 *const *pLines, int x, int c)
+    {
+        const __m128i level = _mm_set1_epi16(128);
+        __m128i m0, m1, m2;
+        stride3_masks_avx2(c, m0, m1, m2);
+        x *= 16 * 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+        {
+            __m128i s = _mm_sub_epi16(_mm_srli_epi16(load_pairs_avx2(pLines[i] + x, m0, m1, m2), 1), level);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst), _mm256_cvtepi16_epi32(s));
+        }
+    }
+
+    JPGE_AVX2_TARGET static inline __m256i ycc_avx2(const __m256i &r, const __m256i &g, const __m256i &b, int cr, int cg, int cb)
+    {
+        __m256i s = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(cr)), _mm256_mullo_epi32(g, _mm256_set1_epi32(cg)));
+        s = _mm256_add_epi32(s, _mm256_mullo_epi32(b, _mm256_set1_epi32(cb)));
+        return _mm256_srai_epi32(_mm256_add_epi32(s, _mm256_set1_epi32(32768)), 16);
+    }
+
+    JPGE_AVX2_TARGET static inline __m128i pack_epi32_avx2(const __m256i &v)
+    {
+        return _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    }
+
+    JPGE_AVX2_TARGET static void RGB_to_YCC_avx2(uint8 *pDst, const uint8 *pSrc, int num_pixels)
+    {
+        __m128i mr0, mr1, mg0, mg1, mb0, mb1, unused;
+        stride3_masks_avx2(0, mr0, mr1, unused);
+        stride3_masks_avx2(1, mg0, mg1, unused);
+        stride3_masks_avx2(2, mb0, mb1, unused);
+        // Interleaves 8 Y (bytes 0 - 7) and Cb (bytes 8 - 15) samples, and 8 Cr samples into 24 bytes.
+        const __m128i y0 = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+        const __m128i c0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+        const __m128i y1 = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i c1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i chroma = _mm256_set1_epi32(128);
+        for (; num_pixels >= 8; pDst += 24, pSrc += 24, num_pixels -= 8)
+        {
+            const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc));
+            const __m128i hi = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(pSrc + 16));
+            const __m256i r = _mm256_cvtepu8_epi32(_mm_or_si128(_mm_shuffle_epi8(lo, mr0), _mm_shuffle_epi8(hi, mr1)));
+            const __m256i g = _mm256_cvtepu8_epi32(_mm_or_si128(_mm_shuffle_epi8(lo, mg0), _mm_shuffle_epi8(hi, mg1)));
+            const __m256i b = _mm256_cvtepu8_epi32(_mm_or_si128(_mm_shuffle_epi8(lo, mb0), _mm_shuffle_epi8(hi, mb1)));
+            const __m128i y = pack_epi32_avx2(ycc_avx2(r, g, b, YR, YG, YB));
+            const __m128i cb = pack_epi32_avx2(_mm256_add_epi32(chroma, ycc_avx2(r, g, b, CB_R, CB_G, CB_B)));
+            const __m128i cr = pack_epi32_avx2(_mm256_add_epi32(chroma, ycc_avx2(r, g, b, CR_R, CR_G, CR_B)));
+            const __m128i ycb = _mm_packus_epi16(y, cb), crcr = _mm_packus_epi16(cr, cr);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst), _mm_or_si128(_mm_shuffle_epi8(ycb, y0), _mm_shuffle_epi8(crcr, c0)));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(pDst + 16), _mm_or_si128(_mm_shuffle_epi8(ycb, y1), _mm_shuffle_epi8(crcr, c1)));
+        }
+        RGB_to_YCC(pDst, pSrc, num_pixels);
+    }
+#endif
+
+#ifdef JPGE_NEON
+#define JPGE_NEON_MUL(x, c) vmull_s16(vmovn_s32(x), vdup_n_s16(c))
+
+    static inline void transpose_4x4_neon(int32x4_t &a, int32x4_t &b, int32x4_t &c, int32x4_t &d)
+    {
+        int32x4x2_t ab = vtrnq_s32(a, b), cd = vtrnq_s32(c, d);
+        a = vcombine_s32(vget_low_s32(ab.val[0]), vget_low_s32(cd.val[0]));
+        b = vcombine_s32(vget_low_s32(ab.val[1]), vget_low_s32(cd.val[1]));
+        c = vcombine_s32(vget_high_s32(ab.val[0]), vget_high_s32(cd.val[0]));
+        d = vcombine_s32(vget_high_s32(ab.val[1]), vget_high_s32(cd.val[1]));
+    }
+
+    // m[h][i] holds columns 4h to 4h + 3 of row i.
+    static inline void transpose_8x8_neon(int32x4_t m[2][8])
+    {
+        transpose_4x4_neon(m[0][0], m[0][1], m[0][2], m[0][3]);
+        transpose_4x4_neon(m[1][4], m[1][5], m[1][6], m[1][7]);
+        transpose_4x4_neon(m[1][0], m[1][1], m[1][2], m[1][3]);
+        transpose_4x4_neon(m[0][4], m[0][5], m[0][6], m[0][7]);
+        for (int i = 0; i < 4; i++)
+        {
+            int32x4_t t = m[1][i];
+            m[1][i] = m[0][4 + i];
+            m[0][4 + i] = t;
+        }
+    }
+
+    static void DCT2D_neon(int32 *p)
+    {
+        int32x4_t m[2][8];
+        for (int i = 0; i < 8; i++)
+        {
+            m[0][i] = vld1q_s32(p + i * 8);
+            m[1][i] = vld1q_s32(p + i * 8 + 4);
+        }
+        transpose_8x8_neon(m);
+        for (int h = 0; h < 2; h++)
+        {
+            int32x4_t *s = m[h];
+            JPGE_DCT1D_SIMD(int32x4_t, vaddq_s32, vsubq_s32, JPGE_NEON_MUL, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+            s[0] = vshlq_n_s32(s[0], ROW_BITS);
+            s[1] = vrshrq_n_s32(s[1], CONST_BITS - ROW_BITS);
+            s[2] = vrshrq_n_s32(s[2], CONST_BITS - ROW_BITS);
+            s[3] = vrshrq_n_s32(s[3], CONST_BITS - ROW_BITS);
+            s[4] = vshlq_n_s32(s[4], ROW_BITS);
+            s[5] = vrshrq_n_s32(s[5], CONST_BITS - ROW_BITS);
+            s[6] = vrshrq_n_s32(s[6], CONST_BITS - ROW_BITS);
+            s[7] = vrshrq_n_s32(s[7], CONST_BITS - ROW_BITS);
+        }
+        transpose_8x8_neon(m);
+        for (int h = 0; h < 2; h++)
+        {
+            int32x4_t *s = m[h];
+            JPGE_DCT1D_SIMD(int32x4_t, vaddq_s32, vsubq_s32, JPGE_NEON_MUL, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+            s[0] = vrshrq_n_s32(s[0], ROW_BITS + 3);
+            s[1] = vrshrq_n_s32(s[1], CONST_BITS + ROW_BITS + 3);
+            s[2] = vrshrq_n_s32(s[2], CONST_BITS + ROW_BITS + 3);
+            s[3] = vrshrq_n_s32(s[3], CONST_BITS + ROW_BITS + 3);
+            s[4] = vrshrq_n_s32(s[4], ROW_BITS + 3);
+            s[5] = vrshrq_n_s32(s[5], CONST_BITS + ROW_BITS + 3);
+            s[6] = vrshrq_n_s32(s[6], CONST_BITS + ROW_BITS + 3);
+            s[7] = vrshrq_n_s32(s[7], CONST_BITS + ROW_BITS + 3);
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            vst1q_s32(p + i * 8, m[0][i]);
+            vst1q_s32(p + i * 8 + 4, m[1][i]);
+        }
+    }
+
+#ifdef __aarch64__
+    static inline int32x4_t quantize4_neon(int32x4_t j, int32x4_t q)
+    {
+        const int32x4_t sign = vshrq_n_s32(j, 31);
+        int32x4_t n = vaddq_s32(vabsq_s32(j), vshrq_n_s32(q, 1));
+        n = vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(n), vcvtq_f32_s32(q)));
+        return vsubq_s32(veorq_s32(n, sign), sign);
+    }
+
+    static void quantize_neon(int16 *pDst, const int32 *pSamples, const int32 *q)
+    {
+        int32 zag[64];
+        for (int i = 0; i < 64; i++)
+            zag[i] = pSamples[s_zag[i]];
+        for (int i = 0; i < 64; i += 8)
+        {
+            int32x4_t lo = quantize4_neon(vld1q_s32(zag + i), vld1q_s32(q + i));
+            int32x4_t hi = quantize4_neon(vld1q_s32(zag + i + 4), vld1q_s32(q + i + 4));
+            vst1q_s16(pDst + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        }
+    }
+#endif
+
+    static inline void store_block_row_neon(int32 *pDst, int16x8_t s)
+    {
+        vst1q_s32(pDst, vmovl_s16(vget_low_s16(s)));
+        vst1q_s32(pDst + 4, vmovl_s16(vget_high_s16(s)));
+    }
+
+    static void load_block_8_8_grey_neon(int32 *pDst, uint8 *const *pLines, int x)
+    {
+        const int16x8_t level = vdupq_n_s16(128);
+        x <<= 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+            store_block_row_neon(pDst, vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pLines[i] + x))), level));
+    }
+
+    static void load_block_8_8_neon(int32 *pDst, uint8 *const *pLines, int x, int c)
+    {
+        const int16x8_t level = vdupq_n_s16(128);
+        x *= 8 * 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+        {
+            uint8x8x3_t v = vld3_u8(pLines[i] + x);
+            store_block_row_neon(pDst, vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v.val[c])), level));
+        }
+    }
+
+    static void load_block_16_8_neon(int32 *pDst, uint8 *const *pLines, int x, int c)
+    {
+        const int16x8_t level = vdupq_n_s16(128);
+        x *= 16 * 3;
+        for (int i = 0; i < 16; i += 2, pDst += 8)
+        {
+            uint8x16x3_t v1 = vld3q_u8(pLines[i] + x), v2 = vld3q_u8(pLines[i + 1] + x);
+            uint16x8_t s = vaddq_u16(vpaddlq_u8(v1.val[c]), vpaddlq_u8(v2.val[c]));
+            s = vshrq_n_u16(vaddq_u16(s, vld1q_u16(s_round_16_8[(i >> 1) & 1])), 2);
+            store_block_row_neon(pDst, vsubq_s16(vreinterpretq_s16_u16(s), level));
+        }
+    }
+
+    static void load_block_16_8_8_neon(int32 *pDst, uint8 *const *pLines, int x, int c)
+    {
+        const int16x8_t level = vdupq_n_s16(128);
+        x *= 16 * 3;
+        for (int i = 0; i < 8; i++, pDst += 8)
+        {
+            uint8x16x3_t v = vld3q_u8(pLines[i] + x);
+            store_block_row_neon(pDst, vsubq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vpaddlq_u8(v.val[c]), 1)), level));
+        }
+    }
+
+    static inline int32x4_t ycc_neon(int32x4_t r, int32x4_t g, int32x4_t b, int cr, int cg, int cb)
+    {
+        int32x4_t s = vmlaq_n_s32(vmlaq_n_s32(vmulq_n_s32(r, cr), g, cg), b, cb);
+        return vshrq_n_s32(vaddq_s32(s, vdupq_n_s32(32768)), 16);
+    }
+
+    // Converts 4 pixels to Y, Cb and Cr as int16 with the chroma level shift applied.
+    static inline void ycc4_neon(uint16x4_t r16, uint16x4_t g16, uint16x4_t b16, int16x4_t &y, int16x4_t &cb, int16x4_t &cr)
+    {
+        const int32x4_t r = vreinterpretq_s32_u32(vmovl_u16(r16)), g = vreinterpretq_s32_u32(vmovl_u16(g16)), b = vreinterpretq_s32_u32(vmovl_u16(b16));
+        const int32x4_t chroma = vdupq_n_s32(128);
+        y = vmovn_s32(ycc_neon(r, g, b, YR, YG, YB));
+        cb = vmovn_s32(vaddq_s32(chroma, ycc_neon(r, g, b, CB_R, CB_G, CB_B)));
+        cr = vmovn_s32(vaddq_s32(chroma, ycc_neon(r, g, b, CR_R, CR_G, CR_B)));
+    }
+
+    static void RGB_to_YCC_neon(uint8 *pDst, const uint8 *pSrc, int num_pixels)
+    {
+        for (; num_pixels >= 8; pDst += 24, pSrc += 24, num_pixels -= 8)
+        {
+            const uint8x8x3_t v = vld3_u8(pSrc);
+            const uint16x8_t r = vmovl_u8(v.val[0]), g = vmovl_u8(v.val[1]), b = vmovl_u8(v.val[2]);
+            int16x4_t y0, cb0, cr0, y1, cb1, cr1;
+            ycc4_neon(vget_low_u16(r), vget_low_u16(g), vget_low_u16(b), y0, cb0, cr0);
+            ycc4_neon(vget_high_u16(r), vget_high_u16(g), vget_high_u16(b), y1, cb1, cr1);
+            uint8x8x3_t o;
+            o.val[0] = vqmovun_s16(vcombine_s16(y0, y1));
+            o.val[1] = vqmovun_s16(vcombine_s16(cb0, cb1));
+            o.val[2] = vqmovun_s16(vcombine_s16(cr0, cr1));
+            vst3_u8(pDst, o);
+        }
+        RGB_to_YCC(pDst, pSrc, num_pixels);
+    }
+#endif
+
+    // Kernel table of one instruction set. The DCT and color conversion are always set, a NULL block loader or
+    // quantizer selects the scalar jpeg_encoder method.
+    struct simd_kernels
+    {
+        simd_t m_simd;
+        void (*m_dct)(int32 *p);
+        void (*m_rgb_to_ycc)(uint8 *pDst, const uint8 *pSrc, int num_pixels);
+        void (*m_quantize)(int16 *pDst, const int32 *pSamples, const int32 *q);
+        void (*m_load_block_8_8_grey)(int32 *pDst, uint8 *const *pLines, int x);
+        void (*m_load_block_8_8)(int32 *pDst, uint8 *const *pLines, int x, int c);
+        void (*m_load_block_16_8)(int32 *pDst, uint8 *const *pLines, int x, int c);
+        void (*m_load_block_16_8_8)(int32 *pDst, uint8 *const *pLines, int x, int c);
+    };
+
+    static const simd_kernels s_scalar_kernels = {SIMD_NONE, DCT2D, RGB_to_YCC, NULL, NULL, NULL, NULL, NULL};
+#ifdef JPGE_SSE2
+    // SSE2 has no byte shuffle for the 3 channel block loaders.
+    static const simd_kernels s_sse2_kernels = {SIMD_SSE2, DCT2D_sse2, RGB_to_YCC, quantize_sse2, load_block_8_8_grey_sse2, NULL, NULL, NULL};
+#endif
+#ifdef JPGE_AVX2
+    static const simd_kernels s_avx2_kernels = {SIMD_AVX2, DCT2D_avx2, RGB_to_YCC_avx2, quantize_avx2, load_block_8_8_grey_avx2, load_block_8_8_avx2, load_block_16_8_avx2, load_block_16_8_8_avx2};
+#endif
+#ifdef JPGE_NEON
+#ifdef __aarch64__
+    static const simd_kernels s_neon_kernels = {SIMD_NEON, DCT2D_neon, RGB_to_YCC_neon, quantize_neon, load_block_8_8_grey_neon, load_block_8_8_neon, load_block_16_8_neon, load_block_16_8_8_neon};
+#else
+    // 32-bit ARM has no vector division, the quantizer stays scalar.
+    static const simd_kernels s_neon_kernels = {SIMD_NEON, DCT2D_neon, RGB_to_YCC_neon, NULL, load_block_8_8_grey_neon, load_block_8_8_neon, load_block_16_8_neon, load_block_16_8_8_neon};
+#endif
+#endif
+
+    static const simd_kernels *find_simd_kernels(simd_t simd)
+    {
+        switch (simd)
+        {
+        case SIMD_NONE:
+            return &s_scalar_kernels;
+#ifdef JPGE_SSE2
+        case SIMD_SSE2:
+            return &s_sse2_kernels;
+#endif
+#ifdef JPGE_AVX2
+        case SIMD_AVX2:
+            return __builtin_cpu_supports("avx2") ? &s_avx2_kernels : NULL;
+#endif
+#ifdef JPGE_NEON
+        case SIMD_NEON:
+            return &s_neon_kernels;
+#endif
+        default:
+            return NULL;
+        }
+    }
+
+    static std::atomic<const simd_kernels *> s_simd_kernels(NULL);
+
+    static const simd_kernels *get_simd_kernels()
+    {
+        const simd_kernels *pKernels = s_simd_kernels.load();
+        if (!pKernels)
+        {
+            const simd_t best[] = {SIMD_AVX2, SIMD_SSE2, SIMD_NEON, SIMD_NONE};
+            for (uint i = 0; (!pKernels) && (i < sizeof(best) / sizeof(best[0])); i++)
+                pKernels = find_simd_kernels(best[i]);
+            s_simd_kernels.store(pKernels);
+        }
+        return pKernels;
+    }
+
+    simd_t get_simd()
+    {
+        return get_simd_kernels()->m_simd;
+    }
+
+    bool set_simd(simd_t simd)
+    {
+        const simd_kernels *pKernels = find_simd_kernels(simd);
+        if (!pKernels)
+            return false;
+        s_simd_kernels.store(pKernels);
+        return true;
+    }
+
     struct sym_freq
     {
         uint m_key, m_sym_index;
@@ -493,6 +1110,12 @@ namespace jpge
         emit_dqt();
         emit_sof();
         emit_dhts();
+        if (m_restart_interval)
+        {
+            emit_marker(M_DRI);
+            emit_word(4);
+            emit_word(m_restart_interval);
+        }
         emit_sos();
     }
 
@@ -561,15 +1184,19 @@ namespace jpge
 
     bool jpeg_encoder::second_pass_init()
     {
-        compute_huffman_table(&m_huff_codes[0 + 0][0], &m_huff_code_sizes[0 + 0][0], m_huff_bits[0 + 0], m_huff_val[0 + 0]);
-        compute_huffman_table(&m_huff_codes[2 + 0][0], &m_huff_code_sizes[2 + 0][0], m_huff_bits[2 + 0], m_huff_val[2 + 0]);
-        if (m_num_components > 1)
+        if (!m_std_huff_tables)
         {
-            compute_huffman_table(&m_huff_codes[0 + 1][0], &m_huff_code_sizes[0 + 1][0], m_huff_bits[0 + 1], m_huff_val[0 + 1]);
-            compute_huffman_table(&m_huff_codes[2 + 1][0], &m_huff_code_sizes[2 + 1][0], m_huff_bits[2 + 1], m_huff_val[2 + 1]);
+            compute_huffman_table(&m_huff_codes[0 + 0][0], &m_huff_code_sizes[0 + 0][0], m_huff_bits[0 + 0], m_huff_val[0 + 0]);
+            compute_huffman_table(&m_huff_codes[2 + 0][0], &m_huff_code_sizes[2 + 0][0], m_huff_bits[2 + 0], m_huff_val[2 + 0]);
+            if (m_num_components > 1)
+            {
+                compute_huffman_table(&m_huff_codes[0 + 1][0], &m_huff_code_sizes[0 + 1][0], m_huff_bits[0 + 1], m_huff_val[0 + 1]);
+                compute_huffman_table(&m_huff_codes[2 + 1][0], &m_huff_code_sizes[2 + 1][0], m_huff_bits[2 + 1], m_huff_val[2 + 1]);
+            }
         }
         first_pass_init();
-        emit_markers();
+        if (!m_strip_flag)
+            emit_markers();
         m_pass_num = 2;
         return true;
     }
@@ -635,32 +1262,51 @@ namespace jpge
         m_image_bpl_mcu = m_image_x_mcu * m_num_components;
         m_mcus_per_row = m_image_x_mcu / m_mcu_x;
 
-        if ((m_mcu_lines[0] = static_cast<uint8 *>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL)
-            return false;
+        uint mcu_buf_size = m_image_bpl_mcu * m_mcu_y;
+        if (mcu_buf_size > m_mcu_buf_size)
+        {
+            jpge_free(m_mcu_lines[0]);
+            m_mcu_buf_size = 0;
+            if ((m_mcu_lines[0] = static_cast<uint8 *>(jpge_malloc(mcu_buf_size))) == NULL)
+                return false;
+            m_mcu_buf_size = mcu_buf_size;
+        }
         for (int i = 1; i < m_mcu_y; i++)
             m_mcu_lines[i] = m_mcu_lines[i - 1] + m_image_bpl_mcu;
 
-        compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
-        compute_quant_table(m_quantization_tables[1], m_params.m_no_chroma_discrim_flag ? s_std_lum_quant : s_std_croma_quant);
+        if ((m_quant_quality != m_params.m_quality) || (m_quant_no_chroma_discrim_flag != m_params.m_no_chroma_discrim_flag))
+        {
+            compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
+            compute_quant_table(m_quantization_tables[1], m_params.m_no_chroma_discrim_flag ? s_std_lum_quant : s_std_croma_quant);
+            m_quant_quality = m_params.m_quality;
+            m_quant_no_chroma_discrim_flag = m_params.m_no_chroma_discrim_flag;
+        }
 
         m_out_buf_left = JPGE_OUT_BUF_SIZE;
         m_pOut_buf = m_out_buf;
 
         if (m_params.m_two_pass_flag)
         {
+            m_std_huff_tables = false; // replaced by the optimized tables after the first pass
             clear_obj(m_huff_count);
             first_pass_init();
         }
         else
         {
-            memcpy(m_huff_bits[0 + 0], s_dc_lum_bits, 17);
-            memcpy(m_huff_val[0 + 0], s_dc_lum_val, DC_LUM_CODES);
-            memcpy(m_huff_bits[2 + 0], s_ac_lum_bits, 17);
-            memcpy(m_huff_val[2 + 0], s_ac_lum_val, AC_LUM_CODES);
-            memcpy(m_huff_bits[0 + 1], s_dc_chroma_bits, 17);
-            memcpy(m_huff_val[0 + 1], s_dc_chroma_val, DC_CHROMA_CODES);
-            memcpy(m_huff_bits[2 + 1], s_ac_chroma_bits, 17);
-            memcpy(m_huff_val[2 + 1], s_ac_chroma_val, AC_CHROMA_CODES);
+            if (!m_std_huff_tables)
+            {
+                memcpy(m_huff_bits[0 + 0], s_dc_lum_bits, 17);
+                memcpy(m_huff_val[0 + 0], s_dc_lum_val, DC_LUM_CODES);
+                memcpy(m_huff_bits[2 + 0], s_ac_lum_bits, 17);
+                memcpy(m_huff_val[2 + 0], s_ac_lum_val, AC_LUM_CODES);
+                memcpy(m_huff_bits[0 + 1], s_dc_chroma_bits, 17);
+                memcpy(m_huff_val[0 + 1], s_dc_chroma_val, DC_CHROMA_CODES);
+                memcpy(m_huff_bits[2 + 1], s_ac_chroma_bits, 17);
+                memcpy(m_huff_val[2 + 1], s_ac_chroma_val, AC_CHROMA_CODES);
+                for (int i = 0; i < 4; i++)
+                    compute_huffman_table(&m_huff_codes[i][0], &m_huff_code_sizes[i][0], m_huff_bits[i], m_huff_val[i]);
+                m_std_huff_tables = true;
+            }
             if (!second_pass_init())
                 return false; // in effect, skip over the first pass
         }
@@ -669,6 +1315,11 @@ namespace jpge
 
     void jpeg_encoder::load_block_8_8_grey(int x)
     {
+        if (m_simd->m_load_block_8_8_grey)
+        {
+            m_simd->m_load_block_8_8_grey(m_sample_array, m_mcu_lines, x);
+            return;
+        }
         uint8 *pSrc;
         sample_array_t *pDst = m_sample_array;
         x <<= 3;
@@ -688,6 +1339,11 @@ namespace jpge
 
     void jpeg_encoder::load_block_8_8(int x, int y, int c)
     {
+        if (m_simd->m_load_block_8_8)
+        {
+            m_simd->m_load_block_8_8(m_sample_array, m_mcu_lines + (y << 3), x, c);
+            return;
+        }
         uint8 *pSrc;
         sample_array_t *pDst = m_sample_array;
         x = (x * (8 * 3)) + c;
@@ -708,6 +1364,11 @@ namespace jpge
 
     void jpeg_encoder::load_block_16_8(int x, int c)
     {
+        if (m_simd->m_load_block_16_8)
+        {
+            m_simd->m_load_block_16_8(m_sample_array, m_mcu_lines, x, c);
+            return;
+        }
         uint8 *pSrc1, *pSrc2;
         sample_array_t *pDst = m_sample_array;
         x = (x * (16 * 3)) + c;
@@ -732,6 +1393,11 @@ namespace jpge
 
     void jpeg_encoder::load_block_16_8_8(int x, int c)
     {
+        if (m_simd->m_load_block_16_8_8)
+        {
+            m_simd->m_load_block_16_8_8(m_sample_array, m_mcu_lines, x, c);
+            return;
+        }
         uint8 *pSrc1;
         sample_array_t *pDst = m_sample_array;
         x = (x * (16 * 3)) + c;
@@ -752,6 +1418,11 @@ namespace jpge
     void jpeg_encoder::load_quantized_coefficients(int component_num)
     {
         int32 *q = m_quantization_tables[component_num > 0];
+        if (m_simd->m_quantize)
+        {
+            m_simd->m_quantize(m_coefficient_array, m_sample_array, q);
+            return;
+        }
         int16 *pDst = m_coefficient_array;
         for (int i = 0; i < 64; i++)
         {
@@ -920,7 +1591,7 @@ namespace jpge
 
     void jpeg_encoder::code_block(int component_num)
     {
-        DCT2D(m_sample_array);
+        m_simd->m_dct(m_sample_array);
         load_quantized_coefficients(component_num);
         if (m_pass_num == 1)
             code_coefficients_pass_one(component_num);
@@ -1000,7 +1671,8 @@ namespace jpge
     {
         put_bits(0x7F, 7);
         flush_output_buffer();
-        emit_marker(M_EOI);
+        if (!m_strip_flag)
+            emit_marker(M_EOI);
         m_pass_num++; // purposely bump up m_pass_num, for debugging
         return true;
     }
@@ -1044,7 +1716,7 @@ namespace jpge
             if (m_image_bpp == 4)
                 RGBA_to_YCC(pDst, Psrc, m_image_x);
             else if (m_image_bpp == 3)
-                RGB_to_YCC(pDst, Psrc, m_image_x);
+                m_simd->m_rgb_to_ycc(pDst, Psrc, m_image_x);
             else
                 Y_to_YCC(pDst, Psrc, m_image_x);
         }
@@ -1074,8 +1746,21 @@ namespace jpge
     void jpeg_encoder::clear()
     {
         m_mcu_lines[0] = NULL;
+        m_mcu_buf_size = 0;
+        m_quant_quality = -1;
+        m_quant_no_chroma_discrim_flag = false;
+        m_std_huff_tables = false;
+        reset();
+    }
+
+    // Resets the state of the current image, keeping the scanline buffer and the tables for the next one.
+    void jpeg_encoder::reset()
+    {
         m_pass_num = 0;
         m_all_stream_writes_succeeded = true;
+        m_restart_interval = 0;
+        m_strip_flag = false;
+        m_simd = get_simd_kernels();
     }
 
     jpeg_encoder::jpeg_encoder()
@@ -1088,16 +1773,39 @@ namespace jpge
         deinit();
     }
 
-    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    bool jpeg_encoder::open(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, uint restart_interval, bool strip_flag)
     {
-        deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check()))
+        reset();
+        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check()) || (restart_interval > 0xFFFF))
             return false;
         m_pStream = pStream;
         m_params = comp_params;
+        m_restart_interval = restart_interval;
+        m_strip_flag = strip_flag;
         return jpg_open(width, height, src_channels);
     }
 
+    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        return open(pStream, width, height, src_channels, comp_params, 0, false);
+    }
+
+    bool jpeg_encoder::write_headers(output_stream *pStream, int width, int height, int src_channels, const params &comp_params, uint restart_interval)
+    {
+        params single_pass = comp_params;
+        single_pass.m_two_pass_flag = false;
+        bool status = open(pStream, width, height, src_channels, single_pass, restart_interval, false); // single pass: markers are written by jpg_open()
+        deinit();
+        return status;
+    }
+
+    bool jpeg_encoder::init_strip(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    {
+        params single_pass = comp_params;
+        single_pass.m_two_pass_flag = false;
+        return open(pStream, width, height, src_channels, single_pass, 0, true);
+    }
+
     void jpeg_encoder::deinit()
     {
         jpge_free(m_mcu_lines[0]);
@@ -1203,34 +1911,77 @@ namespace jpge
         return dst_stream.close();
     }
 
-    class memory_stream : public output_stream
+    bool memory_stream::put_buf(const void *pBuf, int len)
     {
-        memory_stream(const memory_stream &);
-        memory_stream &operator=(const memory_stream &);
-
-        uint8 *m_pBuf;
-        uint m_buf_size, m_buf_ofs;
-
-    public:
-        memory_stream(void *pBuf, uint buf_size) : m_pBuf(static_cast<uint8 *>(pBuf)), m_buf_size(buf_size), m_buf_ofs(0) {}
+        uint buf_remaining = m_buf_size - m_buf_ofs;
+        if ((uint)len > buf_remaining)
+            return false;
+        memcpy(m_pBuf + m_buf_ofs, pBuf, len);
+        m_buf_ofs += len;
+        return true;
+    }
 
-        virtual ~memory_stream() {}
+    bool vector_stream::put_buf(const void *pBuf, int len)
+    {
+        const uint8 *p = static_cast<const uint8 *>(pBuf);
+        m_buf.insert(m_buf.end(), p, p + len);
+        return true;
+    }
 
-        virtual bool put_buf(const void *pBuf, int len)
+#ifndef _WIN32
+    bool fd_stream::put_buf(const void *pBuf, int len)
+    {
+        const uint8 *p = static_cast<const uint8 *>(pBuf);
+        while (len > 0)
         {
-            uint buf_remaining = m_buf_size - m_buf_ofs;
-            if ((uint)len > buf_remaining)
+            ssize_t n;
+            if (m_socket)
+            {
+#ifdef MSG_NOSIGNAL
+                n = send(m_fd, p, len, MSG_NOSIGNAL);
+#else
+                n = send(m_fd, p, len, 0); // SIGPIPE is suppressed with SO_NOSIGPIPE where MSG_NOSIGNAL is missing
+#endif
+                if ((n < 0) && (errno == ENOTSOCK))
+                {
+                    m_socket = false;
+                    continue;
+                }
+            }
+            else
+                n = write(m_fd, p, len);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
                 return false;
-            memcpy(m_pBuf + m_buf_ofs, pBuf, len);
-            m_buf_ofs += len;
-            return true;
+            }
+            p += n;
+            len -= (int)n;
+            m_size += (uint)n;
         }
+        return true;
+    }
+#endif
 
-        uint get_size() const
+    bool compress_image_to_jpeg_stream(output_stream *pStream, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
+    {
+        jpge::jpeg_encoder dst_image;
+        if (!dst_image.init(pStream, width, height, num_channels, comp_params))
+            return false;
+
+        for (uint pass_index = 0; pass_index < dst_image.get_total_passes(); pass_index++)
         {
-            return m_buf_ofs;
+            for (int i = 0; i < height; i++)
+            {
+                if (!dst_image.process_scanline(pImage_data + (size_t)i * width * num_channels))
+                    return false;
+            }
+            if (!dst_image.process_scanline(NULL))
+                return false;
         }
-    };
+        return true;
+    }
 
     bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
     {
@@ -1272,4 +2023,109 @@ namespace jpge
         return true;
     }
 
+    bool compress_image_to_jpeg_file_in_memory_mt(void *pDstBuf, int &buf_size, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params, int num_threads)
+    {
+        if ((!pDstBuf) || (buf_size <= 0))
+            return false;
+
+        memory_stream dst_stream(pDstBuf, buf_size);
+        buf_size = 0;
+        if (!compress_image_to_jpeg_stream_mt(&dst_stream, width, height, num_channels, pImage_data, comp_params, num_threads))
+            return false;
+        buf_size = dst_stream.get_size();
+        return true;
+    }
+
+    bool compress_image_to_jpeg_stream_mt(output_stream *pStream, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params, int num_threads)
+    {
+        if (!pImage_data)
+            return false;
+        // rows are read in place
+        return compress_scanlines_to_jpeg_stream_mt(pStream, width, height, num_channels, [=](int y, uint8 *)
+                                                    { return pImage_data + (size_t)y * width * num_channels; },
+                                                    comp_params, num_threads);
+    }
+
+    bool compress_scanlines_to_jpeg_stream_mt(output_stream *pStream, int width, int height, int num_channels, const scanline_source &source, const params &comp_params, int num_threads)
+    {
+        if ((!pStream) || (!source) || (width < 1) || (height < 1) || ((num_channels != 1) && (num_channels != 3) && (num_channels != 4)) || (!comp_params.check()))
+            return false;
+
+        int threads = num_threads > 0 ? num_threads : (int)std::thread::hardware_concurrency();
+        int mcu_x = ((comp_params.m_subsampling == Y_ONLY) || (comp_params.m_subsampling == H1V1)) ? 8 : 16;
+        int mcu_y = (comp_params.m_subsampling == H2V2) ? 16 : 8;
+        int mcus_per_row = (width + mcu_x - 1) / mcu_x;
+        int mcu_rows = (height + mcu_y - 1) / mcu_y;
+
+        // a few strips per thread to balance the load, each strip must fit in a restart interval
+        int strip_rows = threads > 1 ? (mcu_rows + threads * 4 - 1) / (threads * 4) : mcu_rows;
+        strip_rows = JPGE_MIN(JPGE_MAX(strip_rows, 1), 0xFFFF / mcus_per_row);
+        if ((threads <= 1) || (comp_params.m_two_pass_flag) || (strip_rows < 1) || (strip_rows >= mcu_rows))
+        {
+            // serial, one scanline at a time
+            jpeg_encoder dst_image;
+            if (!dst_image.init(pStream, width, height, num_channels, comp_params))
+                return false;
+            std::vector<uint8> line((size_t)width * num_channels);
+            for (uint pass_index = 0; pass_index < dst_image.get_total_passes(); pass_index++)
+            {
+                for (int i = 0; i < height; i++)
+                {
+                    const uint8 *pScanline = source(i, line.data());
+                    if (!pScanline || !dst_image.process_scanline(pScanline))
+                        return false;
+                }
+                if (!dst_image.process_scanline(NULL))
+                    return false;
+            }
+            return true;
+        }
+        int num_strips = (mcu_rows + strip_rows - 1) / strip_rows;
+
+        std::vector<std::vector<uint8>> strips(num_strips);
+        std::vector<char> strip_ok(num_strips, 0);
+        std::atomic<int> next_strip(0);
+        auto encode_strips = [&]()
+        {
+            int strip;
+            jpeg_encoder strip_image;                         // reused for all strips of this thread
+            std::vector<uint8> line((size_t)width * num_channels); // scanline of this thread, for sources that convert rows
+            while ((strip = next_strip++) < num_strips)
+            {
+                int y0 = strip * strip_rows * mcu_y;
+                int y1 = JPGE_MIN(height, y0 + strip_rows * mcu_y);
+                strips[strip].reserve((size_t)width * (y1 - y0) * num_channels / 4 + 1024);
+                vector_stream strip_stream(strips[strip]);
+                if (!strip_image.init_strip(&strip_stream, width, y1 - y0, num_channels, comp_params))
+                    continue;
+                bool ok = true;
+                for (int i = y0; ok && i < y1; i++)
+                {
+                    const uint8 *pScanline = source(i, line.data());
+                    ok = pScanline && strip_image.process_scanline(pScanline);
+                }
+                strip_ok[strip] = ok && strip_image.process_scanline(NULL);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < JPGE_MIN(threads, num_strips); i++)
+            workers.push_back(std::thread(encode_strips));
+        encode_strips();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+
+        jpeg_encoder headers;
+        if (!headers.write_headers(pStream, width, height, num_channels, comp_params, strip_rows * mcus_per_row))
+            return false;
+        for (int strip = 0; strip < num_strips; strip++)
+        {
+            if (!strip_ok[strip] || !pStream->put_buf(strips[strip].data(), strips[strip].size()))
+                return false;
+            uint8 marker[2] = {0xFF, (uint8)(strip == num_strips - 1 ? M_EOI : M_RST0 + (strip & 7))};
+            if (!pStream->put_buf(marker, 2))
+                return false;
+        }
+        return true;
+    }
+
 } // namespace jpge